@@ -0,0 +1,182 @@
+#include "core/Checkpoint.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util/logging.hpp"
+
+/*
+ * The checkpoint file is line based:
+ * epa-ng checkpoint <version>
+ * query <query file>
+ * ranks <number of ranks>
+ * sequences <sequences done>
+ * chunks <chunks done>
+ * file <size> <path>
+ * ...
+ * end
+ * Paths are last on their line, so they may contain spaces. The closing line tells
+ * a complete file from one cut short.
+ */
+static const std::string CHECKPOINT_MAGIC("epa-ng checkpoint");
+
+Checkpoint::Checkpoint( std::string const& file_path,
+                        std::string const& query_file,
+                        size_t const num_ranks )
+  : file_path_(file_path)
+  , query_file_(query_file)
+  , num_ranks_(num_ranks)
+{ }
+
+static std::string rest_of(std::istringstream& line)
+{
+  std::string rest;
+  std::getline(line >> std::ws, rest);
+  return rest;
+}
+
+bool Checkpoint::load()
+{
+  std::ifstream in(file_path_);
+  if (not in.is_open()) {
+    return false;
+  }
+
+  const auto corrupt = [this](std::string const& what) {
+    return std::runtime_error{"Invalid checkpoint " + file_path_ + ": " + what};
+  };
+
+  std::string line;
+  if (not std::getline(in, line) or line.compare(0, CHECKPOINT_MAGIC.size(), CHECKPOINT_MAGIC)) {
+    throw corrupt("not a checkpoint file");
+  }
+  if (std::stoul(line.substr(CHECKPOINT_MAGIC.size())) != VERSION) {
+    throw corrupt("unsupported version");
+  }
+
+  std::vector<File_State> files;
+  size_t sequences_done = 0;
+  size_t chunks_done = 0;
+  bool complete = false;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    fields >> key;
+    if (key == "query") {
+      const auto query_file = rest_of(fields);
+      if (query_file != query_file_) {
+        throw std::runtime_error{"Checkpoint " + file_path_ + " was written for the query file "
+                                 + query_file + ", not " + query_file_};
+      }
+    } else if (key == "ranks") {
+      size_t num_ranks = 0;
+      fields >> num_ranks;
+      if (num_ranks != num_ranks_) {
+        throw std::runtime_error{"Checkpoint " + file_path_ + " was written by a run on "
+                                 + std::to_string(num_ranks) + " ranks, resume on as many"};
+      }
+    } else if (key == "sequences") {
+      fields >> sequences_done;
+    } else if (key == "chunks") {
+      fields >> chunks_done;
+    } else if (key == "file") {
+      File_State state;
+      fields >> state.size;
+      state.path = rest_of(fields);
+      files.push_back(state);
+    } else if (key == "end") {
+      complete = true;
+      break;
+    }
+    if (fields.fail()) {
+      throw corrupt("bad line: " + line);
+    }
+  }
+  if (not complete) {
+    throw corrupt("file is incomplete");
+  }
+
+  sequences_done_ = sequences_done;
+  chunks_done_ = chunks_done;
+  files_ = std::move(files);
+  return true;
+}
+
+void Checkpoint::save( size_t const sequences_done,
+                       size_t const chunks_done,
+                       std::vector<File_State> const& files )
+{
+  sequences_done_ = sequences_done;
+  chunks_done_ = chunks_done;
+  files_ = files;
+
+  std::ostringstream text;
+  text << CHECKPOINT_MAGIC << " " << VERSION << "\n";
+  text << "query " << query_file_ << "\n";
+  text << "ranks " << num_ranks_ << "\n";
+  text << "sequences " << sequences_done_ << "\n";
+  text << "chunks " << chunks_done_ << "\n";
+  for (auto const& file : files_) {
+    text << "file " << file.size << " " << file.path << "\n";
+  }
+  text << "end\n";
+  const auto data = text.str();
+
+  // written next to it, then renamed over it: a crash leaves the old or the new one
+  const auto tmp_path = file_path_ + ".tmp";
+  const int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error{tmp_path + ": could not open!"};
+  }
+  size_t done = 0;
+  bool ok = true;
+  while (ok and done < data.size()) {
+    const auto n = ::write(fd, data.data() + done, data.size() - done);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    ok = n > 0;
+    done += ok ? n : 0;
+  }
+  ok = ok and fsync(fd) == 0;
+  ok = (::close(fd) == 0) and ok;
+  if (not ok or std::rename(tmp_path.c_str(), file_path_.c_str()) != 0) {
+    const std::string reason = std::strerror(errno);
+    // the last complete checkpoint stays valid, the partial one goes
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error{"Failed to write checkpoint " + file_path_ + ": " + reason};
+  }
+}
+
+void Checkpoint::restore_files() const
+{
+  for (auto const& file : files_) {
+    struct stat info;
+    if (stat(file.path.c_str(), &info) != 0) {
+      throw std::runtime_error{"Cannot resume: output file " + file.path + " is missing"};
+    }
+    if (static_cast<size_t>(info.st_size) < file.size) {
+      throw std::runtime_error{"Cannot resume: output file " + file.path + " is shorter than checkpointed"};
+    }
+    if (static_cast<size_t>(info.st_size) > file.size) {
+      LOG_DBG << "Dropping " << info.st_size - file.size << " bytes written after the checkpoint from "
+              << file.path;
+      if (truncate(file.path.c_str(), file.size) != 0) {
+        throw std::runtime_error{"Cannot resume: failed to truncate " + file.path + ": " + std::strerror(errno)};
+      }
+    }
+  }
+}
+
+void Checkpoint::remove() const
+{
+  std::remove(file_path_.c_str());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "io/placement_writer_interface.hpp"
+
+/**
+ * Progress of a run, recorded after every chunk written, so that an interrupted run
+ * can be continued where it stopped (see --checkpoint and --resume).
+ *
+ * A checkpoint holds the number of sequences and chunks done, and the size of every
+ * output file after writing them. To resume, the outputs are cut back to these sizes
+ * (dropping whatever was written after the checkpoint), the reader skips the done
+ * sequences, and the writers append to the files.
+ *
+ * The checkpoint is a small text file, replaced atomically on every save. Under MPI,
+ * every rank keeps its own, for its part of the queries.
+ */
+class Checkpoint
+{
+public:
+  using File_State = placement_writer::File_State;
+
+  /**
+   * Checkpoint at file_path, of the placement of query_file on num_ranks ranks.
+   */
+  Checkpoint(std::string const& file_path,
+             std::string const& query_file,
+             size_t const num_ranks = 1);
+
+  /**
+   * Reads the checkpoint file. Returns false if there is none, throws if it is
+   * unreadable or belongs to a different run.
+   */
+  bool load();
+
+  /**
+   * Records the progress, replacing the checkpoint file.
+   */
+  void save(size_t const sequences_done,
+            size_t const chunks_done,
+            std::vector<File_State> const& files);
+
+  /**
+   * Cuts the output files back to their recorded size. Throws if one is missing or
+   * shorter than recorded.
+   */
+  void restore_files() const;
+
+  /**
+   * Deletes the checkpoint file, once the run is complete.
+   */
+  void remove() const;
+
+  std::string const& path() const { return file_path_; }
+  size_t sequences_done() const { return sequences_done_; }
+  size_t chunks_done() const { return chunks_done_; }
+  std::vector<File_State> const& files() const { return files_; }
+
+  static constexpr unsigned int VERSION = 1;
+
+private:
+  std::string file_path_;
+  std::string query_file_;
+  size_t num_ranks_;
+  size_t sequences_done_ = 0;
+  size_t chunks_done_ = 0;
+  std::vector<File_State> files_;
+};
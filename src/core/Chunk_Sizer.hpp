@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <limits>
+
+#include <unistd.h>
+
+#include "sample/Placement.hpp"
+#include "util/Options.hpp"
+
+/**
+ * Picks the number of query sequences to read per chunk.
+ *
+ * With a fixed chunk size (the default) this simply returns Options::chunk_size.
+ * In auto mode, the chunk size is bounded by a memory ceiling, derived from an
+ * estimate of the per-query memory footprint of a chunk, and adapted between
+ * chunks based on the measured throughput: chunks are grown for as long as that
+ * pays off (as the per-chunk overheads such as Tiny_Tree construction and the
+ * barriers at the end of each phase get amortized), or shrunk, also below the
+ * starting size, if growing never did or the best known size gets slower. When a
+ * step does not pay off, the best known size is used again.
+ */
+class Chunk_Sizer
+{
+public:
+  using duration = std::chrono::milliseconds;
+
+  Chunk_Sizer(const size_t num_branches,
+              const size_t sites,
+              const Options& options,
+              const size_t chunks_in_flight = 1)
+    : adaptive_(options.auto_chunk_size)
+    , current_(std::max<size_t>(options.chunk_size, 1u))
+  {
+    if (not adaptive_) {
+      return;
+    }
+
+    const size_t mem_limit  = options.chunk_memory
+                            ? options.chunk_memory * 1024ul * 1024ul
+                            : default_memory_limit();
+
+    per_query_ = bytes_per_query(num_branches, sites, options);
+    max_ = std::max<size_t>(mem_limit / (per_query_ * std::max<size_t>(chunks_in_flight, 1u)), 1u);
+    current_ = best_ = start_ = std::min(current_, max_);
+  }
+
+  Chunk_Sizer()   = delete;
+  ~Chunk_Sizer()  = default;
+
+  /**
+   * Number of sequences to request for the next chunk.
+   */
+  size_t next() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+  }
+
+  size_t max() const { return max_; }
+  size_t bytes_per_query() const { return per_query_; }
+
+  /**
+   * Report how long it took to process a chunk: the number of sequences it was read
+   * with (what next() returned at the time) and how many it got.
+   */
+  void update(const size_t requested, const size_t num_sequences, const duration time)
+  {
+    if (not adaptive_) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // partial chunks (end of input) say nothing about the chosen size
+    if (num_sequences < requested or num_sequences == 0) {
+      return;
+    }
+
+    const double ms = std::max<double>(time.count(), 1.0);
+    const double rate = num_sequences / ms;
+
+    if (rate > best_rate_ * grow_threshold_) {
+      // still improving: remember this size and keep going the same way
+      best_rate_ = rate;
+      best_ = requested;
+      current_ = shrinking_
+               ? std::max<size_t>(requested / 2u, 1u)
+               : std::min(requested * 2u, max_);
+    } else if (requested != best_) {
+      if (not shrinking_ and best_ == start_ and best_ > 1u) {
+        // larger chunks never paid off: try smaller ones instead
+        shrinking_ = true;
+        current_ = best_ / 2u;
+      } else {
+        // no better than what worked best: go back to it
+        current_ = best_;
+      }
+    } else if (rate < best_rate_ * shrink_threshold_ and best_ > 1u) {
+      // the best known size got slower: look for a better one below it
+      shrinking_ = true;
+      best_rate_ = rate;
+      current_ = best_ / 2u;
+    }
+  }
+
+  /**
+   * Estimated memory held per query sequence of a chunk: the sequence itself,
+   * the preplacement results and the thorough placement work and results.
+   */
+  static size_t bytes_per_query(const size_t num_branches,
+                                const size_t sites,
+                                const Options& options)
+  {
+    // header and sequence, roughly
+    size_t bytes = sites + 128u;
+
+    if (options.prescoring) {
+      // full preplacement sample
+      bytes += num_branches * sizeof(Placement);
+      // candidates: fixed heuristic is exact, the others are usually a small fraction
+      const double fraction = options.prescoring_by_percentage
+                            ? options.prescoring_threshold
+                            : 0.1;
+      const auto candidates = std::max<size_t>(fraction * num_branches, 1u);
+      bytes += candidates * (sizeof(Placement) + sizeof(size_t));
+    } else {
+      bytes += num_branches * (sizeof(Placement) + sizeof(size_t));
+    }
+
+    return bytes;
+  }
+
+  /**
+   * A quarter of the physical memory, or 1 GiB if that cannot be determined.
+   */
+  static size_t default_memory_limit()
+  {
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 or page_size <= 0) {
+      return 1024ul * 1024ul * 1024ul;
+    }
+    return static_cast<size_t>(pages) * static_cast<size_t>(page_size) / 4u;
+  }
+
+private:
+  static constexpr double grow_threshold_   = 1.05;
+  static constexpr double shrink_threshold_ = 0.9;
+
+  bool adaptive_;
+  size_t current_;
+  size_t best_ = 0;
+  size_t start_ = 0;
+  bool shrinking_ = false;
+  size_t max_ = std::numeric_limits<size_t>::max();
+  size_t per_query_ = 0;
+  double best_rate_ = 0.0;
+  mutable std::mutex mutex_;
+};
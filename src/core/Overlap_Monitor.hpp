@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+/**
+ * Bookkeeping for the thread idle time at the end of the thorough placement of a
+ * chunk.
+ *
+ * Threads record the intervals during which they worked on tasks of either phase.
+ * When a chunk is closed, the tail window of every thread is the time from when it
+ * finished its last thorough task to when the last thorough task of the chunk
+ * finished overall: with a barrier after each phase, that is time spent idle. The
+ * part of that window a thread instead spent prescoring the next chunk counts as
+ * recovered.
+ *
+ * record() may be called concurrently by different threads, as long as each uses
+ * its own thread id. close_chunk() must not run concurrently with record().
+ */
+class Overlap_Monitor
+{
+public:
+  using clock       = std::chrono::steady_clock;
+  using time_point  = clock::time_point;
+  using duration    = std::chrono::duration<double, std::milli>;
+
+  enum class Phase { kPrescore, kThorough };
+
+  explicit Overlap_Monitor(const size_t num_threads)
+    : intervals_(std::max<size_t>(num_threads, 1u))
+  { }
+
+  Overlap_Monitor()   = delete;
+  ~Overlap_Monitor()  = default;
+
+  void record(const size_t tid,
+              const Phase phase,
+              const time_point begin,
+              const time_point end)
+  {
+    intervals_[tid].push_back({phase, begin, end});
+  }
+
+  /**
+   * Evaluate and forget the intervals recorded since the last call.
+   */
+  void close_chunk()
+  {
+    bool any_thorough = false;
+    time_point phase_start = time_point::max();
+    time_point phase_end = time_point::min();
+    for (auto& thread : intervals_) {
+      for (auto& iv : thread) {
+        if (iv.phase == Phase::kThorough) {
+          any_thorough = true;
+          phase_start = std::min(phase_start, iv.begin);
+          phase_end = std::max(phase_end, iv.end);
+        }
+      }
+    }
+
+    if (any_thorough) {
+      for (auto& thread : intervals_) {
+        // threads that did no thorough work at all idled for the whole phase
+        time_point last_done = phase_start;
+        for (auto& iv : thread) {
+          if (iv.phase == Phase::kThorough) {
+            last_done = std::max(last_done, iv.end);
+          }
+        }
+        tail_ += phase_end - last_done;
+
+        for (auto& iv : thread) {
+          if (iv.phase == Phase::kPrescore) {
+            const auto from = std::max(iv.begin, last_done);
+            const auto to   = std::min(iv.end, phase_end);
+            if (from < to) {
+              recovered_ += to - from;
+            }
+          }
+        }
+      }
+      ++chunks_;
+    }
+
+    for (auto& thread : intervals_) {
+      thread.clear();
+    }
+  }
+
+  /**
+   * Accumulated tail idle time a barrier after each thorough phase would have cost.
+   */
+  duration tail() const { return tail_; }
+
+  /**
+   * Part of tail() spent prescoring the next chunk instead.
+   */
+  duration recovered() const { return recovered_; }
+
+  double recovered_fraction() const
+  {
+    return tail_.count() > 0.0 ? recovered_.count() / tail_.count() : 0.0;
+  }
+
+  size_t chunks() const { return chunks_; }
+
+private:
+  struct Interval
+  {
+    Phase phase;
+    time_point begin;
+    time_point end;
+  };
+
+  std::vector<std::vector<Interval>> intervals_;
+  duration tail_{0};
+  duration recovered_{0};
+  size_t chunks_ = 0;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <utility>
+
+#include "seq/MSA.hpp"
+#include "core/Work.hpp"
+#include "pipeline/Token.hpp"
+
+/**
+ * A chunk of query sequences travelling through the placement pipeline, together
+ * with the global ID of its first sequence and, once prescored, the candidate
+ * branches to be evaluated thoroughly.
+ */
+class Query_Chunk : public Token
+{
+public:
+  Query_Chunk() = default;
+  ~Query_Chunk() = default;
+
+  Query_Chunk(Query_Chunk const& other) = default;
+  Query_Chunk(Query_Chunk&& other)      = default;
+
+  Query_Chunk& operator= (Query_Chunk const& other) = default;
+  Query_Chunk& operator= (Query_Chunk && other)     = default;
+
+  // member access
+  MSA& msa() { return msa_; }
+  Work& work() { return work_; }
+  size_t seq_id_offset() const { return seq_id_offset_; }
+  void seq_id_offset(const size_t offset) { seq_id_offset_ = offset; }
+  // the number of sequences requested when reading the chunk
+  size_t requested_size() const { return requested_size_; }
+  void requested_size(const size_t n) { requested_size_ = n; }
+
+  size_t size() const { return msa_.size(); }
+  void clear() { msa_.clear(); work_.clear(); }
+
+private:
+  MSA msa_;
+  Work work_;
+  size_t seq_id_offset_ = 0;
+  size_t requested_size_ = 0;
+};
@@ -0,0 +1,318 @@
+#include "core/Query_Dedup.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include "util/logging.hpp"
+
+// records between two entries of the sparse index of a spill run
+constexpr size_t DEDUP_INDEX_STRIDE = 64;
+// bits per key, and number of probes, of the bloom filter of a spill run
+constexpr size_t DEDUP_BLOOM_BITS = 10;
+constexpr size_t DEDUP_BLOOM_PROBES = 4;
+
+static_assert(std::is_trivially_copyable<Placement>::value,
+              "spill runs store placements as raw bytes");
+
+/**
+ * A sorted, immutable part of the table on disk. A record is
+ * <key a><key b><number of placements><placement>...
+ */
+struct Query_Dedup::Run
+{
+  std::string file_name;
+  int fd = -1;
+  uint64_t size = 0;
+  std::vector<std::pair<Seq_Key, uint64_t>> index;
+  std::vector<uint64_t> bloom;
+
+  ~Run()
+  {
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (not file_name.empty()) {
+      std::remove(file_name.c_str());
+    }
+  }
+
+  size_t bloom_bit(const Seq_Key& key, const size_t i) const
+  {
+    return (key.a + i * (key.b | 1u)) % (bloom.size() * 64u);
+  }
+
+  void bloom_add(const Seq_Key& key)
+  {
+    for (size_t i = 0; i < DEDUP_BLOOM_PROBES; ++i) {
+      const auto bit = bloom_bit(key, i);
+      bloom[bit / 64u] |= (1ull << (bit % 64u));
+    }
+  }
+
+  bool maybe_contains(const Seq_Key& key) const
+  {
+    for (size_t i = 0; i < DEDUP_BLOOM_PROBES; ++i) {
+      const auto bit = bloom_bit(key, i);
+      if (not (bloom[bit / 64u] & (1ull << (bit % 64u)))) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+template <class T>
+static inline void append_int(std::string& buffer, const T value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <class T>
+static inline T take_int(const char*& p)
+{
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return value;
+}
+
+static size_t table_entry_bytes(const Query_Dedup::placements_type& placements)
+{
+  // rough per entry overhead of the hash map: node, bucket, vector
+  return 64u + placements.size() * sizeof(Placement);
+}
+
+Seq_Key Query_Dedup::key_of(const std::string& sequence)
+{
+  Seq_Key key;
+  key.a = std::hash<std::string>()(sequence);
+
+  // FNV-1a, as a second independent hash
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const auto c : sequence) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ull;
+  }
+  key.b = hash;
+  return key;
+}
+
+Query_Dedup::Query_Dedup(const size_t memory_limit, const std::string& spill_dir)
+  : memory_limit_(memory_limit)
+  , spill_dir_(spill_dir)
+{ }
+
+Query_Dedup::~Query_Dedup() = default;
+
+void Query_Dedup::filter(MSA& chunk, const size_t seq_id_offset)
+{
+  kept_.clear();
+  late_.clear();
+
+  std::vector<Seq_Key> keys(chunk.size());
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    keys[i] = key_of(chunk[i].sequence());
+  }
+
+  // position in kept_ or late_ of the first occurrence of a key in this chunk
+  std::unordered_map<Seq_Key, std::pair<bool, size_t>, Seq_Key_Hash> seen;
+  seen.reserve(chunk.size());
+
+  MSA unique(chunk.num_sites());
+  placements_type placements;
+
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    const auto& key = keys[i];
+    const auto& s = chunk[i];
+    const auto found = seen.find(key);
+
+    if (found != seen.end()) {
+      const auto& where = found->second;
+      auto& duplicates = where.first
+                       ? late_[where.second].duplicates
+                       : kept_[where.second].duplicates;
+      duplicates.push_back(s.header());
+      ++num_duplicates_;
+    } else if (lookup_(key, placements)) {
+      // placed as part of an earlier chunk
+      seen.emplace(key, std::make_pair(true, late_.size()));
+      late_.push_back({seq_id_offset + i, s.header(), {}, std::move(placements)});
+      placements.clear();
+      ++num_duplicates_;
+    } else {
+      seen.emplace(key, std::make_pair(false, kept_.size()));
+      kept_.push_back({seq_id_offset + i, key, {}});
+      unique.append(s.header(), s.sequence());
+      ++num_unique_;
+    }
+  }
+
+  MSA::swap(chunk, unique);
+}
+
+void Query_Dedup::resolve(Sample<Placement>& sample, const size_t seq_id_offset)
+{
+  for (auto& pq : sample) {
+    const auto idx = pq.sequence_id() - seq_id_offset;
+    if (idx >= kept_.size()) {
+      throw std::runtime_error{"Placement result does not match the deduplicated chunk"};
+    }
+    auto& kept = kept_[idx];
+
+    pq.sequence_id(kept.input_id);
+    for (auto& name : kept.duplicates) {
+      pq.add_duplicate(std::move(name));
+    }
+
+    insert_(kept.key, pq.data());
+  }
+
+  for (auto& late : late_) {
+    PQuery<Placement> pq(late.input_id, late.header);
+    pq.append(late.placements.cbegin(), late.placements.cend());
+    for (auto& name : late.duplicates) {
+      pq.add_duplicate(std::move(name));
+    }
+    sample.push_back(std::move(pq));
+  }
+
+  kept_.clear();
+  late_.clear();
+
+  if (memory_limit_ and table_bytes_ > memory_limit_) {
+    spill_();
+  }
+}
+
+bool Query_Dedup::lookup_(const Seq_Key& key, placements_type& placements) const
+{
+  const auto found = table_.find(key);
+  if (found != table_.end()) {
+    placements = found->second;
+    return true;
+  }
+
+  for (const auto& run : runs_) {
+    if (not run->maybe_contains(key)) {
+      continue;
+    }
+
+    // the sparse index narrows the search down to one stretch of records
+    auto next = std::upper_bound( run->index.begin(), run->index.end(), key,
+                                  [](const Seq_Key& k, const std::pair<Seq_Key, uint64_t>& e){
+                                    return k < e.first;
+                                  });
+    if (next == run->index.begin()) {
+      continue;
+    }
+    const uint64_t begin = std::prev(next)->second;
+    const uint64_t end = next == run->index.end() ? run->size : next->second;
+
+    std::string buffer(end - begin, '\0');
+    size_t done = 0;
+    while (done < buffer.size()) {
+      const auto n = pread(run->fd, &buffer[done], buffer.size() - done, begin + done);
+      if (n <= 0) {
+        throw std::runtime_error{"Failed to read from dedup spill file: " + run->file_name};
+      }
+      done += n;
+    }
+
+    const char* p = buffer.data();
+    const char* const p_end = p + buffer.size();
+    while (p < p_end) {
+      Seq_Key record;
+      record.a = take_int<uint64_t>(p);
+      record.b = take_int<uint64_t>(p);
+      const auto count = take_int<uint64_t>(p);
+      if (record == key) {
+        placements.resize(count);
+        std::memcpy(placements.data(), p, count * sizeof(Placement));
+        return true;
+      }
+      if (key < record) {
+        break;
+      }
+      p += count * sizeof(Placement);
+    }
+  }
+
+  return false;
+}
+
+void Query_Dedup::insert_(const Seq_Key& key, const placements_type& placements)
+{
+  const auto inserted = table_.emplace(key, placements);
+  if (inserted.second) {
+    table_bytes_ += table_entry_bytes(placements);
+  }
+}
+
+void Query_Dedup::spill_()
+{
+  std::vector<Seq_Key> keys;
+  keys.reserve(table_.size());
+  for (const auto& entry : table_) {
+    keys.push_back(entry.first);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  auto run = std::make_unique<Run>();
+  // a unique name, as the output directory may be shared by processes on other hosts
+  std::string file_name = spill_dir_ + "epa_dedup.XXXXXX";
+  run->fd = mkstemp(&file_name[0]);
+  if (run->fd < 0) {
+    throw std::runtime_error{"Cannot open dedup spill file in: " + spill_dir_};
+  }
+  run->file_name = file_name;
+  run->bloom.assign(std::max<size_t>((keys.size() * DEDUP_BLOOM_BITS + 63u) / 64u, 1u), 0u);
+
+  std::string buffer;
+  auto flush = [&](){
+    size_t done = 0;
+    while (done < buffer.size()) {
+      const auto n = write(run->fd, buffer.data() + done, buffer.size() - done);
+      if (n <= 0) {
+        throw std::runtime_error{"Failed to write dedup spill file: " + run->file_name};
+      }
+      done += n;
+    }
+    buffer.clear();
+  };
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const auto& key = keys[i];
+    const auto& placements = table_[key];
+
+    if (i % DEDUP_INDEX_STRIDE == 0) {
+      run->index.emplace_back(key, run->size + buffer.size());
+    }
+    run->bloom_add(key);
+
+    append_int<uint64_t>(buffer, key.a);
+    append_int<uint64_t>(buffer, key.b);
+    append_int<uint64_t>(buffer, placements.size());
+    buffer.append(reinterpret_cast<const char*>(placements.data()),
+                  placements.size() * sizeof(Placement));
+
+    if (buffer.size() >= (1u << 20)) {
+      run->size += buffer.size();
+      flush();
+    }
+  }
+  run->size += buffer.size();
+  flush();
+
+  LOG_DBG << "Spilled " << keys.size() << " deduplicated queries to " << run->file_name;
+
+  runs_.push_back(std::move(run));
+  table_.clear();
+  table_bytes_ = 0;
+}
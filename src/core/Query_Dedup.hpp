@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "seq/MSA.hpp"
+#include "sample/Sample.hpp"
+
+/**
+ * 128 bit fingerprint of a (premasked) query sequence.
+ */
+struct Seq_Key
+{
+  uint64_t a = 0;
+  uint64_t b = 0;
+
+  bool operator==(const Seq_Key& other) const { return a == other.a and b == other.b; }
+  bool operator<(const Seq_Key& other) const
+  {
+    return a < other.a or (a == other.a and b < other.b);
+  }
+};
+
+struct Seq_Key_Hash
+{
+  size_t operator()(const Seq_Key& key) const { return key.a; }
+};
+
+/**
+ * Streaming deduplication of identical query sequences.
+ *
+ * Before placement, filter() reduces a chunk to the sequences that were not seen
+ * before: duplicates within the chunk are folded into their first occurrence, and
+ * sequences that were already placed as part of an earlier chunk are taken out.
+ * After placement, resolve() gives the pqueries their input order ids, adds the
+ * headers of the folded duplicates to their name list, remembers the placements,
+ * and adds a pquery for every group of sequences that had been placed before.
+ *
+ * The placements of all unique sequences are kept in a hash table, which is
+ * spilled to disk as a sorted run (with a sparse index and a bloom filter) whenever
+ * it grows beyond the memory limit.
+ */
+class Query_Dedup
+{
+public:
+  using placements_type = std::vector<Placement>;
+
+  /**
+   * memory_limit in bytes, 0 to never spill. Spill files go to spill_dir.
+   */
+  Query_Dedup(const size_t memory_limit, const std::string& spill_dir);
+  ~Query_Dedup();
+
+  Query_Dedup(Query_Dedup const& other) = delete;
+  Query_Dedup& operator= (Query_Dedup const& other) = delete;
+
+  /**
+   * seq_id_offset is the input position of the first sequence of the chunk.
+   */
+  void filter(MSA& chunk, const size_t seq_id_offset);
+
+  /**
+   * The sample holds the pqueries of the filtered chunk, numbered seq_id_offset plus
+   * their position in it.
+   */
+  void resolve(Sample<Placement>& sample, const size_t seq_id_offset);
+
+  size_t num_unique() const { return num_unique_; }
+  size_t num_duplicates() const { return num_duplicates_; }
+  size_t num_spills() const { return runs_.size(); }
+
+  static Seq_Key key_of(const std::string& sequence);
+
+private:
+  struct Kept
+  {
+    size_t input_id;
+    Seq_Key key;
+    std::vector<std::string> duplicates;
+  };
+
+  struct Late
+  {
+    size_t input_id;
+    std::string header;
+    std::vector<std::string> duplicates;
+    placements_type placements;
+  };
+
+  struct Run;
+
+  bool lookup_(const Seq_Key& key, placements_type& placements) const;
+  void insert_(const Seq_Key& key, const placements_type& placements);
+  void spill_();
+
+  // state of the current chunk, between filter and resolve
+  std::vector<Kept> kept_;
+  std::vector<Late> late_;
+
+  std::unordered_map<Seq_Key, placements_type, Seq_Key_Hash> table_;
+  size_t table_bytes_ = 0;
+  size_t memory_limit_ = 0;
+  std::string spill_dir_;
+  std::vector<std::unique_ptr<Run>> runs_;
+
+  size_t num_unique_ = 0;
+  size_t num_duplicates_ = 0;
+};
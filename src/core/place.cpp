@@ -5,6 +5,9 @@
 #include <memory>
 #include <functional>
 #include <limits>
+#include <algorithm>
+#include <chrono>
+#include <exception>
 
 #ifdef __OMP
 #include <omp.h>
@@ -14,19 +17,29 @@
 #include "io/jplace_util.hpp"
 #include "io/msa_reader.hpp"
 #include "io/Binary_Fasta.hpp"
-#include "io/jplace_writer.hpp"
+#include "io/placement_writer.hpp"
+#include "io/Summary_Writer.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
 #include "util/Timer.hpp"
+#include "util/numa.hpp"
+#include "util/parallel.hpp"
 #include "tree/Tiny_Tree.hpp"
+#include "tree/Branch_Distances.hpp"
 #include "net/mpihead.hpp"
 #include "pipeline/schedule.hpp"
 #include "pipeline/Pipeline.hpp"
+#include "pipeline/Threaded_Pipeline.hpp"
 #include "seq/MSA.hpp"
 #include "core/pll/pll_util.hpp"
 #include "core/pll/epa_pll_util.hpp"
 #include "core/Work.hpp"
 #include "core/Lookup_Store.hpp"
+#include "core/Query_Chunk.hpp"
+#include "core/Chunk_Sizer.hpp"
+#include "core/Overlap_Monitor.hpp"
+#include "core/Query_Dedup.hpp"
+#include "core/Checkpoint.hpp"
 #include "core/Work.hpp"
 #include "core/heuristics.hpp"
 #include "sample/Sample.hpp"
@@ -38,13 +51,131 @@
 
 using mytimer = Timer<std::chrono::milliseconds>;
 
+/**
+ * Read-only reference data (tree CLVs, edge list, lookup tables) as seen by one
+ * NUMA node. Without --numa there is exactly one of these, shared by all threads.
+ */
+struct Reference_Replica
+{
+  Tree * tree;
+  std::vector<pll_unode_t *> branches;
+  std::shared_ptr<Lookup_Store> lookups;
+};
+
+using replica_list = std::vector<Reference_Replica>;
+
+static Reference_Replica make_replica(Tree& tree)
+{
+  const auto num_branches = tree.nums().branches;
+
+  Reference_Replica replica;
+  replica.tree = &tree;
+  replica.branches.resize(num_branches);
+
+  // get all edges
+  auto num_traversed_branches = utree_query_branches(tree.tree(), &replica.branches[0]);
+  if (num_traversed_branches != num_branches) {
+    throw std::runtime_error{"Traversing the utree went wrong during pipeline startup!"};
+  }
+
+  replica.lookups =
+    std::make_shared<Lookup_Store>(num_branches, tree.partition()->states);
+
+  return replica;
+}
+
+/**
+ * Pins the OpenMP worker threads to NUMA nodes and builds one replica of the
+ * reference per additional node, copied by a thread of that node so that
+ * first-touch allocation keeps it local. Node 0 uses the original reference tree.
+ *
+ * The calling thread is left unpinned: threads it spawns later inherit its affinity.
+ */
+static replica_list make_replicas(Tree& reference_tree,
+                                  std::vector<Tree>& replica_trees,
+                                  const Options& options)
+{
+#ifdef __OMP
+  const size_t num_threads  = options.num_threads
+                            ? options.num_threads
+                            : omp_get_max_threads();
+  // never more replicas than there are threads to build and use them
+  size_t num_nodes          = options.numa
+                            ? std::min(get_num_numa_nodes(), num_threads)
+                            : 1;
+  if (num_nodes > 1
+      and options.repeats
+      and not reference_tree.options().load_binary_mode) {
+    LOG_WARN << "NUMA mode can not replicate a reference using site repeats, using a single reference replica";
+    num_nodes = 1;
+  }
+#else
+  const size_t num_nodes = 1;
+  if (options.numa) {
+    LOG_WARN << "NUMA mode requires OpenMP support, using a single reference replica";
+  }
+#endif
+
+  replica_trees.clear();
+  replica_trees.resize(num_nodes - 1);
+
+#ifdef __OMP
+  if (num_nodes > 1) {
+    omp_set_num_threads(num_threads);
+    First_Error error;
+
+    #pragma omp parallel
+    {
+      const size_t tid  = omp_get_thread_num();
+      const auto node   = get_numa_node(tid, num_threads, num_nodes);
+
+      if (tid > 0 and not pin_to_numa_node(node)) {
+        #pragma omp critical
+        {
+          LOG_WARN << "Could not pin thread " << tid << " to NUMA node " << node;
+        }
+      }
+
+      // the first thread of each further node copies the reference for it
+      if (node > 0 and get_numa_node(tid - 1, num_threads, num_nodes) != node) {
+        try {
+          replica_trees[node - 1] = reference_tree.replicate();
+        } catch (...) {
+          error.capture();
+        }
+      }
+    }
+
+    error.rethrow();
+    LOG_INFO << "NUMA mode: replicated the reference data across " << num_nodes << " nodes";
+    if (num_nodes < get_num_numa_nodes()) {
+      LOG_INFO << "NUMA mode: threads on the remaining " << get_num_numa_nodes() - num_nodes
+               << " nodes use the nearest replica";
+    }
+  }
+#endif
+
+  replica_list result;
+  result.push_back(make_replica(reference_tree));
+  for (auto& tree : replica_trees) {
+    result.push_back(make_replica(tree));
+  }
+  return result;
+}
+
+/**
+ * The replica of the NUMA node the calling thread runs on.
+ */
+static Reference_Replica& local_replica(replica_list& replicas)
+{
+  return replicas[ current_numa_node(replicas.size()) ];
+}
+
 template <class T>
 static void place(MSA& msa,
-                  Tree& reference_tree,
-                  const std::vector<pll_unode_t *>& branches,
+                  replica_list& replicas,
                   Sample<T>& sample,
                   const Options& options,
-                  std::shared_ptr<Lookup_Store>& lookup_store,
                   mytimer* time=nullptr)
 {
 
@@ -60,7 +191,7 @@ static void place(MSA& msa,
 #endif
 
   const size_t num_sequences  = msa.size();
-  const size_t num_branches   = branches.size();
+  const size_t num_branches   = replicas.front().branches.size();
 
   std::vector<std::unique_ptr<Tiny_Tree>> branch_ptrs(num_threads);
   auto prev_branch_id = std::numeric_limits<size_t>::max();
@@ -69,37 +200,45 @@ static void place(MSA& msa,
     time->start();
   }
 #ifdef __OMP
-  #pragma omp parallel for schedule(guided, 10000), firstprivate(prev_branch_id)
+  #pragma omp parallel firstprivate(prev_branch_id)
 #endif
-  for (size_t i = 0; i < num_sequences * num_branches; ++i) {
+  {
+    // timed per thread and loop, as timing every placement costs more than it tells
+    Phase_Timer place_time(Stat_Phase::kPrescore);
+#ifdef __OMP
+    #pragma omp for schedule(guided, 10000) nowait
+#endif
+    for (size_t i = 0; i < num_sequences * num_branches; ++i) {
 
 #ifdef __OMP
-    const auto tid = omp_get_thread_num();
+      const auto tid = omp_get_thread_num();
 #else
-    const auto tid = 0;
+      const auto tid = 0;
 #endif
-    // reference to the threadlocal branch
-    auto& branch = branch_ptrs[tid];
-
-    const auto branch_id = static_cast<size_t>(i) / num_sequences;
-    const auto seq_id = i % num_sequences;
-
-    // get a tiny tree representing the current branch,
-    // IF the branch has changed. Overwriting the old variable ensures
-    // the now unused previous tiny tree is deallocated
-    if ((branch_id != prev_branch_id) or not branch) {
-      // as make_unique produces an rvalue, this is a move assignment and thus legal
-      branch = std::make_unique<Tiny_Tree>(branches[branch_id],
-                                           branch_id,
-                                           reference_tree,
-                                           false,
-                                           options,
-                                           lookup_store);
+      // reference to the threadlocal branch
+      auto& branch = branch_ptrs[tid];
+
+      const auto branch_id = static_cast<size_t>(i) / num_sequences;
+      const auto seq_id = i % num_sequences;
+
+      // get a tiny tree representing the current branch,
+      // IF the branch has changed. Overwriting the old variable ensures
+      // the now unused previous tiny tree is deallocated
+      if ((branch_id != prev_branch_id) or not branch) {
+        auto& local = local_replica(replicas);
+        // as make_unique produces an rvalue, this is a move assignment and thus legal
+        branch = std::make_unique<Tiny_Tree>(local.branches[branch_id],
+                                             branch_id,
+                                             *local.tree,
+                                             false,
+                                             options,
+                                             local.lookups);
+      }
+
+      sample[seq_id][branch_id] = branch->place(msa[seq_id]);
+
+      prev_branch_id = branch_id;
     }
-
-    sample[seq_id][branch_id] = branch->place(msa[seq_id]);
-
-    prev_branch_id = branch_id;
   }
   if (time){
     time->stop();
@@ -109,11 +248,9 @@ static void place(MSA& msa,
 template <class T>
 static void place_thorough(const Work& to_place,
                   MSA& msa,
-                  Tree& reference_tree,
-                  const std::vector<pll_unode_t *>& branches,
+                  replica_list& replicas,
                   Sample<T>& sample,
                   const Options& options,
-                  std::shared_ptr<Lookup_Store>& lookup_store,
                   const size_t seq_id_offset=0,
                   mytimer* time=nullptr)
 {
@@ -149,43 +286,51 @@ static void place_thorough(const Work& to_place,
     time->start();
   }
 #ifdef __OMP
-  #pragma omp parallel for schedule(dynamic), firstprivate(prev_branch_id)
+  #pragma omp parallel firstprivate(prev_branch_id)
+#endif
+  {
+    // timed per thread and loop, as timing every placement costs more than it tells
+    Phase_Timer place_time(Stat_Phase::kBLO);
+#ifdef __OMP
+    #pragma omp for schedule(dynamic) nowait
 #endif
-  for (size_t i = 0; i < id.size(); ++i) {
+    for (size_t i = 0; i < id.size(); ++i) {
 
 #ifdef __OMP
-    const auto tid = omp_get_thread_num();
+      const auto tid = omp_get_thread_num();
 #else
-    const auto tid = 0;
+      const auto tid = 0;
 #endif
-    auto& local_sample = sample_parts[tid];
-    auto& seq_lookup = seq_lookup_vec[tid];
-
-    const auto branch_id = id[i].branch_id;
-    const auto seq_id = id[i].sequence_id;
-    const auto& seq = msa[seq_id];
-
-    // get a tiny tree representing the current branch,
-    // IF the branch has changed. Overwriting the old variable ensures
-    // the now unused previous tiny tree is deallocated
-    if ((branch_id != prev_branch_id) or not branch_ptrs[tid]) {
-      // as make_unique produces an rvalue, this is a move assignment and thus legal
-      branch_ptrs[tid] = std::make_unique<Tiny_Tree>(branches[branch_id],
-                                           branch_id,
-                                           reference_tree,
-                                           true,
-                                           options,
-                                           lookup_store);
-    }
-
-    if (seq_lookup.count( seq_id ) == 0) {
-      auto const new_idx = local_sample.add_pquery( seq_id_offset + seq_id, seq.header() );
-      seq_lookup[ seq_id ] = new_idx;
+      auto& local_sample = sample_parts[tid];
+      auto& seq_lookup = seq_lookup_vec[tid];
+
+      const auto branch_id = id[i].branch_id;
+      const auto seq_id = id[i].sequence_id;
+      const auto& seq = msa[seq_id];
+
+      // get a tiny tree representing the current branch,
+      // IF the branch has changed. Overwriting the old variable ensures
+      // the now unused previous tiny tree is deallocated
+      if ((branch_id != prev_branch_id) or not branch_ptrs[tid]) {
+        auto& local = local_replica(replicas);
+        // as make_unique produces an rvalue, this is a move assignment and thus legal
+        branch_ptrs[tid] = std::make_unique<Tiny_Tree>(local.branches[branch_id],
+                                             branch_id,
+                                             *local.tree,
+                                             true,
+                                             options,
+                                             local.lookups);
+      }
+
+      if (seq_lookup.count( seq_id ) == 0) {
+        auto const new_idx = local_sample.add_pquery( seq_id_offset + seq_id, seq.header() );
+        seq_lookup[ seq_id ] = new_idx;
+      }
+      assert( seq_lookup.count( seq_id ) > 0 );
+      local_sample[ seq_lookup[ seq_id ] ].emplace_back( branch_ptrs[tid]->place(seq) );
+
+      prev_branch_id = branch_id;
     }
-    assert( seq_lookup.count( seq_id ) > 0 );
-    local_sample[ seq_lookup[ seq_id ] ].emplace_back( branch_ptrs[tid]->place(seq) );
-
-    prev_branch_id = branch_id;
   }
   if (time){
     time->stop();
@@ -195,6 +340,447 @@ static void place_thorough(const Work& to_place,
   collapse(sample);
 }
 
+static size_t timed_read(msa_reader& reader, MSA& chunk, const size_t number)
+{
+  Phase_Timer read_time(Stat_Phase::kRead);
+  return reader.read_next(chunk, number);
+}
+
+static void timed_write(placement_writer& jplace, Sample<Placement>& sample)
+{
+  Phase_Timer write_time(Stat_Phase::kOutput);
+  jplace.write( sample );
+}
+
+static Work select_candidates(MSA& chunk,
+                              replica_list& replicas,
+                              Sample<Placement>& preplace,
+                              const Options& options)
+{
+  const auto num_branches = replicas.front().branches.size();
+
+  if (not options.prescoring) {
+    return Work(std::make_pair(0, num_branches), std::make_pair(0, chunk.size()));
+  }
+
+  LOG_DBG << "Preplacement." << std::endl;
+  place(chunk,
+        replicas,
+        preplace,
+        options);
+
+  LOG_DBG << "Selecting candidates." << std::endl;
+  return apply_heuristic(preplace, options);
+}
+
+static Sample<Placement> place_candidates(const Work& blo_work,
+                                          MSA& chunk,
+                                          replica_list& replicas,
+                                          const Options& options,
+                                          const size_t seq_id_offset)
+{
+  Sample<Placement> blo_sample;
+
+  LOG_DBG << "BLO Placement." << std::endl;
+  place_thorough( blo_work,
+                  chunk,
+                  replicas,
+                  blo_sample,
+                  options,
+                  seq_id_offset);
+
+  Phase_Timer lwr_time(Stat_Phase::kLWRFilter);
+  // before the weights are summed up, so that they do not differ in the last digits
+  if (options.deterministic) {
+#ifdef __OMP
+    const size_t num_threads  = options.num_threads
+                              ? options.num_threads
+                              : omp_get_max_threads();
+#else
+    const size_t num_threads = 1;
+#endif
+    sort_canonically(blo_sample, num_threads);
+  }
+  compute_and_set_lwr(blo_sample);
+  filter(blo_sample, options);
+
+  return blo_sample;
+}
+
+/**
+ * The placements of a chunk on its way to the writer, and the number of sequences
+ * the chunk was read with.
+ */
+struct Placed_Chunk : public Token
+{
+  Sample<Placement> sample;
+  size_t requested_size = 0;
+};
+
+/**
+ * Shared memory placement as a threaded pipeline: while one chunk is placed
+ * thoroughly, the next one is already read and prescored, and the previous one
+ * written. Prescoring and thorough placement get their own OpenMP thread budgets.
+ */
+static void pipelined_placement(msa_reader& reader,
+                                replica_list& replicas,
+                                placement_writer& jplace,
+                                const size_t sites,
+                                const Options& options)
+{
+  const auto num_branches = replicas.front().branches.size();
+
+#ifdef __OMP
+  const unsigned int num_threads  = options.num_threads
+                                  ? options.num_threads
+                                  : omp_get_max_threads();
+#else
+  const unsigned int num_threads = 1;
+#endif
+
+  // per-stage thread budgets, by default splitting the available threads evenly
+  auto prescore_options = options;
+  auto thorough_options = options;
+  prescore_options.num_threads  = options.prescore_threads
+                                ? options.prescore_threads
+                                : std::max(1u, num_threads / 2u);
+  thorough_options.num_threads  = options.thorough_threads
+                                ? options.thorough_threads
+                                : std::max(1u, num_threads - prescore_options.num_threads);
+
+  LOG_INFO << "Pipelined placement: " << prescore_options.num_threads << " prescoring thread(s), "
+           << thorough_options.num_threads << " thorough placement thread(s), queue depth "
+           << options.pipeline_depth;
+
+  size_t sequences_read = 0;
+  size_t sequences_done = 0;
+
+  // every stage holds a chunk, and so may every queue slot
+  const size_t chunks_in_flight = 4u + 3u * options.pipeline_depth;
+  Chunk_Sizer chunk_sizer(num_branches, sites, options, chunks_in_flight);
+  auto last_write = std::chrono::steady_clock::now();
+
+  auto read_stage = [&](VoidToken&) {
+    Query_Chunk chunk;
+    chunk.requested_size(chunk_sizer.next());
+    const auto num_sequences = timed_read(reader, chunk.msa(), chunk.requested_size());
+    chunk.seq_id_offset(sequences_read + reader.local_seq_offset());
+    sequences_read += num_sequences;
+    if (not num_sequences) {
+      chunk.is_last(true);
+    }
+    return chunk;
+  };
+
+  auto prescore_stage = [&](Query_Chunk& chunk) {
+    Sample<Placement> preplace;
+    if (options.prescoring) {
+      preplace = Sample<Placement>(chunk.size(), num_branches);
+    }
+    chunk.work() = select_candidates(chunk.msa(), replicas, preplace, prescore_options);
+    return std::move(chunk);
+  };
+
+  auto thorough_stage = [&](Query_Chunk& chunk) {
+    Placed_Chunk placed;
+    placed.sample = place_candidates(chunk.work(),
+                                     chunk.msa(),
+                                     replicas,
+                                     thorough_options,
+                                     chunk.seq_id_offset());
+    placed.requested_size = chunk.requested_size();
+    return placed;
+  };
+
+  auto write_stage = [&](Placed_Chunk& placed) {
+    auto& sample = placed.sample;
+    timed_write(jplace, sample);
+
+    // the time between two writes is the time the pipeline took per chunk. Chunks
+    // still in flight were read with an earlier size, so they report that one
+    const auto now = std::chrono::steady_clock::now();
+    chunk_sizer.update(placed.requested_size,
+                       sample.size(),
+                       std::chrono::duration_cast<Chunk_Sizer::duration>(now - last_write));
+    last_write = now;
+
+    sequences_done += sample.size();
+    LOG_INFO << sequences_done  << " Sequences done!";
+    return VoidToken();
+  };
+
+  make_threaded_pipeline(read_stage, options.pipeline_depth)
+    .push(prescore_stage)
+    .push(thorough_stage)
+    .push(write_stage)
+    .process();
+}
+
+#ifdef __OMP
+/**
+ * A chunk on its way through overlapped placement. Tasks refer to it by pointer,
+ * so it lives on the heap until its results are written.
+ */
+struct Overlap_Chunk
+{
+  MSA msa;
+  size_t seq_id_offset = 0;
+  size_t requested_size = 0;
+  Sample<Placement> preplace;
+  Work work;
+  std::vector<Work::Work_Pair> pairs;
+  std::vector<Sample<Placement>> parts;
+};
+
+static size_t task_grain(const size_t total, const size_t num_threads)
+{
+  // a few tasks per thread keep the imbalance at the end of a phase small
+  return std::max<size_t>(total / (num_threads * 8u), 1u);
+}
+
+static void spawn_prescore_tasks(Overlap_Chunk* chunk,
+                                 replica_list* replicas,
+                                 const Options* options,
+                                 Overlap_Monitor* monitor,
+                                 const size_t num_threads)
+{
+  const size_t num_sequences  = chunk->msa.size();
+  const size_t num_branches   = replicas->front().branches.size();
+  const size_t total          = num_sequences * num_branches;
+  const size_t grain          = task_grain(total, num_threads);
+
+  for (size_t begin = 0; begin < total; begin += grain) {
+    const size_t end = std::min(begin + grain, total);
+
+    #pragma omp task firstprivate(begin, end, chunk, replicas, options, monitor)
+    {
+      const auto start  = Overlap_Monitor::clock::now();
+      const size_t tid  = omp_get_thread_num();
+      auto& local = local_replica(*replicas);
+      Phase_Timer place_time(Stat_Phase::kPrescore);
+
+      std::unique_ptr<Tiny_Tree> branch;
+      auto prev_branch_id = std::numeric_limits<size_t>::max();
+
+      for (size_t i = begin; i < end; ++i) {
+        const auto branch_id = i / num_sequences;
+        const auto seq_id = i % num_sequences;
+
+        if (branch_id != prev_branch_id) {
+          branch = std::make_unique<Tiny_Tree>(local.branches[branch_id],
+                                               branch_id,
+                                               *local.tree,
+                                               false,
+                                               *options,
+                                               local.lookups);
+          prev_branch_id = branch_id;
+        }
+
+        chunk->preplace[seq_id][branch_id] = branch->place(chunk->msa[seq_id]);
+      }
+
+      monitor->record(tid, Overlap_Monitor::Phase::kPrescore, start, Overlap_Monitor::clock::now());
+    }
+  }
+}
+
+static void spawn_thorough_tasks(Overlap_Chunk* chunk,
+                                 replica_list* replicas,
+                                 const Options* options,
+                                 Overlap_Monitor* monitor,
+                                 const size_t num_threads)
+{
+  chunk->pairs.clear();
+  for(auto it = chunk->work.begin(); it != chunk->work.end(); ++it) {
+    chunk->pairs.push_back(*it);
+  }
+
+  const size_t total = chunk->pairs.size();
+  const size_t grain = task_grain(total, num_threads);
+
+  // every task fills its own part of the result
+  chunk->parts.clear();
+  chunk->parts.resize((total + grain - 1) / grain);
+
+  for (size_t part = 0; part < chunk->parts.size(); ++part) {
+
+    #pragma omp task firstprivate(part, chunk, replicas, options, monitor)
+    {
+      const auto start  = Overlap_Monitor::clock::now();
+      const size_t tid  = omp_get_thread_num();
+      auto& local = local_replica(*replicas);
+      Phase_Timer place_time(Stat_Phase::kBLO);
+      auto& local_sample = chunk->parts[part];
+      std::unordered_map<size_t, size_t> seq_lookup;
+
+      std::unique_ptr<Tiny_Tree> branch;
+      auto prev_branch_id = std::numeric_limits<size_t>::max();
+
+      const size_t end = std::min((part + 1) * grain, total);
+      for (size_t i = part * grain; i < end; ++i) {
+        const auto branch_id = chunk->pairs[i].branch_id;
+        const auto seq_id = chunk->pairs[i].sequence_id;
+        const auto& seq = chunk->msa[seq_id];
+
+        if (branch_id != prev_branch_id) {
+          branch = std::make_unique<Tiny_Tree>(local.branches[branch_id],
+                                               branch_id,
+                                               *local.tree,
+                                               true,
+                                               *options,
+                                               local.lookups);
+          prev_branch_id = branch_id;
+        }
+
+        if (seq_lookup.count( seq_id ) == 0) {
+          seq_lookup[ seq_id ] = local_sample.add_pquery( chunk->seq_id_offset + seq_id, seq.header() );
+        }
+        local_sample[ seq_lookup[ seq_id ] ].emplace_back( branch->place(seq) );
+      }
+
+      monitor->record(tid, Overlap_Monitor::Phase::kThorough, start, Overlap_Monitor::clock::now());
+    }
+  }
+}
+
+/**
+ * Merges, weighs, filters and writes the results of a chunk in the background.
+ * Tasks spawned by consecutive loop iterations are ordered by the taskwait in between.
+ */
+static void spawn_finish_task(Overlap_Chunk* chunk,
+                              placement_writer* jplace,
+                              const Options* options,
+                              size_t* sequences_done)
+{
+  #pragma omp task firstprivate(chunk, jplace, options, sequences_done)
+  {
+    std::unique_ptr<Overlap_Chunk> owned(chunk);
+
+    Sample<Placement> blo_sample;
+    merge(blo_sample, std::move(owned->parts));
+    collapse(blo_sample);
+    {
+      Phase_Timer lwr_time(Stat_Phase::kLWRFilter);
+      if (options->deterministic) {
+        // on this thread alone, the others are busy with placement tasks
+        sort_canonically(blo_sample, 1);
+      }
+      compute_and_set_lwr(blo_sample);
+      filter(blo_sample, *options);
+    }
+
+    timed_write(*jplace, blo_sample);
+
+    *sequences_done += owned->msa.size();
+    LOG_INFO << *sequences_done  << " Sequences done!";
+  }
+}
+
+static Work candidates_of(Overlap_Chunk& chunk,
+                          const size_t num_branches,
+                          const Options& options)
+{
+  if (not options.prescoring) {
+    return Work(std::make_pair(0, num_branches), std::make_pair(0, chunk.msa.size()));
+  }
+  return apply_heuristic(chunk.preplace, options);
+}
+
+/**
+ * Shared memory placement as a stream of OpenMP tasks, executed by one persistent
+ * thread team instead of a fresh parallel loop per phase. The thorough placement
+ * tasks of a chunk and the prescoring tasks of the next one are in flight together,
+ * so that threads running out of thorough work continue with the next chunk rather
+ * than waiting at a barrier. Reports how much of that tail idle time was recovered.
+ */
+static void overlapped_placement(msa_reader& reader,
+                                 replica_list& replicas,
+                                 placement_writer& jplace,
+                                 const size_t sites,
+                                 const Options& options)
+{
+  const auto num_branches = replicas.front().branches.size();
+  const size_t num_threads  = options.num_threads
+                            ? options.num_threads
+                            : omp_get_max_threads();
+
+  // the chunk being placed, the one being prescored and the one being written
+  Chunk_Sizer chunk_sizer(num_branches, sites, options, 3u);
+  Overlap_Monitor monitor(num_threads);
+  mytimer chunk_time;
+
+  size_t sequences_read = 0;
+  size_t sequences_done = 0;
+
+  auto read_chunk = [&]() {
+    auto chunk = std::make_unique<Overlap_Chunk>();
+    chunk->requested_size = chunk_sizer.next();
+    const auto num_sequences = timed_read(reader, chunk->msa, chunk->requested_size);
+    chunk->seq_id_offset = sequences_read + reader.local_seq_offset();
+    sequences_read += num_sequences;
+
+    if (not num_sequences) {
+      chunk.reset();
+    } else if (options.prescoring) {
+      chunk->preplace = Sample<Placement>(num_sequences, num_branches);
+    }
+    return chunk;
+  };
+
+  LOG_INFO << "Overlapped placement using " << num_threads << " thread(s)";
+
+  omp_set_num_threads(num_threads);
+
+  #pragma omp parallel
+  #pragma omp single
+  {
+    auto current = read_chunk();
+    if (current and options.prescoring) {
+      spawn_prescore_tasks(current.get(), &replicas, &options, &monitor, num_threads);
+      #pragma omp taskwait
+    }
+    if (current) {
+      current->work = candidates_of(*current, num_branches, options);
+    }
+
+    while (current) {
+      chunk_time.start();
+      const auto num_sequences = current->msa.size();
+      const auto requested_size = current->requested_size;
+
+      spawn_thorough_tasks(current.get(), &replicas, &options, &monitor, num_threads);
+
+      // threads done with the thorough placement pick up these tasks, instead of idling
+      auto next = read_chunk();
+      if (next and options.prescoring) {
+        spawn_prescore_tasks(next.get(), &replicas, &options, &monitor, num_threads);
+      }
+
+      #pragma omp taskwait
+      monitor.close_chunk();
+
+      spawn_finish_task(current.release(), &jplace, &options, &sequences_done);
+
+      if (next) {
+        next->work = candidates_of(*next, num_branches, options);
+      }
+
+      chunk_time.stop();
+      chunk_sizer.update(requested_size, num_sequences, chunk_time.last_duration());
+
+      current = std::move(next);
+    }
+    #pragma omp taskwait
+  }
+
+  LOG_INFO << "Chunk overlap: recovered " << static_cast<size_t>(monitor.recovered().count())
+           << " of " << static_cast<size_t>(monitor.tail().count())
+           << " ms thread tail idle time at thorough placement barriers ("
+           << static_cast<size_t>(monitor.recovered_fraction() * 100.0) << "%) over "
+           << monitor.chunks() << " chunk(s)";
+}
+#endif
+
 void simple_mpi(Tree& reference_tree,
                 const std::string& query_file,
                 const MSA_Info& msa_info,
@@ -203,99 +789,213 @@ void simple_mpi(Tree& reference_tree,
                 const std::string& invocation)
 {
   const auto num_branches = reference_tree.nums().branches;
+  const auto sites  = options.premasking
+                    ? msa_info.sites() - msa_info.gap_count()
+                    : msa_info.sites();
 
-  // get all edges
-  std::vector<pll_unode_t *> branches(num_branches);
-  auto num_traversed_branches = utree_query_branches(reference_tree.tree(), &branches[0]);
-  if (num_traversed_branches != num_branches) {
-    throw std::runtime_error{"Traversing the utree went wrong during pipeline startup!"};
-  }
-
-  auto lookups =
-    std::make_shared<Lookup_Store>(num_branches, reference_tree.partition()->states);
+  // one set of reference data per NUMA node (just one unless --numa)
+  std::vector<Tree> replica_trees;
+  auto replicas = make_replicas(reference_tree, replica_trees, options);
 
   auto reader = make_msa_reader(query_file,
                                 msa_info,
                                 options.premasking,
-                                true);
+                                true,
+                                options.mmap_queries,
+                                options.parse_threads);
 
   size_t num_sequences = 0;
-  Work all_work(std::make_pair(0, num_branches), std::make_pair(0, options.chunk_size));
-
-  Work blo_work;
 
   using Sample = Sample<Placement>;
   MSA chunk;
   size_t sequences_done = 0; // not just for info output!
+  size_t chunks_done = 0;
+
+  // outputs of the individual ranks are told apart by a prefix
+  std::string rank_prefix;
+  size_t num_ranks = 1;
+  #ifdef __MPI
+  int local_rank = 0;
+  int world_size = 1;
+  MPI_COMM_RANK(MPI_COMM_WORLD, &local_rank);
+  MPI_COMM_SIZE(MPI_COMM_WORLD, &world_size);
+  rank_prefix = std::to_string(local_rank) + ".";
+  num_ranks = world_size;
+  #endif
+
+  // continue after the last checkpoint of an interrupted run, if requested
+  std::unique_ptr<Checkpoint> checkpoint;
+  bool resumed = false;
+  if (options.checkpoint) {
+    checkpoint = std::make_unique<Checkpoint>(outdir + rank_prefix + "epa_checkpoint",
+                                              query_file,
+                                              num_ranks);
+    if (options.resume) {
+      int found = checkpoint->load();
+      int any_found = found;
+      #ifdef __MPI
+      // a rank may have been interrupted before it saved its first checkpoint
+      MPI_Allreduce(&found, &any_found, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+      #endif
+      if (found) {
+        checkpoint->restore_files();
+        sequences_done = checkpoint->sequences_done();
+        chunks_done = checkpoint->chunks_done();
+        reader->skip(sequences_done);
+        resumed = true;
+        LOG_INFO << "Resuming from " << checkpoint->path() << ": " << sequences_done
+                 << " sequences in " << chunks_done << " chunks were done";
+      } else if (any_found) {
+        // nothing of this rank's part was done: start it over, other ranks resume
+        LOG_INFO << "No checkpoint at " << checkpoint->path()
+                 << ", placing this rank's part from the beginning";
+      } else {
+        // starting over would truncate whatever outputs are there
+        throw std::runtime_error{"Nothing to resume: no checkpoint found at " + checkpoint->path()
+                                 + ". Rerun without --resume to start from the beginning."};
+      }
+    }
+  }
 
   // prepare output file
-  LOG_INFO << "Output file: " << outdir + "epa_result.jplace";
-  jplace_writer jplace( outdir, "epa_result.jplace",
-                        get_numbered_newick_string( reference_tree.tree(),
-                                                    reference_tree.mapper(),
-                                                    options.precision ),
-                        invocation,
-                        reference_tree.mapper());
-  jplace.set_precision( options.precision );
+  std::string out_file;
+  auto writer = make_placement_writer( outdir,
+                                       get_numbered_newick_string( reference_tree.tree(),
+                                                                   reference_tree.mapper(),
+                                                                   options.precision ),
+                                       invocation,
+                                       reference_tree.mapper(),
+                                       options,
+                                       out_file,
+                                       msa_info.sequences(),
+                                       resumed );
+  LOG_INFO << "Output file: " << out_file;
+
+  // per query summary, from the same chunks
+  if (options.summary) {
+    const auto summary_file = rank_prefix + "epa_summary.tsv";
+    LOG_INFO << "Summary file: " << outdir + summary_file;
+
+    auto writers = std::make_unique<Multi_Writer>();
+    writers->add(std::move(writer));
+    writers->add(std::make_unique<Summary_Writer>( outdir,
+                                                   summary_file,
+                                                   Branch_Distances(reference_tree.tree()),
+                                                   reference_tree.mapper(),
+                                                   options.precision,
+                                                   output_threads(options),
+                                                   resumed ));
+    writer = std::move(writers);
+  }
+  auto& jplace = *writer;
 
-  Sample preplace(options.chunk_size, num_branches);
+#ifdef __MPI
+  if (options.pipeline) {
+    LOG_WARN << "Pipelined placement is not supported under MPI, placing chunk by chunk instead.";
+  }
+  if (options.overlap_chunks) {
+    LOG_WARN << "Overlapped placement is not supported under MPI, placing chunk by chunk instead.";
+  }
+#else
+  if (options.pipeline) {
+    pipelined_placement(*reader, replicas, jplace, sites, options);
+    jplace.wait();
+    return;
+  }
+  if (options.overlap_chunks) {
+  #ifdef __OMP
+    overlapped_placement(*reader, replicas, jplace, sites, options);
+    jplace.wait();
+    return;
+  #else
+    LOG_WARN << "Overlapped placement requires OpenMP support, placing chunk by chunk instead.";
+  #endif
+  }
+#endif
 
-  while ( (num_sequences = reader->read_next(chunk, options.chunk_size)) ) {
+  Chunk_Sizer chunk_sizer(num_branches, sites, options);
+  mytimer chunk_time;
 
-    assert(chunk.size() == num_sequences);
+  if (options.auto_chunk_size) {
+    LOG_INFO << "Adaptive chunk size: estimated " << chunk_sizer.bytes_per_query()
+             << " bytes per query, at most " << chunk_sizer.max() << " queries per chunk";
+  }
 
-    LOG_DBG << "num_sequences: " << num_sequences << std::endl;
+  size_t requested_size = chunk_sizer.next();
+  Sample preplace(requested_size, num_branches);
 
-    size_t const seq_id_offset = sequences_done + reader->local_seq_offset();
+  // identical queries are placed only once (per rank) if requested
+  std::unique_ptr<Query_Dedup> dedup;
+  if (options.dedup) {
+    dedup = std::make_unique<Query_Dedup>(options.dedup_memory * 1024ul * 1024ul,
+                                          options.tmp_dir.empty() ? outdir : options.tmp_dir);
+  }
 
-    if (num_sequences < options.chunk_size) {
-      all_work = Work(std::make_pair(0, num_branches), std::make_pair(0, num_sequences));
-      preplace = Sample(num_sequences, num_branches);
-    }
+  while ( (num_sequences = timed_read(*reader, chunk, requested_size)) ) {
 
-    if (options.prescoring) {
+    assert(chunk.size() == num_sequences);
 
-      LOG_DBG << "Preplacement." << std::endl;
-      place(chunk,
-            reference_tree,
-            branches,
-            preplace,
-            options,
-            lookups);
+    LOG_DBG << "num_sequences: " << num_sequences << std::endl;
 
-      LOG_DBG << "Selecting candidates." << std::endl;
+    chunk_time.start();
 
-      blo_work = apply_heuristic(preplace, options);
+    size_t const seq_id_offset = sequences_done + reader->local_seq_offset();
 
-    } else {
-      blo_work = all_work;
+    if (dedup) {
+      dedup->filter(chunk, seq_id_offset);
     }
 
     Sample blo_sample;
+    if (chunk.size()) {
+      if (preplace.size() != chunk.size()) {
+        preplace = Sample(chunk.size(), num_branches);
+      }
 
-    LOG_DBG << "BLO Placement." << std::endl;
-    place_thorough( blo_work,
-                    chunk,
-                    reference_tree,
-                    branches,
-                    blo_sample,
-                    options,
-                    lookups,
-                    seq_id_offset);
+      auto blo_work = select_candidates(chunk, replicas, preplace, options);
 
-    // Output
-    compute_and_set_lwr(blo_sample);
-    filter(blo_sample, options);
+      blo_sample = place_candidates(blo_work, chunk, replicas, options, seq_id_offset);
+    }
+
+    if (dedup) {
+      dedup->resolve(blo_sample, seq_id_offset);
+      // queries answered from earlier chunks were appended at the end
+      if (options.deterministic) {
+        sort_by_sequence_id(blo_sample);
+      }
+    }
 
     // pass the result chunk to the writer
-    jplace.write( blo_sample );
+    timed_write(jplace, blo_sample);
+
+    chunk_time.stop();
+    chunk_sizer.update(requested_size, num_sequences, chunk_time.last_duration());
+    requested_size = chunk_sizer.next();
 
     sequences_done += num_sequences;
+    ++chunks_done;
     LOG_INFO << sequences_done  << " Sequences done!";
+
+    if (checkpoint) {
+      // only what is on disk may be recorded as done
+      std::vector<placement_writer::File_State> files;
+      jplace.sync(files);
+      checkpoint->save(sequences_done, chunks_done, files);
+    }
   }
 
   jplace.wait();
 
+  if (dedup) {
+    LOG_INFO << "Deduplication: placed " << dedup->num_unique() << " unique sequences, "
+             << dedup->num_duplicates() << " duplicates"
+             << (dedup->num_spills() ? " (spilled to disk " + std::to_string(dedup->num_spills()) + " times)" : "");
+  }
+
+  if (checkpoint) {
+    // complete the outputs before the checkpoint goes: until then, a resume can finish them
+    writer.reset();
+    checkpoint->remove();
+  }
+
   MPI_BARRIER(MPI_COMM_WORLD);
 }
-
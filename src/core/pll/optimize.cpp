@@ -11,6 +11,7 @@
 #include "core/pll/pll_util.hpp"
 #include "util/constants.hpp"
 #include "util/logging.hpp"
+#include "util/Timer.hpp"
 
 static void traverse_update_partials( pll_unode_t * root,
                                       pll_partition_t * partition,
@@ -60,6 +61,9 @@ static void utree_derivative_func ( void * parameters,
                                     double *df,
                                     double *ddf)
 {
+  // called once per Newton-Raphson step
+  Stats::count(Stat_Counter::kNewtonIterations);
+
   auto params = static_cast<pll_newton_tree_params_t*>(parameters);
   pll_compute_likelihood_derivatives (params->partition,
                                       params->tree->scaler_index,
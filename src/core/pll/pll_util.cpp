@@ -3,6 +3,8 @@
 #include <iomanip>
 #include <stdexcept>
 #include <vector>
+#include <cstring>
+#include <unordered_map>
 
 #include "util/constants.hpp"
 
@@ -194,6 +196,68 @@ void utree_destroy(pll_utree_t * tree)
   }
 }
 
+/**
+  Deep copy of a utree: same node order in tree->nodes, same clv, scaler and pmatrix
+  indices, and therefore the same traversals. Node data is not copied.
+*/
+pll_utree_t * clone_utree(pll_utree_t const * const tree)
+{
+  const auto num_nodes = tree->tip_count + tree->inner_count;
+  std::unordered_map<pll_unode_t const *, pll_unode_t *> copy_of;
+
+  auto clone = static_cast<pll_utree_t *>(malloc(sizeof(pll_utree_t)));
+  if (not clone) {
+    throw std::runtime_error{"Could not allocate the utree clone"};
+  }
+  memcpy(clone, tree, sizeof(pll_utree_t));
+  clone->nodes = static_cast<pll_unode_t **>(calloc(num_nodes, sizeof(pll_unode_t *)));
+  if (not clone->nodes) {
+    free(clone);
+    throw std::runtime_error{"Could not allocate the utree clone"};
+  }
+
+  // first copy every node (of every inner node ring)...
+  for (size_t i = 0; i < num_nodes; ++i) {
+    auto node = tree->nodes[i];
+    do {
+      auto copy = static_cast<pll_unode_t *>(malloc(sizeof(pll_unode_t)));
+      if (not copy) {
+        // no labels are set yet, so the nodes themselves are all there is to free
+        for (auto& pair : copy_of) {
+          free(pair.second);
+        }
+        free(clone->nodes);
+        free(clone);
+        throw std::runtime_error{"Could not allocate the utree clone"};
+      }
+      memcpy(copy, node, sizeof(pll_unode_t));
+      copy->data = nullptr;
+      copy_of[node] = copy;
+      node = node->next;
+    } while (node and node != tree->nodes[i]);
+  }
+
+  // ... then link them up. Like the parser, a ring shares the label of its first node
+  for (size_t i = 0; i < num_nodes; ++i) {
+    auto const first = tree->nodes[i];
+    auto const label = first->label ? strdup(first->label) : nullptr;
+    auto node = first;
+    do {
+      auto copy = copy_of.at(node);
+      copy->next  = node->next ? copy_of.at(node->next) : nullptr;
+      copy->back  = node->back ? copy_of.at(node->back) : nullptr;
+      copy->label = (node->label == first->label) ? label
+                  : (node->label ? strdup(node->label) : nullptr);
+      node = node->next;
+    } while (node and node != first);
+    clone->nodes[i] = copy_of.at(first);
+  }
+
+  clone->vroot = copy_of.at(tree->vroot);
+
+  return clone;
+}
+
 static void utree_query_branches_recursive( pll_unode_t * const node,
                                             pll_unode_t ** node_list,
                                             unsigned int * index)
@@ -52,6 +52,7 @@ pll_unode_t * get_tip_node(pll_unode_t * node);
 pll_unode_t* get_root(pll_utree_t const * const tree);
 
 pll_utree_t* make_utree_struct(pll_unode_t * root, const unsigned int num_nodes);
+pll_utree_t* clone_utree(pll_utree_t const * const tree);
 
 // deprecated
 void shift_partition_focus(pll_partition_t * partition, const int offset, const unsigned int span);
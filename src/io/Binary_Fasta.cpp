@@ -0,0 +1,342 @@
+#include "io/Binary_Fasta.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "io/msa_reader.hpp"
+#include "util/parallel.hpp"
+
+#include "genesis/utils/core/fs.hpp"
+#include "genesis/utils/core/options.hpp"
+
+// sequences per thread encoded per chunk during conversion
+constexpr size_t BFAST_CONVERT_CHUNK = 4096;
+
+template <class T>
+static inline void append_int(std::string& buffer, const T value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * One data entry, laid out like Serializer::put_string followed by put_encoded.
+ */
+static std::string make_entry(const Sequence& s)
+{
+  ensure_dna(s.sequence());
+
+  std::string entry;
+  append_int<size_t>(entry, s.header().size());
+  entry.append(s.header());
+  append_int<uint64_t>(entry, s.sequence().size());
+  entry.append(code_().to_fourbit(s.sequence()));
+  return entry;
+}
+
+std::string Binary_Fasta::fasta_to_bfast( const std::string& fasta_file,
+                                          std::string out_dir,
+                                          const size_t num_threads)
+{
+  auto parts = split_by_delimiter(fasta_file, "/");
+
+  out_dir += parts.back() + ".bfast";
+
+  size_t threads = num_threads;
+  #ifdef __OMP
+  if (not threads) {
+    threads = omp_get_max_threads();
+  }
+  #endif
+  threads = std::max<size_t>(threads, 1u);
+
+  // first pass: only the number of sequences and the gap mask
+  auto info = make_msa_info(fasta_file);
+
+  LOG_DBG << info;
+
+  if (utils::file_exists(out_dir) and not utils::Options::get().allow_file_overwriting()) {
+    throw std::runtime_error{"Output file already exists: " + out_dir};
+  }
+  std::ofstream out(out_dir, std::ios::binary);
+  if (not out) {
+    throw std::runtime_error{"Cannot open file for writing: " + out_dir};
+  }
+
+  // write the header, with the offset table zeroed for now
+  const uint64_t num_sequences = info.sequences();
+  std::stringstream ss;
+  ss << info.gap_mask();
+  const auto mask_str = ss.str();
+
+  std::string head(MAGIC, MAGIC_SIZE);
+  append_int<uint64_t>(head, num_sequences);
+  append_int<size_t>(head, mask_str.size());
+  head.append(mask_str);
+  out.write(head.data(), head.size());
+
+  const uint64_t table_offset = head.size();
+  const std::string zeros(64u * 1024u, '\0');
+  for (uint64_t left = num_sequences * sizeof(uint64_t) * 2; left; ) {
+    const auto n = std::min<uint64_t>(left, zeros.size());
+    out.write(zeros.data(), n);
+    left -= n;
+  }
+
+  uint64_t offset = data_section_offset(num_sequences, mask_str.size());
+  assert(offset == table_offset + num_sequences * sizeof(uint64_t) * 2);
+
+  // second pass: encode the records chunk by chunk, then patch in their offsets
+  auto reader = make_msa_reader(fasta_file, info, false, false, true, threads);
+
+  MSA chunk;
+  uint64_t id = 0;
+  while (reader->read_next(chunk, BFAST_CONVERT_CHUNK * threads)) {
+    std::vector<std::string> entries(chunk.size());
+
+    parallel_for(0, chunk.size(), threads, [&](const size_t i) {
+      entries[i] = make_entry(chunk[i]);
+    });
+
+    if (id + entries.size() > num_sequences) {
+      throw std::runtime_error{"Input changed during conversion: " + fasta_file};
+    }
+
+    std::string table;
+    const uint64_t first_id = id;
+    for (const auto& entry : entries) {
+      append_int<uint64_t>(table, id++);
+      append_int<uint64_t>(table, offset);
+      offset += entry.size();
+    }
+
+    out.seekp(table_offset + first_id * sizeof(uint64_t) * 2);
+    out.write(table.data(), table.size());
+    out.seekp(0, std::ios::end);
+    for (const auto& entry : entries) {
+      out.write(entry.data(), entry.size());
+    }
+  }
+
+  if (id != num_sequences) {
+    throw std::runtime_error{"Input changed during conversion: " + fasta_file};
+  }
+  if (not out) {
+    throw std::runtime_error{"Failed to write file: " + out_dir};
+  }
+
+  return out_dir;
+}
+
+static void pread_all(const int fd, char* buffer, size_t size, off_t offset)
+{
+  while (size) {
+    const auto n = pread(fd, buffer, size, offset);
+    if (n <= 0) {
+      throw std::runtime_error{"Failed to read from bfast file"};
+    }
+    buffer += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+template <class T>
+static inline T take_int(const char*& p, const char* end)
+{
+  T value;
+  if (p + sizeof(T) > end) {
+    throw std::runtime_error{"Truncated bfast entry"};
+  }
+  std::memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return value;
+}
+
+/**
+ * Inverse of make_entry.
+ */
+static Sequence decode_entry(const char* p, const char* end, const mask_type& mask)
+{
+  const auto label_size = take_int<size_t>(p, end);
+  if (p + label_size > end) {
+    throw std::runtime_error{"Truncated bfast entry"};
+  }
+  std::string label(p, label_size);
+  p += label_size;
+
+  const auto decoded_size = take_int<uint64_t>(p, end);
+  const auto coded_size = code_().packed_size(decoded_size);
+  if (p + coded_size > end) {
+    throw std::runtime_error{"Truncated bfast entry"};
+  }
+  auto sequence = code_().from_fourbit(std::string(p, coded_size), decoded_size);
+
+  if (mask.count()) {
+    sequence = subset_sequence(sequence, mask);
+  }
+
+  return Sequence(std::move(label), std::move(sequence));
+}
+
+Binary_Fasta_Reader::Binary_Fasta_Reader( std::string const& file_name,
+                                          MSA_Info const& info,
+                                          bool const premasking,
+                                          bool const split,
+                                          bool const use_mmap,
+                                          size_t const decode_threads)
+  : mask_(info.gap_mask())
+  , decode_threads_(std::max<size_t>(decode_threads, 1u))
+{
+  {
+    utils::Deserializer des(file_name);
+    mask_type dummy_mask;
+    read_header(des, seq_offsets_, dummy_mask);
+  }
+
+  assert(seq_offsets_.size() == info.sequences());
+
+  fd_ = open(file_name.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd_ < 0 or fstat(fd_, &st) != 0) {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+  size_ = static_cast<size_t>(st.st_size);
+
+  if (use_mmap and size_) {
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) {
+      LOG_DBG << "Cannot memory map " << file_name << ", reading it instead.";
+    } else {
+      map_ = static_cast<const char*>(map);
+    }
+  }
+
+  // if we are under MPI, start at this ranks assigned part of the input file
+  #ifdef __MPI
+  if ( split ) {
+    // get info about to which sequence to skip to and how much this rank should read
+    std::tie( local_seq_offset_, max_read_ ) = local_seq_package( info.sequences() );
+  }
+  #else
+  static_cast<void>(split);
+  #endif
+
+  max_read_ = std::min( seq_offsets_.size() - std::min(seq_offsets_.size(), local_seq_offset_), max_read_);
+
+  if (not premasking) {
+    mask_ = mask_type();
+  }
+}
+
+Binary_Fasta_Reader::~Binary_Fasta_Reader()
+{
+#ifdef __PREFETCH
+  // avoid dangling threads
+  if (prefetcher_.valid()) {
+    prefetcher_.wait();
+  }
+#endif
+  if (map_) {
+    munmap(const_cast<char*>(map_), size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+/**
+ * Reads the records [first, first + count) and decodes them into result.
+ */
+void Binary_Fasta_Reader::fetch_(const size_t first, const size_t count, MSA& result) const
+{
+  result = MSA();
+  if (not count) {
+    return;
+  }
+
+  const uint64_t begin = seq_offsets_[first];
+  const uint64_t end = first + count < seq_offsets_.size() ? seq_offsets_[first + count] : size_;
+  if (begin > end or end > size_) {
+    throw std::runtime_error{"Corrupt bfast offset table"};
+  }
+
+  std::string buffer;
+  const char* data = map_ ? map_ + begin : nullptr;
+  if (not data) {
+    buffer.resize(end - begin);
+    pread_all(fd_, &buffer[0], buffer.size(), begin);
+    data = buffer.data();
+  }
+
+  std::vector<Sequence> records(count);
+
+  parallel_for(0, count, decode_threads_, [&](const size_t i) {
+    const auto entry_end = i + 1 < count ? seq_offsets_[first + i + 1] : end;
+    records[i] = decode_entry(data + (seq_offsets_[first + i] - begin), data + (entry_end - begin), mask_);
+  });
+
+  result.move_sequences(records.begin(), records.end());
+}
+
+void Binary_Fasta_Reader::skip(const size_t n)
+{
+  if (num_read_) {
+    throw std::runtime_error{"Skipping currently not allowed after first read!"};
+  }
+  if (n > max_read_) {
+    throw std::runtime_error{"Trying to skip out of bounds!"};
+  }
+  // reads start from the offset table entry of the next sequence anyway
+  num_read_ = n;
+}
+
+size_t Binary_Fasta_Reader::read_next(MSA& result, const size_t number)
+{
+  const auto to_read = std::min( number, max_read_ - num_read_ );
+  const auto first = local_seq_offset_ + num_read_;
+
+#ifdef __PREFETCH
+  if (prefetcher_.valid()) {
+    // rethrows errors of the prefetch
+    prefetcher_.get();
+  }
+  // the prefetched chunk is only of use if the chunk size did not change
+  if (prefetch_first_ == first and prefetch_chunk_.size() == to_read and to_read) {
+    std::swap(result, prefetch_chunk_);
+  } else {
+    fetch_(first, to_read, result);
+  }
+#else
+  fetch_(first, to_read, result);
+#endif
+
+  num_read_ += result.size();
+
+#ifdef __PREFETCH
+  // fetch the next chunk in the background, assuming the same chunk size
+  const auto next_count = std::min( number, max_read_ - num_read_ );
+  if (next_count) {
+    prefetch_first_ = local_seq_offset_ + num_read_;
+    prefetcher_ = std::async( std::launch::async,
+                              [this, next_count](){
+                                fetch_(prefetch_first_, next_count, prefetch_chunk_);
+                              });
+  }
+#endif
+
+  return result.size();
+}
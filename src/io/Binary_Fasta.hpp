@@ -240,105 +240,51 @@ public:
     return read_sequences( des, mask, offset.size() );
   }
 
+  /**
+   * Converts a fasta file in two passes: the first only determines the number of
+   * sequences and the gap mask, the second writes the records chunk by chunk, filling
+   * in their part of the offset table as it goes. Memory use is bounded by the chunk
+   * size, and chunks are encoded on num_threads threads (0: as many as OpenMP would use).
+   */
   static std::string fasta_to_bfast( const std::string& fasta_file,
-                              std::string out_dir)
-  {
-    auto parts = split_by_delimiter(fasta_file, "/");
-
-    out_dir += parts.back() + ".bfast";
-
-    // specific, per sequence sizes
-    std::vector<size_t> entry_sizes;
-    // and a function to get it during msa info fetch
-    auto get_sizes = [&](const genesis::sequence::Sequence& s)
-    {
-      entry_sizes.push_back(
-        s.label().size() +
-        code_().packed_size(s.sites().size())
-      );
-    };
-
-    MSA_Info info(fasta_file, get_sizes);
-
-    LOG_DBG << info;
-
-    // write the header
-    utils::Serializer ser(out_dir);
-    write_header(ser, entry_sizes, info.gap_mask());
-
-    // write the data
-    auto it = sequence::FastaInputIterator( utils::from_file(fasta_file) );
-
-    // probe first seq to see if this might be AA data
-    ensure_dna( it->sites() );
-
-    while ( it ) {
-      ser.put_string(it->label());
-      put_encoded(ser, it->sites());
-      ++it;
-    }
-    return out_dir;
-  }
+                                     std::string out_dir,
+                                     const size_t num_threads = 0);
 
 };
 
 #include "io/msa_reader_interface.hpp"
 #include "net/epa_mpi_util.hpp"
 
+#ifdef __PREFETCH
+#include <future>
+#endif
+
+/**
+ * Reader for bfast files.
+ *
+ * Chunks are fetched with positional reads (pread) of the byte range given by the
+ * offset table, or straight from a memory mapping of the file, which lets ranks on the
+ * same node share the page cache. The records of a chunk are then decoded on
+ * decode_threads threads. With __PREFETCH, the next chunk is fetched and decoded in the
+ * background while the current one is being placed.
+ */
 class Binary_Fasta_Reader : public msa_reader
 {
 public:
   Binary_Fasta_Reader(std::string const& file_name,
                       MSA_Info const& info,
                       bool const premasking = false,
-                      bool const split = false)
-    : istream_(file_name)
-    , des_(istream_)
-    , mask_(info.gap_mask())
-  {
-    mask_type dummy_mask;
-    read_header(des_, seq_offsets_, dummy_mask);
+                      bool const split = false,
+                      bool const use_mmap = false,
+                      size_t const decode_threads = 1);
 
-    assert(seq_offsets_.size() == info.sequences());
+  ~Binary_Fasta_Reader();
 
+  Binary_Fasta_Reader(Binary_Fasta_Reader const& other) = delete;
+  Binary_Fasta_Reader& operator= (Binary_Fasta_Reader const& other) = delete;
 
-    // if we are under MPI, skip to this ranks assigned part of the input file
-    #ifdef __MPI
-    if ( split ) {
-      // get info about to which sequence to skip to and how much this rank should read
-      std::tie( local_seq_offset_, max_read_ ) = local_seq_package( info.sequences() );
-
-      // skip to that offset in the underlying istream
-      istream_ = std::ifstream( file_name );
-      istream_.seekg( seq_offsets_[ local_seq_offset_ ], istream_.beg );
-
-      // rebuild the deserializer, starting from the desired sequence
-      des_ = utils::Deserializer( istream_ );
-    }
-    #else
-    static_cast<void>(split);
-    #endif
-
-    max_read_ = std::min( seq_offsets_.size(), max_read_);
-
-    if (not premasking) {
-      mask_ = mask_type();
-    }
-  }
-
-  ~Binary_Fasta_Reader() = default;
-
-  virtual size_t read_next(MSA& result, const size_t number) override
-  {
-    const auto to_read =
-      std::min( number, max_read_ - num_read_ );
-
-    result = read_sequences( des_, mask_, to_read );
-
-    num_read_ += result.size();
-
-    return result.size();
-  }
+  virtual size_t read_next(MSA& result, const size_t number) override;
+  virtual void skip(const size_t n) override;
 
   virtual size_t num_sequences() const override
   {
@@ -350,13 +296,21 @@ public:
     return local_seq_offset_;
   }
 
-
 private:
-  std::ifstream istream_;
-  utils::Deserializer des_;
+  void fetch_(const size_t first, const size_t count, MSA& result) const;
+
+  int fd_ = -1;
+  const char* map_ = nullptr;
+  size_t size_ = 0;
   mask_type mask_;
   std::vector<uint64_t> seq_offsets_;
   size_t num_read_  = 0;
   size_t max_read_  = std::numeric_limits<size_t>::max();
   size_t local_seq_offset_ = 0;
+  size_t decode_threads_ = 1;
+#ifdef __PREFETCH
+  std::future<void> prefetcher_;
+  MSA prefetch_chunk_;
+  size_t prefetch_first_ = 0;
+#endif
 };
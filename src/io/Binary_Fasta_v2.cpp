@@ -0,0 +1,566 @@
+#include "io/Binary_Fasta_v2.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <tuple>
+#include <iterator>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#ifdef __ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef __ZSTD
+#include <zstd.h>
+#endif
+
+#include "io/encoding.hpp"
+#include "io/msa_reader.hpp"
+#include "net/epa_mpi_util.hpp"
+#include "util/stringify.hpp"
+#include "util/logging.hpp"
+#include "util/parallel.hpp"
+
+constexpr char BFAST_V2_MAGIC[] = "BFAST2\0";
+constexpr size_t BFAST_V2_MAGIC_SIZE = sizeof(BFAST_V2_MAGIC);
+constexpr uint64_t BFAST_V2_VERSION = 2;
+// <magic><version><sequences per block>
+constexpr size_t BFAST_V2_HEAD_SIZE = BFAST_V2_MAGIC_SIZE + 2 * sizeof(uint64_t);
+// <index offset><magic>
+constexpr size_t BFAST_V2_TAIL_SIZE = sizeof(uint64_t) + BFAST_V2_MAGIC_SIZE;
+
+using mask_type = MSA_Info::mask_type;
+
+static FourBit& fourbit()
+{
+  static FourBit obj;
+  return obj;
+}
+
+static inline void put_u64(std::string& buffer, const uint64_t value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static inline uint64_t get_u64(const std::string& buffer, size_t& pos)
+{
+  if (pos + sizeof(uint64_t) > buffer.size()) {
+    throw std::runtime_error{"Truncated bfast v2 data"};
+  }
+  uint64_t value;
+  std::memcpy(&value, buffer.data() + pos, sizeof(value));
+  pos += sizeof(value);
+  return value;
+}
+
+static inline std::string get_bytes(const std::string& buffer, size_t& pos, const size_t n)
+{
+  if (pos + n > buffer.size()) {
+    throw std::runtime_error{"Truncated bfast v2 data"};
+  }
+  auto result = buffer.substr(pos, n);
+  pos += n;
+  return result;
+}
+
+static uint64_t fnv1a(const std::string& data)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (const auto c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static void pread_all(const int fd, char* buffer, size_t size, off_t offset)
+{
+  while (size) {
+    const auto n = pread(fd, buffer, size, offset);
+    if (n <= 0) {
+      throw std::runtime_error{"Failed to read from bfast v2 file"};
+    }
+    buffer += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+/**
+ * Whether the sequence can be 4-bit packed.
+ */
+static bool is_fourbit(const std::string& sequence)
+{
+  static const auto table = [](){
+    std::array<bool, 256> t;
+    t.fill(false);
+    for (size_t i = 0; i < NT_MAP_SIZE; ++i) {
+      t[NT_MAP[i]] = true;
+      t[std::tolower(NT_MAP[i])] = true;
+    }
+    return t;
+  }();
+
+  for (const auto c : sequence) {
+    if (not table[static_cast<unsigned char>(c)]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void compress_block(const std::string& raw,
+                           std::string& stored,
+                           Binary_Fasta_v2::Compression& compression)
+{
+  using Compression = Binary_Fasta_v2::Compression;
+
+  #if defined(__ZSTD)
+  stored.resize(ZSTD_compressBound(raw.size()));
+  const size_t size = ZSTD_compress(&stored[0], stored.size(), raw.data(), raw.size(), 3);
+  if (ZSTD_isError(size)) {
+    throw std::runtime_error{std::string("zstd: ") + ZSTD_getErrorName(size)};
+  }
+  stored.resize(size);
+  compression = Compression::kZstd;
+  #elif defined(__ZLIB)
+  uLongf size = compressBound(raw.size());
+  stored.resize(size);
+  if (compress2(reinterpret_cast<Bytef*>(&stored[0]), &size,
+                reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+                Z_DEFAULT_COMPRESSION) != Z_OK) {
+    throw std::runtime_error{"Failed to compress bfast v2 block"};
+  }
+  stored.resize(size);
+  compression = Compression::kZlib;
+  #else
+  stored.clear();
+  compression = Compression::kNone;
+  #endif
+
+  // incompressible (or no compression available): store as is
+  if (compression == Compression::kNone or stored.size() >= raw.size()) {
+    stored = raw;
+    compression = Compression::kNone;
+  }
+}
+
+static std::string decompress_block(const Binary_Fasta_v2::Block& block, std::string stored)
+{
+  using Compression = Binary_Fasta_v2::Compression;
+
+  switch (block.compression) {
+    case Compression::kNone:
+      return stored;
+    case Compression::kZlib: {
+      #ifdef __ZLIB
+      std::string raw(block.raw_size, '\0');
+      uLongf size = raw.size();
+      if (uncompress(reinterpret_cast<Bytef*>(&raw[0]), &size,
+                     reinterpret_cast<const Bytef*>(stored.data()), stored.size()) != Z_OK
+          or size != raw.size()) {
+        throw std::runtime_error{"Corrupt zlib block in bfast v2 file"};
+      }
+      return raw;
+      #else
+      throw std::runtime_error{"Built without zlib, cannot decompress bfast v2 block"};
+      #endif
+    }
+    case Compression::kZstd: {
+      #ifdef __ZSTD
+      std::string raw(block.raw_size, '\0');
+      const size_t size = ZSTD_decompress(&raw[0], raw.size(), stored.data(), stored.size());
+      if (ZSTD_isError(size) or size != raw.size()) {
+        throw std::runtime_error{"Corrupt zstd block in bfast v2 file"};
+      }
+      return raw;
+      #else
+      throw std::runtime_error{"Built without zstd support (see EPA_ZSTD), cannot decompress bfast v2 block"};
+      #endif
+    }
+  }
+  throw std::runtime_error{"Unknown compression in bfast v2 file"};
+}
+
+/**
+ * Builds the raw block from a chunk of sequences, then compresses it. Also narrows
+ * the gap mask to the all-gap sites of this block.
+ */
+static void encode_block(const MSA& chunk,
+                         Binary_Fasta_v2::Block& block,
+                         std::string& stored,
+                         mask_type& mask)
+{
+  using Encoding = Binary_Fasta_v2::Encoding;
+
+  bool dna = true;
+  for (const auto& s : chunk) {
+    dna = dna and is_fourbit(s.sequence());
+    mask &= genesis::sequence::gap_sites(genesis::sequence::Sequence("", s.sequence()));
+  }
+
+  std::string raw;
+  for (const auto& s : chunk) {
+    put_u64(raw, s.header().size());
+    raw.append(s.header());
+    put_u64(raw, s.sequence().size());
+    if (dna) {
+      raw.append(fourbit().to_fourbit(s.sequence()));
+    } else {
+      for (const auto c : s.sequence()) {
+        raw.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+      }
+    }
+  }
+
+  block.raw_size      = raw.size();
+  block.num_sequences = chunk.size();
+  block.encoding      = dna ? Encoding::kFourBit : Encoding::kByte;
+  block.checksum      = fnv1a(raw);
+  compress_block(raw, stored, block.compression);
+  block.stored_size   = stored.size();
+}
+
+Binary_Fasta_v2::Binary_Fasta_v2(const std::string& file_name)
+  : file_name_(file_name)
+{
+  fd_ = open(file_name.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+
+  try {
+    struct stat st;
+    if (fstat(fd_, &st) != 0
+        or static_cast<size_t>(st.st_size) < BFAST_V2_HEAD_SIZE + BFAST_V2_TAIL_SIZE) {
+      throw std::runtime_error{"File is not a bfast v2 file: " + file_name};
+    }
+    const size_t size = st.st_size;
+
+    std::string head(BFAST_V2_HEAD_SIZE, '\0');
+    pread_all(fd_, &head[0], head.size(), 0);
+    std::string tail(BFAST_V2_TAIL_SIZE, '\0');
+    pread_all(fd_, &tail[0], tail.size(), size - tail.size());
+
+    if (std::memcmp(head.data(), BFAST_V2_MAGIC, BFAST_V2_MAGIC_SIZE)
+        or std::memcmp(tail.data() + sizeof(uint64_t), BFAST_V2_MAGIC, BFAST_V2_MAGIC_SIZE)) {
+      throw std::runtime_error{"File is not a bfast v2 file: " + file_name};
+    }
+
+    size_t pos = BFAST_V2_MAGIC_SIZE;
+    const auto version = get_u64(head, pos);
+    if (version != BFAST_V2_VERSION) {
+      throw std::runtime_error{"Unsupported bfast version " + std::to_string(version) + ": " + file_name};
+    }
+
+    pos = 0;
+    const auto index_offset = get_u64(tail, pos);
+    if (index_offset < BFAST_V2_HEAD_SIZE or index_offset > size - tail.size()) {
+      throw std::runtime_error{"Corrupt bfast v2 index: " + file_name};
+    }
+
+    std::string index(size - tail.size() - index_offset, '\0');
+    pread_all(fd_, &index[0], index.size(), index_offset);
+
+    pos = 0;
+    const auto sequences = get_u64(index, pos);
+    const auto sites = get_u64(index, pos);
+    std::stringstream mask_str( get_bytes(index, pos, get_u64(index, pos)) );
+    mask_type mask;
+    mask_str >> mask;
+    info_ = MSA_Info(file_name, sequences, mask, sites);
+
+    blocks_.resize(get_u64(index, pos));
+    for (auto& b : blocks_) {
+      b.offset          = get_u64(index, pos);
+      b.stored_size     = get_u64(index, pos);
+      b.raw_size        = get_u64(index, pos);
+      b.first_sequence  = get_u64(index, pos);
+      b.num_sequences   = get_u64(index, pos);
+      b.compression     = static_cast<Compression>(get_u64(index, pos));
+      b.encoding        = static_cast<Encoding>(get_u64(index, pos));
+      b.checksum        = get_u64(index, pos);
+    }
+  } catch (...) {
+    close(fd_);
+    throw;
+  }
+}
+
+Binary_Fasta_v2::~Binary_Fasta_v2()
+{
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+size_t Binary_Fasta_v2::block_of(const size_t sequence) const
+{
+  const auto it = std::upper_bound(blocks_.begin(), blocks_.end(), sequence,
+    [](const size_t s, const Block& b){ return s < b.first_sequence; });
+  if (it == blocks_.begin() or sequence >= info_.sequences()) {
+    throw std::runtime_error{"Trying to skip out of bounds!"};
+  }
+  return std::distance(blocks_.begin(), it) - 1;
+}
+
+std::vector<Sequence> Binary_Fasta_v2::decode_block(const size_t i, const mask_type& mask) const
+{
+  const auto& block = blocks_.at(i);
+
+  std::string stored(block.stored_size, '\0');
+  pread_all(fd_, &stored[0], stored.size(), block.offset);
+
+  const auto raw = decompress_block(block, std::move(stored));
+  if (fnv1a(raw) != block.checksum) {
+    throw std::runtime_error{"Checksum mismatch in block " + std::to_string(i)
+      + " of bfast v2 file: " + file_name_};
+  }
+
+  const bool premask = mask.count();
+
+  std::vector<Sequence> result;
+  result.reserve(block.num_sequences);
+  size_t pos = 0;
+  for (size_t k = 0; k < block.num_sequences; ++k) {
+    auto label = get_bytes(raw, pos, get_u64(raw, pos));
+    const auto length = get_u64(raw, pos);
+
+    std::string sequence;
+    if (block.encoding == Encoding::kFourBit) {
+      sequence = fourbit().from_fourbit(get_bytes(raw, pos, fourbit().packed_size(length)), length);
+    } else {
+      sequence = get_bytes(raw, pos, length);
+    }
+
+    if (premask) {
+      sequence = subset_sequence(sequence, mask);
+    }
+    result.emplace_back(std::move(label), std::move(sequence));
+  }
+
+  return result;
+}
+
+bool Binary_Fasta_v2::is_bfast_v2(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  char magic[BFAST_V2_MAGIC_SIZE] = {0};
+  in.read(magic, BFAST_V2_MAGIC_SIZE);
+  return in.gcount() == BFAST_V2_MAGIC_SIZE
+     and not std::memcmp(magic, BFAST_V2_MAGIC, BFAST_V2_MAGIC_SIZE);
+}
+
+MSA_Info Binary_Fasta_v2::get_info(const std::string& file_name)
+{
+  return Binary_Fasta_v2(file_name).info();
+}
+
+void Binary_Fasta_v2::write(msa_reader& reader,
+                            const size_t sites,
+                            const std::string& file_name,
+                            const size_t block_size,
+                            const size_t num_threads)
+{
+  size_t threads = num_threads;
+  #ifdef __OMP
+  if (not threads) {
+    threads = omp_get_max_threads();
+  }
+  #endif
+  threads = std::max<size_t>(threads, 1u);
+
+  std::ofstream out(file_name, std::ios::binary);
+  if (not out) {
+    throw std::runtime_error{std::string("Cannot open file for writing: ") + file_name};
+  }
+
+  std::string head(BFAST_V2_MAGIC, BFAST_V2_MAGIC_SIZE);
+  put_u64(head, BFAST_V2_VERSION);
+  put_u64(head, block_size);
+  out.write(head.data(), head.size());
+
+  uint64_t offset = head.size();
+  uint64_t sequences = 0;
+  std::vector<Block> index;
+  mask_type mask(sites, true);
+
+  // one block per thread in flight, so memory stays bounded by the block size
+  bool more = true;
+  while (more) {
+    std::vector<MSA> batch;
+    while (batch.size() < threads) {
+      MSA chunk;
+      if (not reader.read_next(chunk, block_size)) {
+        more = false;
+        break;
+      }
+      batch.push_back(std::move(chunk));
+    }
+
+    std::vector<Block> blocks(batch.size());
+    std::vector<std::string> stored(batch.size());
+    std::vector<mask_type> masks(batch.size(), mask_type(sites, true));
+
+    parallel_for(0, batch.size(), threads, [&](const size_t i) {
+      encode_block(batch[i], blocks[i], stored[i], masks[i]);
+    }, Schedule::kDynamic);
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      blocks[i].offset = offset;
+      blocks[i].first_sequence = sequences;
+      out.write(stored[i].data(), stored[i].size());
+      offset += stored[i].size();
+      sequences += blocks[i].num_sequences;
+      mask &= masks[i];
+      index.push_back(blocks[i]);
+    }
+  }
+
+  if (not sequences) {
+    mask = mask_type();
+  }
+
+  std::string trailer;
+  put_u64(trailer, sequences);
+  put_u64(trailer, sites);
+  std::stringstream ss;
+  ss << mask;
+  put_u64(trailer, ss.str().size());
+  trailer.append(ss.str());
+  put_u64(trailer, index.size());
+  for (const auto& b : index) {
+    put_u64(trailer, b.offset);
+    put_u64(trailer, b.stored_size);
+    put_u64(trailer, b.raw_size);
+    put_u64(trailer, b.first_sequence);
+    put_u64(trailer, b.num_sequences);
+    put_u64(trailer, static_cast<uint64_t>(b.compression));
+    put_u64(trailer, static_cast<uint64_t>(b.encoding));
+    put_u64(trailer, b.checksum);
+  }
+  put_u64(trailer, offset);
+  trailer.append(BFAST_V2_MAGIC, BFAST_V2_MAGIC_SIZE);
+  out.write(trailer.data(), trailer.size());
+
+  if (not out) {
+    throw std::runtime_error{std::string("Failed to write file: ") + file_name};
+  }
+}
+
+std::string Binary_Fasta_v2::fasta_to_bfast(const std::string& fasta_file,
+                                            const std::string& out_dir,
+                                            const size_t block_size,
+                                            const size_t num_threads)
+{
+  auto parts = split_by_delimiter(fasta_file, "/");
+  const auto out_file = out_dir + parts.back() + ".bfast";
+
+  // only the width is needed up front, the mask is computed while writing
+  auto info = make_streaming_msa_info(fasta_file);
+  LOG_DBG << info;
+
+  auto reader = make_msa_reader(fasta_file, info, false, false, true);
+  write(*reader, info.sites(), out_file, block_size, num_threads);
+
+  return out_file;
+}
+
+Binary_Fasta_v2_Reader::Binary_Fasta_v2_Reader( const std::string& file_name,
+                                                const MSA_Info& info,
+                                                const bool premasking,
+                                                const bool split,
+                                                const size_t num_threads)
+  : file_(file_name)
+  , mask_(premasking ? info.gap_mask() : mask_type())
+  , num_threads_(std::max<size_t>(num_threads, 1u))
+{
+  // if we are under MPI, jump to the block holding this ranks first sequence
+  #ifdef __MPI
+  if ( split ) {
+    std::tie(local_seq_offset_, max_read_) = local_seq_package( num_sequences() );
+    seek_(local_seq_offset_);
+  }
+  #else
+  static_cast<void>(split);
+  #endif
+
+  max_read_ = std::min(num_sequences(), max_read_);
+}
+
+void Binary_Fasta_v2_Reader::seek_(const size_t sequence)
+{
+  pending_.clear();
+  if (sequence >= num_sequences()) {
+    next_block_ = file_.blocks().size();
+    return;
+  }
+  next_block_ = file_.block_of(sequence);
+  auto seqs = file_.decode_block(next_block_, mask_);
+  const auto skip = sequence - file_.blocks()[next_block_].first_sequence;
+  std::move(seqs.begin() + skip, seqs.end(), std::back_inserter(pending_));
+  ++next_block_;
+}
+
+void Binary_Fasta_v2_Reader::skip(const size_t n)
+{
+  if (num_read_) {
+    throw std::runtime_error{"Skipping currently not allowed after first read!"};
+  }
+  if (n > max_read_) {
+    throw std::runtime_error{"Trying to skip out of bounds!"};
+  }
+  if (n) {
+    seek_(local_seq_offset_ + n);
+    num_read_ = n;
+  }
+}
+
+size_t Binary_Fasta_v2_Reader::read_next(MSA& result, const size_t number)
+{
+  const size_t sites = file_.info().sites();
+  result = MSA(mask_.count() ? sites - mask_.count() : sites);
+
+  const size_t to_read = std::min(number, max_read_ - num_read_);
+
+  // the blocks needed to fill this chunk
+  const auto& blocks = file_.blocks();
+  size_t available = pending_.size();
+  size_t end_block = next_block_;
+  while (available < to_read and end_block < blocks.size()) {
+    available += blocks[end_block++].num_sequences;
+  }
+
+  std::vector<std::vector<Sequence>> decoded(end_block - next_block_);
+
+  parallel_for(0, decoded.size(), num_threads_, [&](const size_t i) {
+    decoded[i] = file_.decode_block(next_block_ + i, mask_);
+  }, Schedule::kDynamic);
+
+  next_block_ = end_block;
+  for (auto& seqs : decoded) {
+    std::move(seqs.begin(), seqs.end(), std::back_inserter(pending_));
+  }
+
+  const size_t n = std::min(to_read, pending_.size());
+  std::vector<Sequence> chunk(std::make_move_iterator(pending_.begin()),
+                              std::make_move_iterator(pending_.begin() + n));
+  result.move_sequences(chunk.begin(), chunk.end());
+  pending_.erase(pending_.begin(), pending_.begin() + n);
+
+  num_read_ += result.size();
+
+  return result.size();
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <limits>
+#include <cstdint>
+
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+#include "io/msa_reader_interface.hpp"
+
+/**
+ * Version 2 of the binary fasta (bfast) container.
+ *
+ * Unlike the original format (Binary_Fasta.hpp), sequences are stored in blocks of a
+ * fixed number of sequences that are compressed independently, and the index needed
+ * for random access is written after the data. Conversion therefore needs no prior
+ * pass over the input and only keeps a bounded number of blocks in memory.
+ *
+ * Layout:
+ * <magic><version><sequences per block>
+ * <block>...
+ * <number of sequences><sites><mask string><number of blocks>
+ *   <<offset><stored size><raw size><first sequence><number of sequences>
+ *    <compression><encoding><checksum>>...
+ * <index offset><magic>
+ *
+ * A (raw) block is a series of <label length><label><sequence length><sequence>.
+ * Sequences are 4-bit packed if the whole block is nucleotide data, and stored as
+ * (uppercased) bytes otherwise, which covers amino acid data. The checksum is FNV-1a
+ * over the raw block. Blocks are compressed with zstd or zlib, depending on what the
+ * writing binary was built with, or stored as they are.
+ */
+class Binary_Fasta_v2
+{
+public:
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 4096;
+
+  enum class Compression : uint64_t { kNone = 0, kZlib = 1, kZstd = 2 };
+  enum class Encoding : uint64_t { kFourBit = 0, kByte = 1 };
+
+  struct Block
+  {
+    uint64_t offset;
+    uint64_t stored_size;
+    uint64_t raw_size;
+    uint64_t first_sequence;
+    uint64_t num_sequences;
+    Compression compression;
+    Encoding encoding;
+    uint64_t checksum;
+  };
+
+  /**
+   * Opens the file and reads its index. Throws if it is not a bfast v2 file.
+   */
+  explicit Binary_Fasta_v2(const std::string& file_name);
+  ~Binary_Fasta_v2();
+
+  Binary_Fasta_v2(Binary_Fasta_v2 const& other) = delete;
+  Binary_Fasta_v2& operator= (Binary_Fasta_v2 const& other) = delete;
+
+  const MSA_Info& info() const { return info_; }
+  const std::vector<Block>& blocks() const { return blocks_; }
+
+  /**
+   * Index of the block holding the given sequence.
+   */
+  size_t block_of(const size_t sequence) const;
+
+  /**
+   * Reads, verifies and decodes a block, applying the mask if it is not empty.
+   * Thread safe.
+   */
+  std::vector<Sequence> decode_block(const size_t i, const MSA_Info::mask_type& mask) const;
+
+  static bool is_bfast_v2(const std::string& file_name);
+  static MSA_Info get_info(const std::string& file_name);
+
+  /**
+   * Writes all sequences handed out by the reader to file_name, num_threads blocks at
+   * a time encoded and compressed in parallel (0: as many as OpenMP would use).
+   */
+  static void write(msa_reader& reader,
+                    const size_t sites,
+                    const std::string& file_name,
+                    const size_t block_size = DEFAULT_BLOCK_SIZE,
+                    const size_t num_threads = 0);
+
+  /**
+   * Converts a fasta (or compressed fasta) file, returning the name of the output.
+   */
+  static std::string fasta_to_bfast(const std::string& fasta_file,
+                                    const std::string& out_dir,
+                                    const size_t block_size = DEFAULT_BLOCK_SIZE,
+                                    const size_t num_threads = 0);
+
+private:
+  std::string file_name_;
+  int fd_ = -1;
+  MSA_Info info_;
+  std::vector<Block> blocks_;
+};
+
+/**
+ * msa_reader over a bfast v2 file. The blocks needed for a chunk are decoded in
+ * parallel; under MPI, each rank starts at the block holding its first sequence.
+ */
+class Binary_Fasta_v2_Reader : public msa_reader
+{
+public:
+  Binary_Fasta_v2_Reader(const std::string& file_name,
+                         const MSA_Info& info,
+                         const bool premasking = false,
+                         const bool split = false,
+                         const size_t num_threads = 1);
+  ~Binary_Fasta_v2_Reader() = default;
+
+  size_t read_next(MSA& result, const size_t number) override;
+  void skip(const size_t n) override;
+  size_t num_sequences() const override { return file_.info().sequences(); }
+  size_t local_seq_offset() const override { return local_seq_offset_; }
+
+private:
+  // makes the given sequence of the file the next one to be read
+  void seek_(const size_t sequence);
+
+  Binary_Fasta_v2 file_;
+  MSA_Info::mask_type mask_;
+
+  // decoded, not yet handed out sequences
+  std::deque<Sequence> pending_;
+  size_t next_block_ = 0;
+
+  size_t num_read_ = 0;
+  size_t max_read_ = std::numeric_limits<size_t>::max();
+  size_t local_seq_offset_ = 0;
+  size_t num_threads_ = 1;
+};
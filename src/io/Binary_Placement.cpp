@@ -0,0 +1,452 @@
+#include "io/Binary_Placement.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <tuple>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "io/jplace_util.hpp"
+#include "util/logging.hpp"
+
+#include "genesis/utils/core/fs.hpp"
+#include "genesis/utils/core/options.hpp"
+
+static const char BPLACE_MAGIC[] = "EPABPLC";
+constexpr size_t BPLACE_MAGIC_SIZE = sizeof(BPLACE_MAGIC);
+constexpr uint64_t BPLACE_VERSION = 1;
+
+using namespace genesis;
+
+template <class T>
+static inline void put(std::string& buffer, const T value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static inline void put_string(std::string& buffer, const std::string& s)
+{
+  put<uint64_t>(buffer, s.size());
+  buffer.append(s);
+}
+
+template <class T>
+static inline void put_column(std::string& buffer, const std::vector<T>& column)
+{
+  buffer.append(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+}
+
+/**
+ * Bounds checked reading from a buffer.
+ */
+class Cursor
+{
+public:
+  Cursor(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  template <class T>
+  T get()
+  {
+    T value;
+    std::memcpy(&value, take_(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  template <class T>
+  std::vector<T> get_column(const size_t n)
+  {
+    std::vector<T> column(n);
+    if (n) {
+      std::memcpy(column.data(), take_(n * sizeof(T)), n * sizeof(T));
+    }
+    return column;
+  }
+
+  const char* take_(const size_t n)
+  {
+    if (static_cast<size_t>(end_ - p_) < n) {
+      throw std::runtime_error{"Truncated bplace file"};
+    }
+    const auto result = p_;
+    p_ += n;
+    return result;
+  }
+
+private:
+  const char* p_;
+  const char* end_;
+};
+
+static void pread_all(const int fd, char* buffer, size_t size, off_t offset)
+{
+  while (size) {
+    const auto n = pread(fd, buffer, size, offset);
+    if (n <= 0) {
+      throw std::runtime_error{"Failed to read from bplace file"};
+    }
+    buffer += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+static void encode_block(Sample<> const& chunk,
+                         rtree_mapper const& mapper,
+                         std::string& buffer,
+                         uint64_t& num_placements)
+{
+  const size_t n = chunk.size();
+  std::vector<uint64_t> seq_ids(n);
+  std::vector<uint32_t> placement_counts(n);
+  std::vector<uint32_t> name_counts(n);
+  std::vector<uint32_t> name_lengths;
+  std::string names;
+
+  num_placements = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const auto& pq = chunk.at(i);
+    seq_ids[i] = pq.sequence_id();
+    placement_counts[i] = pq.size();
+    name_counts[i] = 1 + pq.duplicates().size();
+    name_lengths.push_back(pq.header().size());
+    names.append(pq.header());
+    for (const auto& name : pq.duplicates()) {
+      name_lengths.push_back(name.size());
+      names.append(name);
+    }
+    num_placements += pq.size();
+  }
+
+  std::vector<uint32_t> edges;
+  std::vector<double> likelihoods, lwrs, distals, pendants;
+  edges.reserve(num_placements);
+  likelihoods.reserve(num_placements);
+  lwrs.reserve(num_placements);
+  distals.reserve(num_placements);
+  pendants.reserve(num_placements);
+
+  for (const auto& pq : chunk) {
+    for (const auto& p : pq) {
+      auto branch_id = p.branch_id();
+      auto distal_length = p.distal_length();
+      if ( mapper ) {
+        std::tie(branch_id, distal_length) = mapper.in_rtree(branch_id, distal_length);
+      }
+      edges.push_back(branch_id);
+      likelihoods.push_back(p.likelihood());
+      lwrs.push_back(p.lwr());
+      distals.push_back(distal_length);
+      pendants.push_back(p.pendant_length());
+    }
+  }
+
+  buffer.clear();
+  put<uint64_t>(buffer, n);
+  put<uint64_t>(buffer, num_placements);
+  put_column(buffer, seq_ids);
+  put_column(buffer, placement_counts);
+  put_column(buffer, name_counts);
+  put_column(buffer, name_lengths);
+  buffer.append(names);
+  put_column(buffer, edges);
+  put_column(buffer, likelihoods);
+  put_column(buffer, lwrs);
+  put_column(buffer, distals);
+  put_column(buffer, pendants);
+}
+
+Binary_Placement_Writer::Binary_Placement_Writer( const std::string& out_dir,
+                                                  const std::string& file_name,
+                                                  const std::string& tree_string,
+                                                  const std::string& invocation_string,
+                                                  rtree_mapper const& mapper,
+                                                  unsigned int const precision)
+  : file_path_(out_dir + file_name)
+  , mapper_(mapper)
+{
+  file_.open(file_path_, std::ios::binary | std::ios::trunc);
+  if (not file_.is_open()) {
+    throw std::runtime_error{file_path_ + ": could not open!"};
+  }
+
+  std::string head(BPLACE_MAGIC, BPLACE_MAGIC_SIZE);
+  put<uint64_t>(head, BPLACE_VERSION);
+  put<uint64_t>(head, precision);
+  put_string(head, tree_string);
+  put_string(head, invocation_string);
+  file_.write(head.data(), head.size());
+  offset_ = head.size();
+}
+
+Binary_Placement_Writer::~Binary_Placement_Writer()
+{
+  // ensure the last write was completed
+  try {
+    wait();
+  } catch (const std::exception& e) {
+    LOG_ERR << "Failed to write " << file_path_ << ": " << e.what();
+  }
+
+  std::string trailer;
+  put<uint64_t>(trailer, blocks_.size());
+  for (const auto& b : blocks_) {
+    put<uint64_t>(trailer, b.offset);
+    put<uint64_t>(trailer, b.size);
+    put<uint64_t>(trailer, b.first_pquery);
+    put<uint64_t>(trailer, b.num_pqueries);
+    put<uint64_t>(trailer, b.num_placements);
+  }
+  put<uint64_t>(trailer, offset_);
+  trailer.append(BPLACE_MAGIC, BPLACE_MAGIC_SIZE);
+
+  file_.write(trailer.data(), trailer.size());
+  file_.close();
+}
+
+void Binary_Placement_Writer::write_(Sample<>& chunk)
+{
+  if (not chunk.size()) {
+    return;
+  }
+
+  Binary_Placement::Block block;
+  encode_block(chunk, mapper_, buffer_, block.num_placements);
+  block.offset = offset_;
+  block.size = buffer_.size();
+  block.first_pquery = num_pqueries_;
+  block.num_pqueries = chunk.size();
+
+  file_.write(buffer_.data(), buffer_.size());
+  file_.flush();
+  if (not file_) {
+    throw std::runtime_error{"Failed to write to " + file_path_};
+  }
+
+  offset_ += block.size;
+  num_pqueries_ += block.num_pqueries;
+  blocks_.push_back(block);
+}
+
+bool Binary_Placement::is_binary_placement(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  char magic[BPLACE_MAGIC_SIZE];
+  return in.read(magic, BPLACE_MAGIC_SIZE) and std::memcmp(magic, BPLACE_MAGIC, BPLACE_MAGIC_SIZE) == 0;
+}
+
+Binary_Placement::Binary_Placement(const std::string& file_name)
+  : file_name_(file_name)
+{
+  fd_ = open(file_name.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    throw std::runtime_error{"Cannot open file: " + file_name};
+  }
+  const auto size = lseek(fd_, 0, SEEK_END);
+
+  try {
+    const size_t tail_size = sizeof(uint64_t) + BPLACE_MAGIC_SIZE;
+    if (size < static_cast<off_t>(2 * BPLACE_MAGIC_SIZE + 4 * sizeof(uint64_t) + tail_size)) {
+      throw std::runtime_error{"Not a bplace file: " + file_name};
+    }
+
+    // head
+    std::string head(BPLACE_MAGIC_SIZE + 2 * sizeof(uint64_t), '\0');
+    pread_all(fd_, &head[0], head.size(), 0);
+    if (std::memcmp(head.data(), BPLACE_MAGIC, BPLACE_MAGIC_SIZE) != 0) {
+      throw std::runtime_error{"Not a bplace file: " + file_name};
+    }
+    Cursor head_cursor(head.data() + BPLACE_MAGIC_SIZE, head.data() + head.size());
+    const auto version = head_cursor.get<uint64_t>();
+    if (version != BPLACE_VERSION) {
+      throw std::runtime_error{"Unsupported bplace version " + std::to_string(version) + ": " + file_name};
+    }
+    precision_ = head_cursor.get<uint64_t>();
+
+    // tail, pointing at the index
+    std::string tail(tail_size, '\0');
+    pread_all(fd_, &tail[0], tail.size(), size - tail_size);
+    if (std::memcmp(tail.data() + sizeof(uint64_t), BPLACE_MAGIC, BPLACE_MAGIC_SIZE) != 0) {
+      throw std::runtime_error{"Incomplete bplace file (the writing run did not finish?): " + file_name};
+    }
+    uint64_t index_offset;
+    std::memcpy(&index_offset, tail.data(), sizeof(index_offset));
+    if (index_offset > static_cast<uint64_t>(size - tail_size)) {
+      throw std::runtime_error{"Corrupt bplace index: " + file_name};
+    }
+
+    // tree and invocation follow the head, each read on its own rather than along
+    // with the blocks behind them
+    uint64_t pos = head.size();
+    auto read_string = [&](std::string& result) {
+      uint64_t length;
+      if (pos + sizeof(length) > index_offset) {
+        throw std::runtime_error{"Truncated bplace file"};
+      }
+      pread_all(fd_, reinterpret_cast<char*>(&length), sizeof(length), pos);
+      pos += sizeof(length);
+      if (length > index_offset - pos) {
+        throw std::runtime_error{"Truncated bplace file"};
+      }
+      result.assign(length, '\0');
+      if (length) {
+        pread_all(fd_, &result[0], length, pos);
+      }
+      pos += length;
+    };
+    read_string(tree_);
+    read_string(invocation_);
+
+    std::string index(size - tail_size - index_offset, '\0');
+    pread_all(fd_, &index[0], index.size(), index_offset);
+    Cursor cursor(index.data(), index.data() + index.size());
+    const auto num_blocks = cursor.get<uint64_t>();
+    for (size_t i = 0; i < num_blocks; ++i) {
+      Block b;
+      b.offset          = cursor.get<uint64_t>();
+      b.size            = cursor.get<uint64_t>();
+      b.first_pquery    = cursor.get<uint64_t>();
+      b.num_pqueries    = cursor.get<uint64_t>();
+      b.num_placements  = cursor.get<uint64_t>();
+      if (b.offset + b.size > index_offset) {
+        throw std::runtime_error{"Corrupt bplace index: " + file_name};
+      }
+      blocks_.push_back(b);
+    }
+  } catch (...) {
+    close(fd_);
+    throw;
+  }
+}
+
+Binary_Placement::~Binary_Placement()
+{
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+size_t Binary_Placement::num_pqueries() const
+{
+  return blocks_.empty() ? 0 : blocks_.back().first_pquery + blocks_.back().num_pqueries;
+}
+
+size_t Binary_Placement::block_of(const size_t pquery) const
+{
+  auto it = std::upper_bound( blocks_.begin(), blocks_.end(), pquery,
+                              [](const size_t p, const Block& b){ return p < b.first_pquery; });
+  if (it == blocks_.begin() or pquery >= num_pqueries()) {
+    throw std::out_of_range{"No such pquery in " + file_name_ + ": " + std::to_string(pquery)};
+  }
+  return std::distance(blocks_.begin(), it) - 1;
+}
+
+Sample<Placement> Binary_Placement::read_block(const size_t i) const
+{
+  const auto& block = blocks_.at(i);
+  std::string data(block.size, '\0');
+  pread_all(fd_, &data[0], data.size(), block.offset);
+
+  Cursor cursor(data.data(), data.data() + data.size());
+  const auto n = cursor.get<uint64_t>();
+  const auto num_placements = cursor.get<uint64_t>();
+  if (n != block.num_pqueries or num_placements != block.num_placements) {
+    throw std::runtime_error{"Corrupt bplace block: " + file_name_};
+  }
+
+  const auto seq_ids = cursor.get_column<uint64_t>(n);
+  const auto placement_counts = cursor.get_column<uint32_t>(n);
+  const auto name_counts = cursor.get_column<uint32_t>(n);
+  size_t total_names = 0;
+  for (const auto c : name_counts) {
+    total_names += c;
+  }
+  const auto name_lengths = cursor.get_column<uint32_t>(total_names);
+
+  Sample<Placement> sample;
+  size_t name = 0;
+  for (size_t q = 0; q < n; ++q) {
+    if (not name_counts[q]) {
+      throw std::runtime_error{"Corrupt bplace block: " + file_name_};
+    }
+    for (size_t k = 0; k < name_counts[q]; ++k, ++name) {
+      std::string label(cursor.take_(name_lengths[name]), name_lengths[name]);
+      if (k == 0) {
+        sample.emplace_back(seq_ids[q], label);
+      } else {
+        sample.back().add_duplicate(std::move(label));
+      }
+    }
+  }
+
+  const auto edges = cursor.get_column<uint32_t>(num_placements);
+  const auto likelihoods = cursor.get_column<double>(num_placements);
+  const auto lwrs = cursor.get_column<double>(num_placements);
+  const auto distals = cursor.get_column<double>(num_placements);
+  const auto pendants = cursor.get_column<double>(num_placements);
+
+  size_t p = 0;
+  for (size_t q = 0; q < n; ++q) {
+    auto& pq = sample[q];
+    for (size_t k = 0; k < placement_counts[q]; ++k, ++p) {
+      if (p >= num_placements) {
+        throw std::runtime_error{"Corrupt bplace block: " + file_name_};
+      }
+      pq.emplace_back(edges[p], likelihoods[p], pendants[p], distals[p]);
+      pq.back().lwr(lwrs[p]);
+    }
+  }
+
+  return sample;
+}
+
+void Binary_Placement::to_jplace(std::ostream& os) const
+{
+  init_jplace_string(tree_, os);
+
+  std::string buffer;
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    buffer.clear();
+    if (i) {
+      buffer.append(",\n");
+    }
+    // edges and distal lengths are already those of the rooted tree
+    sample_to_jplace_buffer(read_block(i), buffer, rtree_mapper(), precision_, 0);
+    os.write(buffer.data(), buffer.size());
+  }
+
+  finalize_jplace_string(invocation_, os);
+}
+
+std::string Binary_Placement::convert(const std::string& file_name, const std::string& out_dir)
+{
+  Binary_Placement bplace(file_name);
+
+  auto name = file_name.substr(file_name.find_last_of('/') + 1);
+  const std::string extension(EXTENSION);
+  if (name.size() > extension.size()
+      and name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+    name.resize(name.size() - extension.size());
+  }
+  if (name.size() < 7 or name.compare(name.size() - 7, 7, ".jplace") != 0) {
+    name += ".jplace";
+  }
+  const auto out_file = out_dir + name;
+
+  if (utils::file_exists(out_file) and not utils::Options::get().allow_file_overwriting()) {
+    throw std::runtime_error{"Output file already exists: " + out_file};
+  }
+  std::ofstream out(out_file, std::ios::binary);
+  if (not out) {
+    throw std::runtime_error{"Cannot open file for writing: " + out_file};
+  }
+
+  bplace.to_jplace(out);
+
+  if (not out) {
+    throw std::runtime_error{"Failed to write file: " + out_file};
+  }
+  return out_file;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include "sample/Sample.hpp"
+#include "core/pll/rtree_mapper.hpp"
+#include "io/placement_writer_interface.hpp"
+
+/**
+ * Compact binary placement output (bplace), an alternative to jplace that is cheap
+ * to write and to read back, and that can be converted to jplace when needed.
+ *
+ * Layout:
+ * <magic><version><precision><numbered tree><invocation>
+ * <block>...
+ * <number of blocks>
+ *   <<offset><size><first pquery><number of pqueries><number of placements>>...
+ * <index offset><magic>
+ *
+ * Strings are stored as <length><bytes>, integers in host byte order. There is one
+ * block per written chunk, laid out in columns:
+ * <number of pqueries><number of placements>
+ * <sequence id>... <placements per pquery>... <names per pquery>...
+ * <name length>... <names>
+ * <edge (uint32)>... <likelihood>... <lwr>... <distal length>... <pendant length>...
+ *
+ * Edges and distal lengths are stored as they appear in the jplace output, that is,
+ * translated to the rooted tree where applicable. The precision is the one the jplace
+ * output would have been written with, and is used when converting.
+ */
+class Binary_Placement
+{
+public:
+  struct Block
+  {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t first_pquery;
+    uint64_t num_pqueries;
+    uint64_t num_placements;
+  };
+
+  /**
+   * Opens the file and reads its index. Throws if it is not a bplace file.
+   */
+  explicit Binary_Placement(const std::string& file_name);
+  ~Binary_Placement();
+
+  Binary_Placement(Binary_Placement const& other) = delete;
+  Binary_Placement& operator= (Binary_Placement const& other) = delete;
+
+  const std::string& tree() const { return tree_; }
+  const std::string& invocation() const { return invocation_; }
+  unsigned int precision() const { return precision_; }
+  const std::vector<Block>& blocks() const { return blocks_; }
+  size_t num_pqueries() const;
+
+  /**
+   * Index of the block holding the n-th pquery of the file.
+   */
+  size_t block_of(const size_t pquery) const;
+
+  /**
+   * Reads a block back into a sample. Thread safe.
+   */
+  Sample<Placement> read_block(const size_t i) const;
+
+  /**
+   * Writes the whole file as jplace.
+   */
+  void to_jplace(std::ostream& os) const;
+
+  static bool is_binary_placement(const std::string& file_name);
+
+  /**
+   * Converts the file to jplace, returning the name of the output: the name of the
+   * input without its .bplace extension, in out_dir.
+   */
+  static std::string convert(const std::string& file_name, const std::string& out_dir);
+
+  static constexpr const char* EXTENSION = ".bplace";
+
+private:
+  std::string file_name_;
+  int fd_ = -1;
+  std::string tree_;
+  std::string invocation_;
+  unsigned int precision_ = 6;
+  std::vector<Block> blocks_;
+};
+
+/**
+ * Writer of the bplace format, used in place of jplace_writer.
+ */
+class Binary_Placement_Writer : public async_placement_writer
+{
+public:
+  Binary_Placement_Writer(const std::string& out_dir,
+                          const std::string& file_name,
+                          const std::string& tree_string,
+                          const std::string& invocation_string,
+                          rtree_mapper const& mapper,
+                          unsigned int const precision);
+  ~Binary_Placement_Writer() override;
+
+private:
+  void write_(Sample<>& chunk) override;
+
+  std::ofstream file_;
+  std::string file_path_;
+  rtree_mapper const mapper_;
+  uint64_t offset_ = 0;
+  uint64_t num_pqueries_ = 0;
+  std::vector<Binary_Placement::Block> blocks_;
+  // encoded block, kept to reuse its allocation
+  std::string buffer_;
+};
@@ -0,0 +1,199 @@
+#include "io/Block_Compressor.hpp"
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#ifdef __ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef __ZSTD
+#include <zstd.h>
+#endif
+
+#include "util/parallel.hpp"
+
+// uncompressed bytes per BGZF block, as used by bgzip: leaves room for incompressible
+// data within the 64 KB limit of a block
+constexpr size_t BGZF_BLOCK_SIZE = 0xff00;
+constexpr size_t ZSTD_FRAME_SIZE = 1u << 20;
+constexpr int ZSTD_OUT_LEVEL = 3;
+
+Block_Compressor::Format Block_Compressor::parse_format(const std::string& name)
+{
+  if (name == "none") {
+    return Format::kNone;
+  }
+  if (name == "gzip" or name == "gz") {
+    return Format::kGzip;
+  }
+  if (name == "zstd" or name == "zst") {
+    return Format::kZstd;
+  }
+  throw std::runtime_error{"Unknown compression format: " + name + " (expected gzip, zstd or none)"};
+}
+
+std::string Block_Compressor::extension(const Format format)
+{
+  switch (format) {
+    case Format::kGzip:
+      return ".gz";
+    case Format::kZstd:
+      return ".zst";
+    default:
+      return "";
+  }
+}
+
+Block_Compressor::Block_Compressor(const Format format, const size_t num_threads)
+  : format_(format)
+  , num_threads_(num_threads)
+{
+  #ifdef __OMP
+  if (not num_threads_) {
+    num_threads_ = omp_get_max_threads();
+  }
+  #endif
+  num_threads_ = std::max<size_t>(num_threads_, 1u);
+
+  switch (format_) {
+    case Format::kGzip:
+      #ifndef __ZLIB
+      throw std::runtime_error{"Built without zlib, cannot write gzip output"};
+      #endif
+      block_size_ = BGZF_BLOCK_SIZE;
+      break;
+    case Format::kZstd:
+      #ifndef __ZSTD
+      throw std::runtime_error{"Built without zstd support (see EPA_ZSTD), cannot write zstd output"};
+      #endif
+      block_size_ = ZSTD_FRAME_SIZE;
+      break;
+    default:
+      break;
+  }
+}
+
+#ifdef __ZLIB
+static inline void put_u16(std::string& out, const unsigned value)
+{
+  out.push_back(static_cast<char>(value & 0xffu));
+  out.push_back(static_cast<char>((value >> 8u) & 0xffu));
+}
+
+static inline void put_u32(std::string& out, const unsigned long value)
+{
+  put_u16(out, value & 0xffffu);
+  put_u16(out, (value >> 16u) & 0xffffu);
+}
+
+static void bgzf_block(const char* data, const size_t size, std::string& out)
+{
+  const auto in = reinterpret_cast<const Bytef*>(data);
+
+  std::string deflated(compressBound(size) + 16, '\0');
+  z_stream zs = {};
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw std::runtime_error{"Failed to initialize gzip compression"};
+  }
+  zs.next_in = const_cast<Bytef*>(in);
+  zs.avail_in = size;
+  zs.next_out = reinterpret_cast<Bytef*>(&deflated[0]);
+  zs.avail_out = deflated.size();
+  const auto status = deflate(&zs, Z_FINISH);
+  deflated.resize(zs.total_out);
+  deflateEnd(&zs);
+  if (status != Z_STREAM_END) {
+    throw std::runtime_error{"Failed to gzip compress output block"};
+  }
+
+  // gzip member header, with the BC extra field holding the block size
+  static const char header[] = {'\x1f', '\x8b', '\x08', '\x04', 0, 0, 0, 0, 0, '\xff'};
+  out.append(header, sizeof(header));
+  put_u16(out, 6);
+  out.append("BC");
+  put_u16(out, 2);
+  put_u16(out, 18 + deflated.size() + 8 - 1);
+  out.append(deflated);
+  put_u32(out, crc32(0, in, size));
+  put_u32(out, size);
+}
+#endif
+
+void Block_Compressor::compress_block_(const char* data, const size_t size, std::string& out) const
+{
+  switch (format_) {
+    case Format::kGzip:
+      #ifdef __ZLIB
+      bgzf_block(data, size, out);
+      #endif
+      break;
+    case Format::kZstd:
+    {
+      #ifdef __ZSTD
+      const auto offset = out.size();
+      out.resize(offset + ZSTD_compressBound(size));
+      const auto written = ZSTD_compress(&out[offset], out.size() - offset, data, size, ZSTD_OUT_LEVEL);
+      if (ZSTD_isError(written)) {
+        throw std::runtime_error{std::string("zstd: ") + ZSTD_getErrorName(written)};
+      }
+      out.resize(offset + written);
+      #endif
+      break;
+    }
+    default:
+      out.append(data, size);
+  }
+}
+
+void Block_Compressor::compress(const std::string& data, std::string& out) const
+{
+  if (format_ == Format::kNone) {
+    out.append(data);
+    return;
+  }
+  if (data.empty()) {
+    return;
+  }
+
+  const size_t num_blocks = (data.size() + block_size_ - 1) / block_size_;
+  const size_t threads = std::min(num_threads_, num_blocks);
+
+  if (threads <= 1) {
+    for (size_t b = 0; b < num_blocks; ++b) {
+      const auto offset = b * block_size_;
+      compress_block_(data.data() + offset, std::min(block_size_, data.size() - offset), out);
+    }
+    return;
+  }
+
+  std::vector<std::string> blocks(num_blocks);
+
+  parallel_for(0, num_blocks, threads, [&](const size_t b) {
+    const auto offset = b * block_size_;
+    compress_block_(data.data() + offset, std::min(block_size_, data.size() - offset), blocks[b]);
+  }, Schedule::kDynamic);
+
+  size_t total = out.size();
+  for (const auto& block : blocks) {
+    total += block.size();
+  }
+  out.reserve(total);
+  for (const auto& block : blocks) {
+    out.append(block);
+  }
+}
+
+std::string Block_Compressor::finish() const
+{
+  std::string result;
+  if (format_ == Format::kGzip) {
+    compress_block_(nullptr, 0, result);
+  }
+  return result;
+}
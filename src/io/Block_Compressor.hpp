@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Compresses output in independent blocks, pigz-style, so that blocks can be
+ * compressed in parallel and written out piece by piece while still forming one
+ * valid compressed stream when concatenated.
+ *
+ * gzip output is written as BGZF (blocked gzip, as written by bgzip): a series of
+ * gzip members of at most 64 KB each, which plain gzip tools read as one stream and
+ * Block_Decompressor (as well as bgzip and htslib) inflates in parallel. zstd output
+ * is written as a series of frames, one per MB of input.
+ *
+ * gzip requires building with zlib (__ZLIB), zstd with libzstd (__ZSTD, see
+ * ENABLE_ZSTD). The constructor throws for formats that are not supported.
+ */
+class Block_Compressor
+{
+public:
+  enum class Format { kNone, kGzip, kZstd };
+
+  /**
+   * Parses "none", "gzip" (or "gz") and "zstd" (or "zst").
+   */
+  static Format parse_format(const std::string& name);
+
+  /**
+   * File name extension of the format, including the dot.
+   */
+  static std::string extension(const Format format);
+
+  /**
+   * Zero threads means as many as OpenMP would use.
+   */
+  explicit Block_Compressor(const Format format, const size_t num_threads = 0);
+  ~Block_Compressor() = default;
+
+  Format format() const { return format_; }
+
+  /**
+   * Appends the compressed form of data to out, as independent blocks.
+   */
+  void compress(const std::string& data, std::string& out) const;
+
+  /**
+   * Bytes that end the stream, to be written after the last block: the empty BGZF
+   * block that marks the end of a BGZF file, nothing for zstd.
+   */
+  std::string finish() const;
+
+private:
+  void compress_block_(const char* data, const size_t size, std::string& out) const;
+
+  Format format_ = Format::kNone;
+  size_t num_threads_ = 1;
+  size_t block_size_ = 0;
+};
@@ -0,0 +1,382 @@
+#include "io/Block_Decompressor.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#ifdef __ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef __ZSTD
+#include <zstd.h>
+#endif
+
+#include "util/parallel.hpp"
+
+// output produced per read() when decompressing serially
+constexpr size_t STREAM_PIECE_SIZE = 4u * 1024u * 1024u;
+// units per thread decompressed per read()
+constexpr size_t UNITS_PER_THREAD = 4u;
+
+struct Block_Decompressor::Stream
+{
+  size_t in_pos = 0;
+  bool done = false;
+  #ifdef __ZLIB
+  z_stream zs;
+  bool zs_init = false;
+  #endif
+  #ifdef __ZSTD
+  ZSTD_DStream* zds = nullptr;
+  #endif
+
+  ~Stream()
+  {
+    #ifdef __ZLIB
+    if (zs_init) {
+      inflateEnd(&zs);
+    }
+    #endif
+    #ifdef __ZSTD
+    if (zds) {
+      ZSTD_freeDStream(zds);
+    }
+    #endif
+  }
+};
+
+static inline uint16_t get_le16(const unsigned char* p)
+{
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const unsigned char* p)
+{
+  return static_cast<uint32_t>(p[0])
+      | (static_cast<uint32_t>(p[1]) << 8)
+      | (static_cast<uint32_t>(p[2]) << 16)
+      | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static inline bool is_gzip(const unsigned char* p, const size_t size)
+{
+  return size >= 18 and p[0] == 0x1f and p[1] == 0x8b;
+}
+
+/**
+ * Total size of the BGZF block at p, or 0 if p is not the start of a BGZF block.
+ */
+static size_t bgzf_block_size(const unsigned char* p, const size_t size)
+{
+  // FLG.FEXTRA must be set, followed by a BC subfield holding the block size
+  if (not is_gzip(p, size) or not (p[3] & 4u)) {
+    return 0;
+  }
+  const size_t xlen = get_le16(p + 10);
+  size_t i = 12;
+  while (i + 4 <= 12 + xlen and i + 4 <= size) {
+    const size_t slen = get_le16(p + i + 2);
+    if (p[i] == 'B' and p[i + 1] == 'C' and slen == 2) {
+      return static_cast<size_t>(get_le16(p + i + 4)) + 1u;
+    }
+    i += 4 + slen;
+  }
+  return 0;
+}
+
+static inline bool is_zstd(const unsigned char* p, const size_t size)
+{
+  return size >= 4 and get_le32(p) == 0xFD2FB528u;
+}
+
+Block_Decompressor::Format Block_Decompressor::detect(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  unsigned char head[18] = {0};
+  in.read(reinterpret_cast<char*>(head), sizeof(head));
+  const size_t n = in.gcount();
+
+  if (is_zstd(head, n)) {
+    return Format::kZstd;
+  }
+  if (n >= 2 and head[0] == 0x1f and head[1] == 0x8b) {
+    return bgzf_block_size(head, n) ? Format::kBGZF : Format::kGzip;
+  }
+  return Format::kNone;
+}
+
+Block_Decompressor::Block_Decompressor(const std::string& file_name, const size_t num_threads)
+  : format_(detect(file_name))
+  , num_threads_(num_threads)
+{
+  #ifdef __OMP
+  if (not num_threads_) {
+    num_threads_ = omp_get_max_threads();
+  }
+  #endif
+  num_threads_ = std::max<size_t>(num_threads_, 1u);
+
+  switch (format_) {
+    case Format::kNone:
+      throw std::runtime_error{"Not a gzip or zstd compressed file: " + file_name};
+    case Format::kGzip:
+    case Format::kBGZF:
+      #ifndef __ZLIB
+      throw std::runtime_error{"Built without zlib, cannot read gzip compressed file: " + file_name};
+      #endif
+      break;
+    case Format::kZstd:
+      #ifndef __ZSTD
+      throw std::runtime_error{"Built without zstd support (see EPA_ZSTD), cannot read: " + file_name};
+      #endif
+      break;
+  }
+
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error{std::string("Cannot map empty or unreadable file: ") + file_name};
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error{std::string("Cannot map file: ") + file_name};
+  }
+  data_ = static_cast<const unsigned char*>(map);
+  madvise(map, size_, MADV_SEQUENTIAL);
+
+  index_units_();
+}
+
+Block_Decompressor::~Block_Decompressor()
+{
+  if (data_) {
+    munmap(const_cast<unsigned char*>(data_), size_);
+  }
+}
+
+/**
+ * Find the independently decompressible units. Only worth it if there are several,
+ * otherwise units_ stays empty and the file is decompressed as one stream.
+ */
+void Block_Decompressor::index_units_()
+{
+  std::vector<Unit> units;
+  size_t offset = 0;
+
+  if (format_ == Format::kBGZF) {
+    while (offset < size_) {
+      const size_t block_size = bgzf_block_size(data_ + offset, size_ - offset);
+      if (not block_size or offset + block_size > size_) {
+        // not BGZF after all, or truncated
+        return;
+      }
+      // ISIZE: the last four bytes of the block
+      units.push_back({offset, block_size, get_le32(data_ + offset + block_size - 4)});
+      offset += block_size;
+    }
+  }
+
+  #ifdef __ZSTD
+  if (format_ == Format::kZstd) {
+    while (offset < size_) {
+      const size_t frame_size = ZSTD_findFrameCompressedSize(data_ + offset, size_ - offset);
+      if (ZSTD_isError(frame_size)) {
+        return;
+      }
+      const auto content_size = ZSTD_getFrameContentSize(data_ + offset, size_ - offset);
+      const bool known  = content_size != ZSTD_CONTENTSIZE_UNKNOWN
+                      and content_size != ZSTD_CONTENTSIZE_ERROR;
+      units.push_back({offset, frame_size, known ? static_cast<size_t>(content_size) : 0u});
+      offset += frame_size;
+    }
+  }
+  #endif
+
+  if (units.size() > 1) {
+    units_ = std::move(units);
+  }
+}
+
+void Block_Decompressor::decompress_unit_(const Unit& unit, std::string& out) const
+{
+  #ifdef __ZLIB
+  if (format_ == Format::kBGZF) {
+    out.resize(unit.content_size);
+    if (not unit.content_size) {
+      return;
+    }
+    z_stream zs = {};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+      throw std::runtime_error{"inflateInit2 failed"};
+    }
+    zs.next_in   = const_cast<unsigned char*>(data_ + unit.offset);
+    zs.avail_in  = static_cast<uInt>(unit.size);
+    zs.next_out  = reinterpret_cast<unsigned char*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+      throw std::runtime_error{"Corrupt BGZF block at byte " + std::to_string(unit.offset)};
+    }
+    return;
+  }
+  #endif
+
+  #ifdef __ZSTD
+  if (format_ == Format::kZstd) {
+    if (unit.content_size) {
+      out.resize(unit.content_size);
+      const size_t ret = ZSTD_decompress(&out[0], out.size(), data_ + unit.offset, unit.size);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error{std::string("zstd: ") + ZSTD_getErrorName(ret)};
+      }
+      out.resize(ret);
+      return;
+    }
+    // size not recorded in the frame header: decompress incrementally
+    out.clear();
+    std::unique_ptr<ZSTD_DStream, size_t(*)(ZSTD_DStream*)> zds(ZSTD_createDStream(), ZSTD_freeDStream);
+    ZSTD_initDStream(zds.get());
+    ZSTD_inBuffer in = { data_ + unit.offset, unit.size, 0 };
+    std::string piece(ZSTD_DStreamOutSize(), '\0');
+    // a full output buffer may mean there is more to flush
+    ZSTD_outBuffer o = { &piece[0], piece.size(), piece.size() };
+    while (in.pos < in.size or o.pos == o.size) {
+      o.pos = 0;
+      const size_t ret = ZSTD_decompressStream(zds.get(), &o, &in);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error{std::string("zstd: ") + ZSTD_getErrorName(ret)};
+      }
+      out.append(piece.data(), o.pos);
+    }
+    return;
+  }
+  #endif
+
+  static_cast<void>(unit);
+  static_cast<void>(out);
+  throw std::runtime_error{"Unsupported compression format"};
+}
+
+bool Block_Decompressor::read(std::string& buffer)
+{
+  if (units_.empty()) {
+    return read_stream_(buffer);
+  }
+
+  if (next_unit_ >= units_.size()) {
+    return false;
+  }
+
+  const size_t begin = next_unit_;
+  const size_t end = std::min(units_.size(), begin + num_threads_ * UNITS_PER_THREAD);
+  next_unit_ = end;
+
+  std::vector<std::string> parts(end - begin);
+
+  parallel_for(begin, end, num_threads_, [&](const size_t i) {
+    decompress_unit_(units_[i], parts[i - begin]);
+  }, Schedule::kDynamic);
+
+  for (const auto& p : parts) {
+    buffer.append(p);
+  }
+  return true;
+}
+
+bool Block_Decompressor::read_stream_(std::string& buffer)
+{
+  if (not stream_) {
+    stream_ = std::make_unique<Stream>();
+  }
+  auto& s = *stream_;
+
+  if (s.done) {
+    return false;
+  }
+
+  const size_t start = buffer.size();
+
+  #ifdef __ZLIB
+  if (format_ == Format::kGzip or format_ == Format::kBGZF) {
+    if (not s.zs_init) {
+      s.zs = {};
+      if (inflateInit2(&s.zs, 16 + MAX_WBITS) != Z_OK) {
+        throw std::runtime_error{"inflateInit2 failed"};
+      }
+      s.zs_init = true;
+    }
+
+    buffer.resize(start + STREAM_PIECE_SIZE);
+    s.zs.next_out  = reinterpret_cast<unsigned char*>(&buffer[start]);
+    s.zs.avail_out = static_cast<uInt>(STREAM_PIECE_SIZE);
+
+    while (s.zs.avail_out and not s.done) {
+      if (not s.zs.avail_in) {
+        const size_t chunk = std::min<size_t>(size_ - s.in_pos, 1u << 30);
+        s.zs.next_in  = const_cast<unsigned char*>(data_ + s.in_pos);
+        s.zs.avail_in = static_cast<uInt>(chunk);
+        s.in_pos += chunk;
+      }
+      const int ret = inflate(&s.zs, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+        // concatenated gzip members are allowed
+        if (s.zs.avail_in or s.in_pos < size_) {
+          inflateReset(&s.zs);
+        } else {
+          s.done = true;
+        }
+      } else if (ret != Z_OK) {
+        throw std::runtime_error{"Corrupt gzip stream"};
+      } else if (not s.zs.avail_in and s.in_pos >= size_) {
+        throw std::runtime_error{"Truncated gzip stream"};
+      }
+    }
+    buffer.resize(start + STREAM_PIECE_SIZE - s.zs.avail_out);
+  }
+  #endif
+
+  #ifdef __ZSTD
+  if (format_ == Format::kZstd) {
+    if (not s.zds) {
+      s.zds = ZSTD_createDStream();
+      ZSTD_initDStream(s.zds);
+    }
+
+    buffer.resize(start + STREAM_PIECE_SIZE);
+    ZSTD_outBuffer out = { &buffer[start], STREAM_PIECE_SIZE, 0 };
+    ZSTD_inBuffer in = { data_, size_, s.in_pos };
+    while (out.pos < out.size) {
+      const size_t ret = ZSTD_decompressStream(s.zds, &out, &in);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error{std::string("zstd: ") + ZSTD_getErrorName(ret)};
+      }
+      // all input consumed and the output not full: everything was flushed
+      if (in.pos >= in.size and out.pos < out.size) {
+        s.done = true;
+        break;
+      }
+    }
+    s.in_pos = in.pos;
+    buffer.resize(start + out.pos);
+  }
+  #endif
+
+  return buffer.size() > start or not s.done;
+}
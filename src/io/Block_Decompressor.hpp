@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+ * Decompresses a gzip or zstd compressed file piece by piece.
+ *
+ * Where the format splits the data into independently compressed units, namely the
+ * blocks of BGZF (blocked gzip, as written by bgzip) and the frames of multi-frame
+ * zstd files (as written by zstd -T or pzstd), batches of units are decompressed
+ * in parallel. Plain gzip and single-frame zstd files are inflated serially.
+ *
+ * gzip requires building with zlib (__ZLIB), zstd with libzstd (__ZSTD, see
+ * ENABLE_ZSTD). The constructor throws for formats that are not supported.
+ */
+class Block_Decompressor
+{
+public:
+  enum class Format { kNone, kGzip, kBGZF, kZstd };
+
+  static Format detect(const std::string& file_name);
+
+  /**
+   * Zero threads means as many as OpenMP would use.
+   */
+  Block_Decompressor(const std::string& file_name, const size_t num_threads = 0);
+  ~Block_Decompressor();
+
+  Block_Decompressor(Block_Decompressor const& other) = delete;
+  Block_Decompressor& operator= (Block_Decompressor const& other) = delete;
+
+  Format format() const { return format_; }
+
+  /**
+   * Appends the next piece of decompressed data to buffer. Returns false, leaving
+   * buffer untouched, once all data was handed out.
+   */
+  bool read(std::string& buffer);
+
+private:
+  struct Unit
+  {
+    size_t offset;
+    size_t size;
+    // decompressed size, 0 if unknown
+    size_t content_size;
+  };
+
+  void index_units_();
+  void decompress_unit_(const Unit& unit, std::string& out) const;
+  bool read_stream_(std::string& buffer);
+
+  Format format_ = Format::kNone;
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t num_threads_ = 1;
+
+  std::vector<Unit> units_;
+  size_t next_unit_ = 0;
+
+  // state of serial decompression
+  struct Stream;
+  std::unique_ptr<Stream> stream_;
+};
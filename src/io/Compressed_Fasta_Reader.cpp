@@ -0,0 +1,226 @@
+#include "io/Compressed_Fasta_Reader.hpp"
+
+#include <stdexcept>
+#include <tuple>
+#include <algorithm>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "net/epa_mpi_util.hpp"
+#include "util/parallel.hpp"
+
+Compressed_Fasta_Reader::Compressed_Fasta_Reader( const std::string& file_name,
+                                                  const MSA_Info& info,
+                                                  const bool premasking,
+                                                  const bool split,
+                                                  const size_t parse_threads)
+  : info_(info)
+  , decompressor_(file_name)
+  , parser_(info, premasking)
+  , parse_threads_(std::max<size_t>(parse_threads, 1u))
+{
+  // if we are under MPI, skip to this ranks assigned part of the input file
+  #ifdef __MPI
+  if ( split ) {
+    std::tie(local_seq_offset_, max_read_) = local_seq_package( info.sequences() );
+    skip_to_sequence( local_seq_offset_ );
+  }
+  #else
+  static_cast<void>(split);
+  #endif
+}
+
+bool Compressed_Fasta_Reader::fill_()
+{
+  if (eof_) {
+    return false;
+  }
+  if (not decompressor_.read(window_)) {
+    eof_ = true;
+  }
+  return not eof_;
+}
+
+/**
+ * Positions of the next (up to) number complete records in the window, decompressing
+ * more data as needed. Advances pos_ past them.
+ */
+std::vector<size_t> Compressed_Fasta_Reader::locate_(const size_t number)
+{
+  std::vector<size_t> starts;
+
+  while (starts.size() < number) {
+    pos_ = Fasta_Parser::skip_blank(window_.data(), window_.size(), pos_);
+    if (pos_ == window_.size()) {
+      if (fill_()) {
+        continue;
+      }
+      break;
+    }
+
+    // a record is complete once the next one starts, or at the end of the data
+    size_t scan = pos_;
+    size_t end = 0;
+    while (true) {
+      end = Fasta_Parser::next_record_start(window_.data(), window_.size(), scan);
+      if (end < window_.size()) {
+        break;
+      }
+      const size_t old_size = window_.size();
+      if (not fill_()) {
+        break;
+      }
+      // the newline preceding the next record may be the last byte we had
+      scan = std::max(pos_, old_size - 1);
+    }
+
+    starts.push_back(pos_);
+    pos_ = end;
+  }
+
+  return starts;
+}
+
+void Compressed_Fasta_Reader::skip_to_sequence(const size_t n)
+{
+  size_t skipped = 0;
+  while (skipped < n) {
+    const auto starts = locate_(std::min<size_t>(n - skipped, 4096u));
+    if (starts.empty()) {
+      throw std::runtime_error{"Trying to skip out of bounds!"};
+    }
+    skipped += starts.size();
+    // drop what was skipped
+    window_.erase(0, pos_);
+    pos_ = 0;
+  }
+}
+
+void Compressed_Fasta_Reader::skip(const size_t n)
+{
+  if (num_read_) {
+    throw std::runtime_error{"Skipping currently not allowed after first read!"};
+  }
+  if (n > max_read_) {
+    throw std::runtime_error{"Trying to skip out of bounds!"};
+  }
+  // relative to where this rank starts
+  skip_to_sequence(n);
+  num_read_ = n;
+}
+
+size_t Compressed_Fasta_Reader::read_next(MSA& result, const size_t number)
+{
+  result = MSA(parser_.masked_width());
+
+  // the previous chunk is no longer needed
+  window_.erase(0, pos_);
+  pos_ = 0;
+
+  const size_t number_left = std::min(number, max_read_ - num_read_);
+  const auto starts = locate_(number_left);
+
+  // the window is not modified anymore until the next call, so the records can be
+  // parsed in parallel
+  const char* data = window_.data();
+  const size_t size = window_.size();
+
+  if (parse_threads_ <= 1) {
+    std::string label;
+    std::string sequence;
+    for (const auto start : starts) {
+      parser_.parse(data, size, start, label, sequence);
+      result.append(std::move(label), std::move(sequence));
+    }
+  } else {
+    std::vector<Sequence> records(starts.size());
+
+    parallel_for(0, starts.size(), parse_threads_, [&](const size_t i) {
+      std::string label;
+      std::string sequence;
+      parser_.parse(data, size, starts[i], label, sequence);
+      records[i] = Sequence(std::move(label), std::move(sequence));
+    });
+
+    result.move_sequences(records.begin(), records.end());
+  }
+
+  num_read_ += result.size();
+
+  return result.size();
+}
+
+bool is_compressed_fasta(const std::string& file_name)
+{
+  switch (Block_Decompressor::detect(file_name)) {
+    case Block_Decompressor::Format::kGzip:
+    case Block_Decompressor::Format::kBGZF:
+      #ifdef __ZLIB
+      return true;
+      #else
+      return false;
+      #endif
+    case Block_Decompressor::Format::kZstd:
+      #ifdef __ZSTD
+      return true;
+      #else
+      return false;
+      #endif
+    default:
+      return false;
+  }
+}
+
+static size_t first_record_width(const std::string& file_name)
+{
+  Block_Decompressor decompressor(file_name, 1);
+  std::string window;
+  bool more = true;
+  size_t pos = 0;
+
+  while (more) {
+    more = decompressor.read(window);
+    pos = Fasta_Parser::skip_blank(window.data(), window.size(), 0);
+    if (pos < window.size()
+        and Fasta_Parser::next_record_start(window.data(), window.size(), pos) < window.size()) {
+      break;
+    }
+  }
+
+  if (pos >= window.size()) {
+    throw std::runtime_error{std::string("Cannot read first sequence of file: ") + file_name};
+  }
+
+  return Fasta_Parser::record_width(window.data(), window.size(), pos);
+}
+
+MSA_Info compressed_msa_info(const std::string& file_name, const bool first_record_only)
+{
+  const auto sites = first_record_width(file_name);
+  MSA_Info width_only(file_name, 0, MSA_Info::mask_type(sites, false), sites);
+
+  if (first_record_only) {
+    return width_only;
+  }
+
+  // read everything, unmasked, to count the sequences and find the all-gap sites
+  Compressed_Fasta_Reader reader(file_name, width_only, false);
+  MSA chunk;
+  size_t sequences = 0;
+  auto mask = MSA_Info::mask_type(sites, true);
+
+  while (reader.read_next(chunk, 4096u)) {
+    for (const auto& s : chunk) {
+      mask &= genesis::sequence::gap_sites(genesis::sequence::Sequence(s.header(), s.sequence()));
+    }
+    sequences += chunk.size();
+  }
+
+  if (not sequences) {
+    mask = MSA_Info::mask_type();
+  }
+
+  return MSA_Info(file_name, sequences, mask, sites);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <limits>
+
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+#include "io/msa_reader_interface.hpp"
+#include "io/Fasta_Parser.hpp"
+#include "io/Block_Decompressor.hpp"
+
+/**
+ * Fasta reader for gzip or zstd compressed query files.
+ *
+ * The file is decompressed piece by piece into a window (see Block_Decompressor, which
+ * decompresses BGZF blocks and zstd frames in parallel), from which records are parsed
+ * as in Mmap_Fasta_Reader. Only the records of the current chunk are kept in memory.
+ *
+ * Compressed files cannot be seeked by record, so when splitting under MPI each rank
+ * decompresses and skips the records preceding its part.
+ */
+class Compressed_Fasta_Reader : public msa_reader
+{
+public:
+  Compressed_Fasta_Reader(const std::string& file_name,
+                          const MSA_Info& info,
+                          const bool premasking = true,
+                          const bool split = false,
+                          const size_t parse_threads = 1);
+  ~Compressed_Fasta_Reader() = default;
+
+  Compressed_Fasta_Reader(Compressed_Fasta_Reader const& other) = delete;
+  Compressed_Fasta_Reader& operator= (Compressed_Fasta_Reader const& other) = delete;
+
+  size_t read_next(MSA& result, const size_t number) override;
+  void skip(const size_t n) override;
+  size_t num_sequences() const override { return info_.sequences(); }
+  size_t local_seq_offset() const override { return local_seq_offset_; }
+
+private:
+  bool fill_();
+  std::vector<size_t> locate_(const size_t number);
+  void skip_to_sequence(const size_t n);
+
+  MSA_Info info_;
+  Block_Decompressor decompressor_;
+  Fasta_Parser parser_;
+
+  // decompressed but not yet consumed data starts at pos_
+  std::string window_;
+  size_t pos_ = 0;
+  bool eof_ = false;
+
+  size_t num_read_ = 0;
+  size_t max_read_ = std::numeric_limits<size_t>::max();
+  size_t local_seq_offset_ = 0;
+  size_t parse_threads_ = 1;
+};
+
+/**
+ * Whether the file is compressed in a format we can read.
+ */
+bool is_compressed_fasta(const std::string& file_name);
+
+/**
+ * MSA_Info of a compressed fasta file. When first_record_only is set, only the width
+ * is determined, as in make_streaming_msa_info.
+ */
+MSA_Info compressed_msa_info(const std::string& file_name, const bool first_record_only = false);
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#include "seq/MSA_Info.hpp"
+
+/**
+ * Parses fasta records out of a contiguous byte range, as used by the readers that
+ * work on raw buffers (Mmap_Fasta_Reader, Compressed_Fasta_Reader).
+ *
+ * Every sequence is built in a single pass: line breaks and other whitespace are
+ * skipped, characters uppercased and, when premasking, masked sites dropped while
+ * copying. All methods are const and may be used concurrently.
+ */
+class Fasta_Parser
+{
+public:
+  Fasta_Parser(const MSA_Info& info, const bool premasking)
+  {
+    const auto& mask = info.gap_mask();
+    keep_.assign(info.sites(), 1);
+    if (premasking and mask.size() == info.sites()) {
+      for (size_t i = 0; i < keep_.size(); ++i) {
+        keep_[i] = not mask[i];
+      }
+    }
+    masked_width_ = info.sites();
+    for (const auto k : keep_) {
+      masked_width_ -= not k;
+    }
+  }
+
+  Fasta_Parser()  = default;
+  ~Fasta_Parser() = default;
+
+  size_t width() const { return keep_.size(); }
+  size_t masked_width() const { return masked_width_; }
+
+  static size_t skip_blank(const char* data, const size_t size, size_t pos)
+  {
+    while (pos < size and std::isspace(static_cast<unsigned char>(data[pos]))) {
+      ++pos;
+    }
+    return pos;
+  }
+
+  /**
+   * Position of the first record starting after pos, or size if there is none
+   * (in the given range).
+   */
+  static size_t next_record_start(const char* data, const size_t size, size_t pos)
+  {
+    while (pos < size) {
+      const void* nl = std::memchr(data + pos, '\n', size - pos);
+      if (not nl) {
+        return size;
+      }
+      pos = static_cast<const char*>(nl) - data + 1;
+      if (pos < size and data[pos] == '>') {
+        return pos;
+      }
+    }
+    return size;
+  }
+
+  /**
+   * Number of sites of the record at pos.
+   */
+  static size_t record_width(const char* data, const size_t size, const size_t pos)
+  {
+    const auto& table = site_table();
+    const size_t end = next_record_start(data, size, pos);
+    const void* nl = std::memchr(data + pos, '\n', end - pos);
+    size_t sites = 0;
+    for (size_t i = nl ? static_cast<const char*>(nl) - data : end; i < end; ++i) {
+      sites += table[static_cast<unsigned char>(data[i])] != 0;
+    }
+    return sites;
+  }
+
+  /**
+   * Parses the record at pos, returning the position just past it.
+   */
+  size_t parse(const char* data,
+               const size_t size,
+               const size_t pos,
+               std::string& label,
+               std::string& sequence) const
+  {
+    if (data[pos] != '>') {
+      throw std::runtime_error{"Malformed fasta: expected '>' at byte " + std::to_string(pos)};
+    }
+
+    // label: the rest of the line
+    const char* begin = data + pos + 1;
+    const char* end = data + size;
+    const char* nl = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+    const char* line_end = nl ? nl : end;
+    const char* label_end = line_end;
+    if (label_end > begin and *(label_end - 1) == '\r') {
+      --label_end;
+    }
+    label.assign(begin, label_end);
+
+    // sequence: all lines up to the next record, transformed in one pass
+    const auto& table = site_table();
+    sequence.resize(masked_width_);
+    const size_t width = keep_.size();
+    size_t site = 0;
+    size_t out = 0;
+
+    const char* p = nl ? nl + 1 : end;
+    while (p < end and *p != '>') {
+      const char* next_nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      const char* stop = next_nl ? next_nl : end;
+
+      for (; p < stop; ++p) {
+        const char c = table[static_cast<unsigned char>(*p)];
+        if (not c) {
+          continue;
+        }
+        if (site < width and keep_[site]) {
+          sequence[out++] = c;
+        }
+        ++site;
+      }
+      p = next_nl ? next_nl + 1 : end;
+    }
+
+    if (site != width) {
+      throw std::runtime_error{"MSA file does not contain equal size sequences! First offending sequence: "
+        + label};
+    }
+
+    return p - data;
+  }
+
+private:
+  /**
+   * Maps every byte to its uppercase version, and whitespace to 0.
+   */
+  static const std::array<char, 256>& site_table()
+  {
+    static const auto table = [](){
+      std::array<char, 256> t;
+      for (size_t i = 0; i < t.size(); ++i) {
+        t[i] = std::isspace(static_cast<int>(i))
+             ? 0
+             : static_cast<char>(std::toupper(static_cast<int>(i)));
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  // per site: keep it (1) or drop it (0) when premasking
+  std::vector<char> keep_;
+  size_t masked_width_ = 0;
+};
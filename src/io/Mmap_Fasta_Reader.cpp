@@ -0,0 +1,157 @@
+#include "io/Mmap_Fasta_Reader.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <tuple>
+#include <algorithm>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "net/epa_mpi_util.hpp"
+#include "util/parallel.hpp"
+
+Mmap_Fasta_Reader::Mmap_Fasta_Reader( const std::string& file_name,
+                                      const MSA_Info& info,
+                                      const bool premasking,
+                                      const bool split,
+                                      const size_t parse_threads)
+  : info_(info)
+  , parse_threads_(std::max<size_t>(parse_threads, 1u))
+{
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error{std::string("Cannot open file: ") + file_name};
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error{std::string("Cannot map empty or unreadable file: ") + file_name};
+  }
+  size_ = static_cast<size_t>(st.st_size);
+
+  void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after closing the descriptor
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error{std::string("Cannot map file: ") + file_name};
+  }
+  data_ = static_cast<const char*>(map);
+  madvise(map, size_, MADV_SEQUENTIAL);
+
+  const auto magic = reinterpret_cast<const unsigned char*>(data_);
+  const bool gzip = size_ >= 2 and magic[0] == 0x1f and magic[1] == 0x8b;
+  const bool zstd = size_ >= 4
+    and magic[0] == 0x28 and magic[1] == 0xb5 and magic[2] == 0x2f and magic[3] == 0xfd;
+  if (gzip or zstd) {
+    munmap(map, size_);
+    throw std::runtime_error{"Compressed input cannot be memory mapped: " + file_name};
+  }
+
+  parser_ = Fasta_Parser(info_, premasking);
+
+  // if we are under MPI, skip to this ranks assigned part of the input file
+  #ifdef __MPI
+  if ( split ) {
+    std::tie(local_seq_offset_, max_read_) = local_seq_package( info.sequences() );
+    skip_to_sequence( local_seq_offset_ );
+  }
+  #else
+  static_cast<void>(split);
+  #endif
+}
+
+Mmap_Fasta_Reader::~Mmap_Fasta_Reader()
+{
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+void Mmap_Fasta_Reader::skip_to_sequence(const size_t n)
+{
+  const auto& offsets = info_.offsets();
+  if (n < offsets.size()) {
+    pos_ = offsets[n];
+    return;
+  }
+
+  // find the start of the n-th record
+  size_t pos = Fasta_Parser::skip_blank(data_, size_, 0);
+  for (size_t i = 0; i < n and pos < size_; ++i) {
+    pos = Fasta_Parser::next_record_start(data_, size_, pos);
+  }
+  if (pos < size_) {
+    pos_ = pos;
+    return;
+  }
+  throw std::runtime_error{"Trying to skip out of bounds!"};
+}
+
+void Mmap_Fasta_Reader::skip(const size_t n)
+{
+  if (num_read_) {
+    throw std::runtime_error{"Skipping currently not allowed after first read!"};
+  }
+  if (n > max_read_) {
+    throw std::runtime_error{"Trying to skip out of bounds!"};
+  }
+  if (not n) {
+    return;
+  }
+
+  const auto target = local_seq_offset_ + n;
+  if (target == num_sequences()) {
+    // all of it
+    pos_ = size_;
+  } else {
+    skip_to_sequence(target);
+  }
+  num_read_ = n;
+}
+
+size_t Mmap_Fasta_Reader::read_next(MSA& result, const size_t number)
+{
+  result = MSA(parser_.masked_width());
+
+  const size_t number_left = std::min(number, max_read_ - num_read_);
+
+  if (parse_threads_ <= 1) {
+    std::string label;
+    std::string sequence;
+    while (result.size() < number_left and (pos_ = Fasta_Parser::skip_blank(data_, size_, pos_)) < size_) {
+      pos_ = parser_.parse(data_, size_, pos_, label, sequence);
+      result.append(std::move(label), std::move(sequence));
+    }
+  } else {
+    // locate the records of this chunk
+    std::vector<size_t> starts;
+    while (starts.size() < number_left and (pos_ = Fasta_Parser::skip_blank(data_, size_, pos_)) < size_) {
+      starts.push_back(pos_);
+      pos_ = Fasta_Parser::next_record_start(data_, size_, pos_);
+    }
+
+    // parse them in parallel, in contiguous segments per thread
+    std::vector<Sequence> records(starts.size());
+
+    parallel_for(0, starts.size(), parse_threads_, [&](const size_t i) {
+      std::string label;
+      std::string sequence;
+      parser_.parse(data_, size_, starts[i], label, sequence);
+      records[i] = Sequence(std::move(label), std::move(sequence));
+    });
+
+    result.move_sequences(records.begin(), records.end());
+  }
+
+  num_read_ += result.size();
+
+  return result.size();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <limits>
+
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+#include "io/msa_reader_interface.hpp"
+#include "io/Fasta_Parser.hpp"
+
+/**
+ * Fasta reader working directly on a memory mapping of the query file.
+ *
+ * Record and line boundaries are located with memchr, and every sequence is built
+ * in a single pass from the mapped bytes (see Fasta_Parser). This avoids the
+ * intermediate genesis Sequence objects and the extra subset_sequence copy of
+ * MSA_Stream.
+ *
+ * With more than one parse thread, the records of a chunk are first located (which
+ * is cheap), then parsed in parallel and appended to the chunk in input order, so
+ * sequence ids are the same as with serial parsing.
+ *
+ * Only for uncompressed fasta; the constructor throws otherwise.
+ */
+class Mmap_Fasta_Reader : public msa_reader
+{
+public:
+  Mmap_Fasta_Reader(const std::string& file_name,
+                    const MSA_Info& info,
+                    const bool premasking = true,
+                    const bool split = false,
+                    const size_t parse_threads = 1);
+  ~Mmap_Fasta_Reader();
+
+  Mmap_Fasta_Reader(Mmap_Fasta_Reader const& other) = delete;
+  Mmap_Fasta_Reader& operator= (Mmap_Fasta_Reader const& other) = delete;
+
+  size_t read_next(MSA& result, const size_t number) override;
+  void skip(const size_t n) override;
+  size_t num_sequences() const override { return info_.sequences(); }
+  size_t local_seq_offset() const override { return local_seq_offset_; }
+
+private:
+  void skip_to_sequence(const size_t n);
+
+  MSA_Info info_;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t pos_ = 0;
+
+  Fasta_Parser parser_;
+
+  size_t num_read_ = 0;
+  size_t max_read_ = std::numeric_limits<size_t>::max();
+  size_t local_seq_offset_ = 0;
+  size_t parse_threads_ = 1;
+};
@@ -0,0 +1,240 @@
+#include "io/Output_File.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util/logging.hpp"
+
+// buffers that may wait for the I/O thread before a writer has to wait as well
+constexpr size_t MAX_PENDING_BUFFERS = 4;
+
+constexpr size_t Output_File::DEFAULT_BUFFER_SIZE;
+
+Output_File::Output_File( std::string const& file_path,
+                          size_t const buffer_size,
+                          bool const append )
+  : file_path_(file_path)
+  , buffer_size_(std::max<size_t>(buffer_size, 4096u))
+{
+  fd_ = ::open(file_path.c_str(), O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error{file_path + ": could not open!"};
+  }
+
+  if (append) {
+    const auto end = ::lseek(fd_, 0, SEEK_END);
+    if (end < 0) {
+      ::close(fd_);
+      fd_ = -1;
+      throw std::runtime_error{file_path + ": could not seek to the end!"};
+    }
+    size_ = end;
+  }
+
+  #ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  #endif
+
+  current_.reserve(buffer_size_);
+  // an appended file already holds what is before the first buffer
+  io_thread_ = std::thread(&Output_File::io_loop_, this, size_);
+}
+
+Output_File::~Output_File()
+{
+  try {
+    close();
+  } catch (const std::exception& e) {
+    LOG_ERR << e.what();
+  }
+}
+
+void Output_File::check_error_()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error_) {
+    auto error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void Output_File::write( char const * const data, size_t const size )
+{
+  if (not is_open()) {
+    throw std::runtime_error{file_path_ + ": write after close"};
+  }
+
+  size_t done = 0;
+  while (done < size) {
+    const auto n = std::min(size - done, buffer_size_ - current_.size());
+    current_.append(data + done, n);
+    done += n;
+    if (current_.size() == buffer_size_) {
+      flush();
+    }
+  }
+  size_ += size;
+}
+
+void Output_File::flush()
+{
+  if (current_.empty()) {
+    check_error_();
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]{ return pending_.size() < MAX_PENDING_BUFFERS or error_; });
+  if (error_) {
+    lock.unlock();
+    check_error_();
+  }
+
+  std::string next;
+  if (not spare_.empty()) {
+    next = std::move(spare_.back());
+    spare_.pop_back();
+  }
+  pending_.push_back(std::move(current_));
+  current_ = std::move(next);
+  current_.clear();
+  current_.reserve(buffer_size_);
+
+  lock.unlock();
+  cv_.notify_all();
+}
+
+void Output_File::sync()
+{
+  if (not is_open()) {
+    return;
+  }
+  flush();
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{ return (pending_.empty() and not busy_) or error_; });
+  }
+  check_error_();
+
+  if (fdatasync(fd_) != 0) {
+    throw std::runtime_error{"Failed to sync " + file_path_ + ": " + std::strerror(errno)};
+  }
+}
+
+void Output_File::set_buffer_size( size_t const bytes )
+{
+  flush();
+  buffer_size_ = std::max<size_t>(bytes, 4096u);
+  current_.reserve(buffer_size_);
+}
+
+void Output_File::reserve( size_t const bytes )
+{
+  if (not is_open() or bytes <= reserved_) {
+    return;
+  }
+  #if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  // keeps the visible size, so readers of a growing file never see the reserved space
+  if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, bytes) == 0) {
+    reserved_ = bytes;
+  } else {
+    LOG_DBG << "Could not preallocate " << file_path_ << ": " << std::strerror(errno);
+  }
+  #endif
+}
+
+void Output_File::io_loop_( size_t offset )
+{
+  while (true) {
+    std::string buffer;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]{ return not pending_.empty() or closing_; });
+      if (pending_.empty()) {
+        return;
+      }
+      buffer = std::move(pending_.front());
+      pending_.pop_front();
+      busy_ = true;
+    }
+
+    try {
+      size_t done = 0;
+      while (done < buffer.size()) {
+        const auto n = ::write(fd_, buffer.data() + done, buffer.size() - done);
+        if (n < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::runtime_error{"Failed to write to " + file_path_ + ": " + std::strerror(errno)};
+        }
+        done += n;
+      }
+      #ifdef POSIX_FADV_DONTNEED
+      // start writeback of what is done, and keep it out of the page cache
+      posix_fadvise(fd_, offset, buffer.size(), POSIX_FADV_DONTNEED);
+      #endif
+      offset += buffer.size();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (not error_) {
+        error_ = std::current_exception();
+      }
+      // drop the rest, nothing more can be written
+      pending_.clear();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffer.clear();
+      spare_.push_back(std::move(buffer));
+      busy_ = false;
+    }
+    cv_.notify_all();
+  }
+}
+
+void Output_File::close()
+{
+  if (not is_open()) {
+    return;
+  }
+
+  std::exception_ptr error = nullptr;
+  try {
+    flush();
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+  }
+  cv_.notify_all();
+  io_thread_.join();
+
+  // release whatever was reserved beyond the end
+  if (reserved_ > size_) {
+    if (ftruncate(fd_, size_) != 0) {
+      LOG_DBG << "Could not release the preallocated space of " << file_path_;
+    }
+  }
+  const auto status = ::close(fd_);
+  fd_ = -1;
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  check_error_();
+  if (status != 0) {
+    throw std::runtime_error{"Failed to close " + file_path_ + ": " + std::strerror(errno)};
+  }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+/**
+ * Write-only file with a large user space buffer. Full buffers are written by a
+ * dedicated I/O thread, so callers only block when several buffers are waiting for
+ * slow storage. The file is written sequentially through a plain file descriptor,
+ * with matching posix_fadvise hints, and can be preallocated from a size estimate.
+ */
+class Output_File
+{
+public:
+  static constexpr size_t DEFAULT_BUFFER_SIZE = 8ul * 1024ul * 1024ul;
+
+  /**
+   * Opens the file for writing, truncating it, or, with append set, to continue
+   * after what it already holds.
+   */
+  explicit Output_File( std::string const& file_path,
+                        size_t const buffer_size = DEFAULT_BUFFER_SIZE,
+                        bool const append = false );
+  ~Output_File();
+
+  Output_File(Output_File const& other) = delete;
+  Output_File& operator= (Output_File const& other) = delete;
+
+  void write( char const * const data, size_t const size );
+  void write( std::string const& data ) { write(data.data(), data.size()); }
+
+  /**
+   * Hands what is buffered to the I/O thread, without waiting for it to be written.
+   */
+  void flush();
+
+  /**
+   * Waits until everything written so far is in the file, and asks the system to
+   * commit it to storage. Throws if any write failed.
+   */
+  void sync();
+
+  /**
+   * Size of the buffers handed to the I/O thread from now on.
+   */
+  void set_buffer_size( size_t const bytes );
+
+  /**
+   * Reserves disk space for a file of about this many bytes, without changing its
+   * size. Best effort: nothing happens where this is not supported.
+   */
+  void reserve( size_t const bytes );
+
+  /**
+   * Writes everything out and closes the file. Throws if any write failed.
+   */
+  void close();
+
+  bool is_open() const { return fd_ >= 0; }
+  std::string const& path() const { return file_path_; }
+  // bytes in the file once everything handed to write is out
+  size_t size() const { return size_; }
+
+private:
+  void io_loop_( size_t offset );
+  void check_error_();
+
+  std::string file_path_;
+  int fd_ = -1;
+  size_t buffer_size_;
+  size_t size_ = 0;
+  size_t reserved_ = 0;
+  std::string current_;
+
+  // buffers waiting for the I/O thread, and emptied ones to reuse
+  std::deque<std::string> pending_;
+  std::vector<std::string> spare_;
+  // the I/O thread is writing a buffer it took from pending_
+  bool busy_ = false;
+  bool closing_ = false;
+  std::exception_ptr error_ = nullptr;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread io_thread_;
+};
@@ -0,0 +1,324 @@
+#include "io/Shard_Writer.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "io/jplace_util.hpp"
+#include "util/logging.hpp"
+#include "util/parallel.hpp"
+
+constexpr const char* Shard_Router::UNASSIGNED;
+constexpr size_t Shard_Writer::SHARD_BUFFER_SIZE;
+constexpr const char* Shard_Writer::MANIFEST_HEADER;
+
+Shard_Router Shard_Router::from_regex(std::string const& pattern)
+{
+  Shard_Router router;
+  try {
+    router.regex_ = std::make_unique<std::regex>(pattern, std::regex::ECMAScript | std::regex::optimize);
+  } catch (const std::regex_error& e) {
+    throw std::runtime_error{"Invalid shard regex '" + pattern + "': " + e.what()};
+  }
+  return router;
+}
+
+Shard_Router Shard_Router::from_map_file(std::string const& file_name)
+{
+  std::ifstream in(file_name);
+  if (not in.is_open()) {
+    throw std::runtime_error{file_name + ": could not open!"};
+  }
+
+  Shard_Router router;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line)) {
+    ++line_number;
+    std::istringstream fields(line);
+    std::string name;
+    std::string shard;
+    if (not (fields >> name) or name[0] == '#') {
+      continue;
+    }
+    if (not (fields >> shard)) {
+      throw std::runtime_error{file_name + ":" + std::to_string(line_number) + ": expected <name> <shard>"};
+    }
+    const auto inserted = router.map_.emplace(name, shard);
+    if (not inserted.second and inserted.first->second != shard) {
+      throw std::runtime_error{file_name + ":" + std::to_string(line_number) + ": " + name
+                               + " is mapped to both " + inserted.first->second + " and " + shard};
+    }
+  }
+  return router;
+}
+
+std::string Shard_Router::shard_of(std::string const& name) const
+{
+  if (regex_) {
+    std::smatch match;
+    if (std::regex_search(name, match, *regex_)) {
+      const auto shard = (match.size() > 1 and match[1].matched) ? match[1].str() : match[0].str();
+      if (not shard.empty()) {
+        return shard;
+      }
+    }
+    return UNASSIGNED;
+  }
+
+  const auto iter = map_.find(name);
+  return iter == map_.end() ? UNASSIGNED : iter->second;
+}
+
+/**
+ * The shard name as part of a file name: anything but letters, digits, '.', '-' and '_'
+ * becomes '_'.
+ */
+static std::string file_safe(std::string const& name)
+{
+  std::string result(name);
+  for (auto& c : result) {
+    const bool safe = (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9')
+                      or c == '.' or c == '-' or c == '_';
+    if (not safe) {
+      c = '_';
+    }
+  }
+  return result;
+}
+
+Shard_Writer::Shard_Writer( std::string const& out_dir,
+                            std::string const& file_prefix,
+                            std::string const& tree_string,
+                            std::string const& invocation_string,
+                            rtree_mapper const& mapper,
+                            std::unique_ptr<Shard_Router> router,
+                            Block_Compressor::Format const compression )
+  : out_dir_(out_dir)
+  , file_prefix_(file_prefix)
+  , manifest_path_(out_dir + file_prefix + ".shards.tsv")
+  , tree_string_(tree_string)
+  , invocation_(invocation_string)
+  , mapper_(mapper)
+  , router_(std::move(router))
+  , compression_(compression)
+{
+  // throws early if this build does not support the compression
+  Block_Compressor check(compression_);
+  static_cast<void>(check);
+}
+
+Shard_Writer::~Shard_Writer()
+{
+  // ensure the last write was completed
+  try {
+    wait();
+  } catch (const std::exception& e) {
+    LOG_ERR << "Failed to write the shards: " << e.what();
+  }
+
+  try {
+    finish_();
+  } catch (const std::exception& e) {
+    LOG_ERR << "Failed to complete the shards: " << e.what();
+  }
+}
+
+size_t Shard_Writer::shard_(std::string const& name)
+{
+  const auto iter = index_.find(name);
+  if (iter != index_.end()) {
+    return iter->second;
+  }
+
+  // names that only differ in unsafe characters must not share a file
+  const auto base = file_prefix_ + "." + file_safe(name);
+  const auto extension = ".jplace" + Block_Compressor::extension(compression_);
+  auto file_name = base + extension;
+  for (size_t i = 2; file_names_.count(file_name); ++i) {
+    file_name = base + "_" + std::to_string(i) + extension;
+  }
+  file_names_.insert(file_name);
+
+  shards_.emplace_back();
+  shards_.back().name = name;
+  shards_.back().file_name = file_name;
+  index_[name] = shards_.size() - 1;
+  return shards_.size() - 1;
+}
+
+void Shard_Writer::add_(size_t const shard, PQuery<Placement> pquery, std::vector<size_t>& touched)
+{
+  auto& target = shards_[shard];
+  if (not target.chunk.size()) {
+    touched.push_back(shard);
+  }
+  target.num_pqueries += 1;
+  target.num_names += 1 + pquery.duplicates().size();
+  target.chunk.push_back(std::move(pquery));
+}
+
+void Shard_Writer::route_(PQuery<Placement>& pquery, std::vector<size_t>& touched)
+{
+  const auto& duplicates = pquery.duplicates();
+  std::vector<size_t> targets;
+  targets.reserve(1 + duplicates.size());
+  targets.push_back(shard_(router_->shard_of(pquery.header())));
+  bool split = false;
+  for (auto const& name : duplicates) {
+    targets.push_back(shard_(router_->shard_of(name)));
+    split = split or targets.back() != targets.front();
+  }
+
+  if (not split) {
+    add_(targets.front(), std::move(pquery), touched);
+    return;
+  }
+
+  // identical sequences of different shards: each gets the placements under its own names
+  std::vector<std::string> names(1, pquery.header());
+  names.insert(names.end(), duplicates.begin(), duplicates.end());
+  std::vector<bool> done(names.size(), false);
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (done[i]) {
+      continue;
+    }
+    PQuery<Placement> part(pquery.sequence_id(), names[i]);
+    for (size_t j = i + 1; j < names.size(); ++j) {
+      if (targets[j] == targets[i]) {
+        part.add_duplicate(names[j]);
+        done[j] = true;
+      }
+    }
+    part.append(pquery.begin(), pquery.end());
+    add_(targets[i], std::move(part), touched);
+  }
+}
+
+void Shard_Writer::format_(Shard& shard, size_t const threads) const
+{
+  std::string text;
+  if (shard.first) {
+    std::ostringstream init;
+    init_jplace_string( tree_string_, init );
+    text = init.str();
+  } else {
+    text = ",\n";
+  }
+  sample_to_jplace_buffer( shard.chunk, text, mapper_, precision_, threads );
+
+  shard.buffer.clear();
+  Block_Compressor(compression_, threads).compress(text, shard.buffer);
+}
+
+void Shard_Writer::open_(Shard& shard)
+{
+  shard.last_use = ++num_uses_;
+  if (shard.file) {
+    return;
+  }
+
+  if (num_open_ >= max_open_) {
+    // make room by closing the least recently used
+    Shard* oldest = nullptr;
+    for (auto& other : shards_) {
+      if (other.file and (not oldest or other.last_use < oldest->last_use)) {
+        oldest = &other;
+      }
+    }
+    close_(*oldest);
+  }
+
+  // the first time truncating the file, later continuing it
+  shard.file = std::make_unique<Output_File>(out_dir_ + shard.file_name, SHARD_BUFFER_SIZE, shard.created);
+  shard.created = true;
+  ++num_open_;
+}
+
+void Shard_Writer::close_(Shard& shard)
+{
+  if (shard.file) {
+    auto file = std::move(shard.file);
+    --num_open_;
+    file->close();
+  }
+}
+
+void Shard_Writer::write_(Sample<>& chunk)
+{
+  // the shards with pquerys in this chunk, in order of appearance
+  std::vector<size_t> touched;
+  if (router_) {
+    for (auto& pquery : chunk) {
+      route_(pquery, touched);
+    }
+  } else if (chunk.size()) {
+    const auto shard = shard_(std::to_string(num_chunks_));
+    shards_[shard].num_pqueries += chunk.size();
+    for (auto const& pquery : chunk) {
+      shards_[shard].num_names += 1 + pquery.duplicates().size();
+    }
+    std::swap(shards_[shard].chunk, chunk);
+    touched.push_back(shard);
+  }
+  ++num_chunks_;
+  if (touched.empty()) {
+    return;
+  }
+
+  // format the shards in parallel, or a single one with all threads
+  size_t threads = threads_;
+  #ifdef __OMP
+  if (not threads) {
+    threads = omp_get_max_threads();
+  }
+  #endif
+  threads = std::max<size_t>(threads, 1u);
+  const size_t shard_threads = touched.size() == 1 ? threads : 1u;
+
+  parallel_for(0, touched.size(), std::min(threads, touched.size()), [&](const size_t i) {
+    format_(shards_[touched[i]], shard_threads);
+  }, Schedule::kDynamic);
+
+  // hand them to their files, to be written in the background
+  for (auto const i : touched) {
+    auto& shard = shards_[i];
+    open_(shard);
+    shard.file->write(shard.buffer);
+    shard.file->flush();
+    shard.first = false;
+    shard.chunk = Sample<>();
+  }
+}
+
+void Shard_Writer::finish_()
+{
+  std::ostringstream trailing;
+  finalize_jplace_string( invocation_, trailing );
+  Block_Compressor compressor(compression_);
+  std::string trailer;
+  compressor.compress(trailing.str(), trailer);
+  trailer.append(compressor.finish());
+
+  std::ofstream manifest(manifest_path_, std::ios::binary | std::ios::trunc);
+  if (not manifest.is_open()) {
+    throw std::runtime_error{manifest_path_ + ": could not open!"};
+  }
+  manifest << MANIFEST_HEADER;
+
+  for (auto& shard : shards_) {
+    open_(shard);
+    shard.file->write(trailer);
+    close_(shard);
+    manifest << shard.name << "\t" << shard.file_name << "\t"
+             << shard.num_pqueries << "\t" << shard.num_names << "\n";
+  }
+
+  if (not manifest) {
+    throw std::runtime_error{"Failed to write to " + manifest_path_};
+  }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <regex>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+#include "sample/Sample.hpp"
+#include "core/pll/rtree_mapper.hpp"
+#include "io/Block_Compressor.hpp"
+#include "io/Output_File.hpp"
+#include "io/placement_writer_interface.hpp"
+
+/**
+ * Assigns query names to shards, such as the samples combined in one query file: either
+ * by a regex, taking its first capture group (or the whole match, if it has none), or by
+ * a mapping file of lines <name> <shard>. Names without a shard go to UNASSIGNED.
+ */
+class Shard_Router
+{
+public:
+  static constexpr const char* UNASSIGNED = "unassigned";
+
+  static Shard_Router from_regex(std::string const& pattern);
+  static Shard_Router from_map_file(std::string const& file_name);
+
+  std::string shard_of(std::string const& name) const;
+
+private:
+  Shard_Router() = default;
+
+  std::unique_ptr<std::regex> regex_;
+  std::unordered_map<std::string, std::string> map_;
+};
+
+/**
+ * Writes the placements to several jplace files, each with the full tree: one per shard
+ * of query names (see Shard_Router), or, without a router, one per written chunk.
+ *
+ * The shards of a chunk are formatted (and compressed) in parallel, then handed to their
+ * files, each written by an Output_File with an I/O thread of its own. Only so many files
+ * are kept open: the least recently used is closed, and appended to when it gets more.
+ *
+ * When done, the shards are listed in a tab separated manifest next to them: the shard,
+ * its file, and the number of pqueries and query names in it.
+ */
+class Shard_Writer : public async_placement_writer
+{
+public:
+  static constexpr size_t DEFAULT_MAX_OPEN = 64;
+  static constexpr size_t SHARD_BUFFER_SIZE = 1024ul * 1024ul;
+  static constexpr const char* MANIFEST_HEADER = "shard\tfile\tpqueries\tnames\n";
+
+  /**
+   * Shards are named <file_prefix>.<shard>.jplace (plus the extension of the compression)
+   * in out_dir, and the manifest <file_prefix>.shards.tsv.
+   */
+  Shard_Writer( std::string const& out_dir,
+                std::string const& file_prefix,
+                std::string const& tree_string,
+                std::string const& invocation_string,
+                rtree_mapper const& mapper,
+                std::unique_ptr<Shard_Router> router,
+                Block_Compressor::Format const compression = Block_Compressor::Format::kNone );
+  ~Shard_Writer() override;
+
+  Shard_Writer(Shard_Writer const& other) = delete;
+  Shard_Writer& operator= (Shard_Writer const& other) = delete;
+
+  Shard_Writer& set_precision( unsigned int const n ) { precision_ = n; return *this; }
+  /**
+   * Number of threads formatting the shards, 0 for as many as OpenMP would use.
+   */
+  Shard_Writer& set_threads( size_t const n ) { threads_ = n; return *this; }
+  /**
+   * Number of shard files kept open at most.
+   */
+  Shard_Writer& set_max_open( size_t const n ) { max_open_ = std::max<size_t>(n, 1u); return *this; }
+
+  std::string const& manifest_path() const { return manifest_path_; }
+
+private:
+  struct Shard
+  {
+    std::string name;
+    std::string file_name;
+    // pquerys of the chunk being written, and their text
+    Sample<> chunk;
+    std::string buffer;
+    std::unique_ptr<Output_File> file;
+    bool created = false;
+    bool first = true;
+    size_t last_use = 0;
+    size_t num_pqueries = 0;
+    size_t num_names = 0;
+  };
+
+  void write_(Sample<>& chunk) override;
+  size_t shard_(std::string const& name);
+  void route_(PQuery<Placement>& pquery, std::vector<size_t>& touched);
+  void add_(size_t const shard, PQuery<Placement> pquery, std::vector<size_t>& touched);
+  void format_(Shard& shard, size_t const threads) const;
+  void open_(Shard& shard);
+  void close_(Shard& shard);
+  void finish_();
+
+  std::string out_dir_;
+  std::string file_prefix_;
+  std::string manifest_path_;
+  std::string tree_string_;
+  std::string invocation_;
+  rtree_mapper const mapper_;
+  std::unique_ptr<Shard_Router> router_;
+  Block_Compressor::Format const compression_;
+  unsigned int precision_ = 6;
+  size_t threads_ = 1;
+  size_t max_open_ = DEFAULT_MAX_OPEN;
+
+  std::vector<Shard> shards_;
+  std::unordered_map<std::string, size_t> index_;
+  std::unordered_set<std::string> file_names_;
+  size_t num_open_ = 0;
+  size_t num_uses_ = 0;
+  size_t num_chunks_ = 0;
+};
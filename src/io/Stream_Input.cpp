@@ -0,0 +1,174 @@
+#include "io/Stream_Input.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool is_stream_input(const std::string& file_name)
+{
+  if (file_name == "-") {
+    return true;
+  }
+  struct stat st;
+  if (stat(file_name.c_str(), &st) != 0) {
+    return false;
+  }
+  return S_ISFIFO(st.st_mode) or S_ISCHR(st.st_mode) or S_ISSOCK(st.st_mode);
+}
+
+Stream_Input& Stream_Input::get(const std::string& file_name)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<Stream_Input>> inputs;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& input = inputs[file_name];
+  if (not input) {
+    input.reset(new Stream_Input(file_name));
+  }
+  return *input;
+}
+
+static int open_input(const std::string& file_name)
+{
+  if (file_name == "-") {
+    return STDIN_FILENO;
+  }
+  const auto fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error{"Cannot open file: " + file_name};
+  }
+  return fd;
+}
+
+Stream_Input::Stream_Input(const std::string& file_name)
+  : file_name_(file_name)
+  , fd_(open_input(file_name))
+  , buffer_(fd_, file_name)
+  , stream_(&buffer_)
+{
+  // a failed read surfaces as the error thrown by the buffer, not just a bad stream
+  stream_.exceptions(std::ios::badbit);
+}
+
+Stream_Input::~Stream_Input()
+{
+  if (fd_ > STDIN_FILENO) {
+    close(fd_);
+  }
+}
+
+Stream_Input::Replay_Buffer::int_type Stream_Input::Replay_Buffer::underflow()
+{
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  if (not prefix_done_) {
+    prefix_done_ = true;
+    if (not prefix.empty()) {
+      setg(&prefix[0], &prefix[0], &prefix[0] + prefix.size());
+      return traits_type::to_int_type(*gptr());
+    }
+  }
+
+  ssize_t n = 0;
+  do {
+    n = read(fd_, buffer_.data(), buffer_.size());
+  } while (n < 0 and errno == EINTR);
+
+  if (n < 0) {
+    throw std::runtime_error{"Failed to read from " + file_name_ + ": " + std::strerror(errno)};
+  }
+  if (n == 0) {
+    return traits_type::eof();
+  }
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+  return traits_type::to_int_type(*gptr());
+}
+
+bool Stream_Input::read_ahead_()
+{
+  if (eof_) {
+    return false;
+  }
+  char chunk[1u << 16];
+  ssize_t n = 0;
+  do {
+    n = read(fd_, chunk, sizeof(chunk));
+  } while (n < 0 and errno == EINTR);
+
+  if (n < 0) {
+    throw std::runtime_error{"Failed to read from " + file_name_ + ": " + std::strerror(errno)};
+  }
+  if (n == 0) {
+    eof_ = true;
+    return false;
+  }
+  buffer_.prefix.append(chunk, n);
+  return true;
+}
+
+size_t Stream_Input::first_sequence_length()
+{
+  if (not peeked_) {
+    sites_ = peek_sites_();
+    peeked_ = true;
+  }
+  return sites_;
+}
+
+size_t Stream_Input::peek_sites_()
+{
+  auto& data = buffer_.prefix;
+  size_t pos = 0;
+
+  // skip to the first header
+  while (true) {
+    while (pos < data.size() and std::isspace(static_cast<unsigned char>(data[pos]))) {
+      ++pos;
+    }
+    if (pos < data.size() or not read_ahead_()) {
+      break;
+    }
+  }
+  if (pos >= data.size() or data[pos] != '>') {
+    throw std::runtime_error{"Input does not start with a fasta header: " + file_name_};
+  }
+
+  // skip the header line
+  size_t newline = std::string::npos;
+  while ((newline = data.find('\n', pos)) == std::string::npos) {
+    if (not read_ahead_()) {
+      throw std::runtime_error{"Cannot read first sequence of: " + file_name_};
+    }
+  }
+  pos = newline + 1;
+
+  // count the sites up to the next header, or the end of the input
+  size_t sites = 0;
+  bool line_start = true;
+  while (true) {
+    for (; pos < data.size(); ++pos) {
+      const auto c = data[pos];
+      if (line_start and c == '>') {
+        return sites;
+      }
+      line_start = (c == '\n');
+      if (not std::isspace(static_cast<unsigned char>(c))) {
+        ++sites;
+      }
+    }
+    if (not read_ahead_()) {
+      return sites;
+    }
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+/**
+ * True for "-" (stdin) and for files that can only be read once, front to back,
+ * such as named pipes.
+ */
+bool is_stream_input(const std::string& file_name);
+
+/**
+ * A query fasta that arrives through stdin or a named pipe.
+ *
+ * As the input can not be rewound, the alignment width is taken by peeking at the
+ * first record, whose bytes are kept and handed out again in front of the rest of
+ * the input by stream(). There is one instance per input, opened on first use.
+ */
+class Stream_Input
+{
+public:
+  static Stream_Input& get(const std::string& file_name);
+
+  ~Stream_Input();
+
+  Stream_Input(Stream_Input const& other) = delete;
+  Stream_Input& operator= (Stream_Input const& other) = delete;
+
+  /**
+   * Number of sites of the first sequence. Must be called before reading from stream().
+   */
+  size_t first_sequence_length();
+
+  std::istream& stream() { return stream_; }
+
+private:
+  class Replay_Buffer : public std::streambuf
+  {
+  public:
+    Replay_Buffer(const int fd, std::string const& file_name)
+      : fd_(fd), file_name_(file_name), buffer_(1u << 16) {}
+
+    // bytes that were read ahead, to be handed out before anything else
+    std::string prefix;
+
+  protected:
+    int_type underflow() override;
+
+  private:
+    int fd_;
+    std::string file_name_;
+    bool prefix_done_ = false;
+    std::vector<char> buffer_;
+  };
+
+  explicit Stream_Input(const std::string& file_name);
+
+  // reads more of the input into the replay prefix, returns false at the end
+  bool read_ahead_();
+  size_t peek_sites_();
+
+  std::string file_name_;
+  int fd_ = -1;
+  Replay_Buffer buffer_;
+  std::istream stream_;
+  bool eof_ = false;
+  bool peeked_ = false;
+  size_t sites_ = 0;
+};
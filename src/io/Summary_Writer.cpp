@@ -0,0 +1,173 @@
+#include "io/Summary_Writer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "io/jplace_util.hpp"
+#include "util/logging.hpp"
+#include "util/parallel.hpp"
+
+constexpr size_t SUMMARY_MIN_PQUERIES_PER_THREAD = 256;
+
+double edpl( PQuery<Placement> const& pquery, Branch_Distances const& distances )
+{
+  double result = 0.0;
+  for (size_t i = 0; i < pquery.size(); ++i) {
+    const auto& a = pquery.at(i);
+    for (size_t j = i + 1; j < pquery.size(); ++j) {
+      const auto& b = pquery.at(j);
+      result += a.lwr() * b.lwr() * distances.distance( a.branch_id(), a.distal_length(),
+                                                        b.branch_id(), b.distal_length() );
+    }
+  }
+  // every pair counts in both orders
+  return 2.0 * result;
+}
+
+static void pquery_range_to_summary_buffer( Sample<Placement> const& sample,
+                                            size_t const begin,
+                                            size_t const end,
+                                            std::string& buffer,
+                                            Branch_Distances const& distances,
+                                            rtree_mapper const& mapper,
+                                            unsigned int const precision )
+{
+  std::string fields;
+  for (size_t i = begin; i < end; ++i) {
+    const auto& pquery = sample.at(i);
+    if (not pquery.size()) {
+      continue;
+    }
+
+    const auto best = std::max_element( pquery.begin(), pquery.end(),
+                                        [](const Placement& a, const Placement& b) {
+                                          return a.lwr() < b.lwr();
+                                        });
+
+    auto branch_id = best->branch_id();
+    auto distal_length = best->distal_length();
+    if ( mapper ) {
+      std::tie(branch_id, distal_length) = mapper.in_rtree(branch_id, distal_length);
+    }
+
+    // the same for all names of the pquery
+    fields.clear();
+    fields.push_back('\t');
+    fields.append(std::to_string(branch_id));
+    fields.push_back('\t');
+    append_fixed(fields, best->lwr(), precision);
+    fields.push_back('\t');
+    append_fixed(fields, best->likelihood(), precision);
+    fields.push_back('\t');
+    append_fixed(fields, distal_length, precision);
+    fields.push_back('\t');
+    append_fixed(fields, best->pendant_length(), precision);
+    fields.push_back('\t');
+    append_fixed(fields, edpl(pquery, distances), precision);
+    fields.push_back('\n');
+
+    buffer.append(pquery.header());
+    buffer.append(fields);
+    for (const auto& name : pquery.duplicates()) {
+      buffer.append(name);
+      buffer.append(fields);
+    }
+  }
+}
+
+void sample_to_summary_buffer( Sample<Placement> const& sample,
+                               std::string& buffer,
+                               Branch_Distances const& distances,
+                               rtree_mapper const& mapper,
+                               unsigned int const precision,
+                               size_t num_threads )
+{
+  const size_t size = sample.size();
+
+  #ifdef __OMP
+  if (not num_threads) {
+    num_threads = omp_get_max_threads();
+  }
+  #else
+  num_threads = 1;
+  #endif
+  // not worth a thread team for small chunks
+  num_threads = std::min(num_threads, size / SUMMARY_MIN_PQUERIES_PER_THREAD);
+
+  if (num_threads <= 1) {
+    pquery_range_to_summary_buffer(sample, 0, size, buffer, distances, mapper, precision);
+    return;
+  }
+
+  // contiguous ranges of pqueries into per-thread buffers, concatenated in order
+  std::vector<std::string> parts(num_threads);
+
+  parallel_for(0, num_threads, num_threads, [&](const size_t t) {
+    pquery_range_to_summary_buffer( sample,
+                                    t * size / num_threads,
+                                    (t + 1) * size / num_threads,
+                                    parts[t],
+                                    distances,
+                                    mapper,
+                                    precision );
+  });
+
+  for (const auto& part : parts) {
+    buffer.append(part);
+  }
+}
+
+Summary_Writer::Summary_Writer( const std::string& out_dir,
+                                const std::string& file_name,
+                                Branch_Distances distances,
+                                rtree_mapper const& mapper,
+                                unsigned int const precision,
+                                size_t const num_threads,
+                                bool const append )
+  : file_path_(out_dir + file_name)
+  , distances_(std::move(distances))
+  , mapper_(mapper)
+  , precision_(precision)
+  , num_threads_(num_threads)
+{
+  file_ = std::make_unique<Output_File>(file_path_, Output_File::DEFAULT_BUFFER_SIZE, append);
+  if (file_->size() == 0) {
+    file_->write(HEADER);
+  }
+}
+
+Summary_Writer::~Summary_Writer()
+{
+  // ensure the last write was completed
+  try {
+    wait();
+  } catch (const std::exception& e) {
+    LOG_ERR << "Failed to write " << file_path_ << ": " << e.what();
+  }
+  try {
+    file_->close();
+  } catch (const std::exception& e) {
+    LOG_ERR << e.what();
+  }
+}
+
+void Summary_Writer::write_(Sample<>& chunk)
+{
+  buffer_.clear();
+  sample_to_summary_buffer(chunk, buffer_, distances_, mapper_, precision_, num_threads_);
+  file_->write(buffer_);
+  file_->flush();
+}
+
+void Summary_Writer::sync(std::vector<File_State>& states)
+{
+  wait();
+  file_->sync();
+  states.push_back({file_path_, file_->size()});
+}
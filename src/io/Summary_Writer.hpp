@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include "sample/Sample.hpp"
+#include "core/pll/rtree_mapper.hpp"
+#include "tree/Branch_Distances.hpp"
+#include "io/placement_writer_interface.hpp"
+#include "io/Output_File.hpp"
+
+/**
+ * Expected distance between placement locations of a pquery: the sum over all (ordered)
+ * pairs of its placements of the product of their LWRs and the path length between them.
+ */
+double edpl( PQuery<Placement> const& pquery, Branch_Distances const& distances );
+
+/**
+ * Appends one tab separated line per query name (including deduplicated ones) to buffer:
+ * the name, the edge, LWR, likelihood, distal and pendant length of its best placement,
+ * and its EDPL. Large samples are processed on num_threads threads (0: as many as OpenMP
+ * would use).
+ */
+void sample_to_summary_buffer( Sample<Placement> const& sample,
+                               std::string& buffer,
+                               Branch_Distances const& distances,
+                               rtree_mapper const& mapper,
+                               unsigned int const precision,
+                               size_t num_threads = 1 );
+
+/**
+ * Writes the per-query summary of each chunk to a TSV file, next to the placement output.
+ * With append set, an existing file is continued (and only gets a header if empty).
+ */
+class Summary_Writer : public async_placement_writer
+{
+public:
+  static constexpr const char* HEADER =
+    "name\tedge_num\tlike_weight_ratio\tlikelihood\tdistal_length\tpendant_length\tedpl\n";
+
+  Summary_Writer( const std::string& out_dir,
+                  const std::string& file_name,
+                  Branch_Distances distances,
+                  rtree_mapper const& mapper,
+                  unsigned int const precision,
+                  size_t const num_threads = 1,
+                  bool const append = false );
+  ~Summary_Writer() override;
+
+  void sync(std::vector<File_State>& states) override;
+
+private:
+  void write_(Sample<>& chunk) override;
+
+  std::unique_ptr<Output_File> file_;
+  std::string file_path_;
+  Branch_Distances const distances_;
+  rtree_mapper const mapper_;
+  unsigned int const precision_;
+  size_t const num_threads_;
+  // text of the chunk being written, kept to reuse its allocation
+  std::string buffer_;
+};
@@ -2,6 +2,26 @@
 
 #include <sstream>
 #include <tuple>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "util/parallel.hpp"
+
+static constexpr uint64_t POW10[] = {
+  1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+  1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+  100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull
+};
+constexpr unsigned int MAX_FAST_PRECISION = 17;
+// fewest pqueries per thread for which serialization is split among threads
+constexpr size_t JPLACE_MIN_PQUERIES_PER_THREAD = 256;
 
 void merge_into(std::ofstream& dest, const std::vector<std::string>& sources)
 {
@@ -36,6 +56,259 @@ void placement_to_jplace_string(Placement const& p,
   os << p.pendant_length() << "]";
 }
 
+static void append_uint(std::string& buffer, uint64_t value, const size_t min_digits = 1)
+{
+  char digits[24];
+  size_t n = 0;
+  do {
+    digits[n++] = '0' + (value % 10u);
+    value /= 10u;
+  } while (value);
+  while (n < min_digits) {
+    digits[n++] = '0';
+  }
+  while (n) {
+    buffer.push_back(digits[--n]);
+  }
+}
+
+static void append_printf_fixed(std::string& buffer, const double value, const unsigned int precision)
+{
+  char small[64];
+  const auto len = std::snprintf(small, sizeof(small), "%.*f", precision, value);
+  if (len < static_cast<int>(sizeof(small))) {
+    buffer.append(small, len);
+  } else {
+    std::string large(len + 1, '\0');
+    std::snprintf(&large[0], large.size(), "%.*f", precision, value);
+    buffer.append(large.data(), len);
+  }
+}
+
+/**
+ * Formats the value like printf("%.*f") (and thus like an ostream set to std::fixed)
+ * does: the exact binary value rounded to precision digits, ties to even. Values that
+ * do not fit the 128 bit fast path (large magnitudes, inf, nan, high precisions) are
+ * passed on to snprintf.
+ */
+void append_fixed(std::string& buffer, const double value, const unsigned int precision)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const bool negative = bits >> 63u;
+  const unsigned biased_exponent = (bits >> 52u) & 0x7ffu;
+  uint64_t mantissa = bits & ((1ull << 52u) - 1u);
+
+  if (biased_exponent == 0x7ffu or precision > MAX_FAST_PRECISION) {
+    append_printf_fixed(buffer, value, precision);
+    return;
+  }
+
+  // value = mantissa * 2^exponent
+  int exponent = -1074;
+  if (biased_exponent) {
+    mantissa |= (1ull << 52u);
+    exponent = static_cast<int>(biased_exponent) - 1075;
+  }
+
+  uint64_t integer_part = 0;
+  uint64_t fraction_part = 0;
+  if (exponent >= 0) {
+    if (exponent > 10) {
+      append_printf_fixed(buffer, value, precision);
+      return;
+    }
+    integer_part = mantissa << exponent;
+  } else {
+    // value * 10^precision, rounded to an integer; this product needs at most 110 bits
+    const unsigned shift = -exponent;
+    const auto scaled = static_cast<unsigned __int128>(mantissa) * POW10[precision];
+    unsigned __int128 rounded = 0;
+    if (shift < 128u) {
+      rounded = scaled >> shift;
+      const auto remainder = scaled - (rounded << shift);
+      const auto half = static_cast<unsigned __int128>(1u) << (shift - 1u);
+      if (remainder > half or (remainder == half and (rounded & 1u))) {
+        ++rounded;
+      }
+    }
+    const auto integer = rounded / POW10[precision];
+    if (integer > std::numeric_limits<uint64_t>::max()) {
+      append_printf_fixed(buffer, value, precision);
+      return;
+    }
+    integer_part = static_cast<uint64_t>(integer);
+    fraction_part = static_cast<uint64_t>(rounded % POW10[precision]);
+  }
+
+  if (negative) {
+    buffer.push_back('-');
+  }
+  append_uint(buffer, integer_part);
+  if (precision) {
+    buffer.push_back('.');
+    append_uint(buffer, fraction_part, precision);
+  }
+}
+
+std::string escape_json(std::string const& s)
+{
+  const auto needs_escape = [](const char c){
+    return c == '"' or c == '\\' or static_cast<unsigned char>(c) < 0x20;
+  };
+  if (std::none_of(s.begin(), s.end(), needs_escape)) {
+    return s;
+  }
+
+  std::string result;
+  result.reserve(s.size() + 8);
+  for (const auto c : s) {
+    if (c == '"' or c == '\\') {
+      result.push_back('\\');
+      result.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char code[8];
+      std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+      result.append(code);
+    } else {
+      result.push_back(c);
+    }
+  }
+  return result;
+}
+
+void placement_to_jplace_buffer(Placement const& p,
+                                std::string& buffer,
+                                rtree_mapper const& mapper,
+                                unsigned int const precision)
+{
+  auto branch_id = p.branch_id();
+  auto distal_length = p.distal_length();
+  if ( mapper ) {
+    std::tie(branch_id, distal_length) = mapper.in_rtree(branch_id, distal_length);
+  }
+
+  buffer.push_back('[');
+  append_uint(buffer, branch_id);
+  buffer.append(", ");
+  append_fixed(buffer, p.likelihood(), precision);
+  buffer.append(", ");
+  append_fixed(buffer, p.lwr(), precision);
+  buffer.append(", ");
+  append_fixed(buffer, distal_length, precision);
+  buffer.append(", ");
+  append_fixed(buffer, p.pendant_length(), precision);
+  buffer.push_back(']');
+}
+
+static void append_name(std::string& buffer, std::string const& name)
+{
+  buffer.push_back('"');
+  buffer.append(escape_json(name));
+  buffer.push_back('"');
+}
+
+void pquery_to_jplace_buffer( PQuery<Placement> const& pquery,
+                              std::string& buffer,
+                              rtree_mapper const& mapper,
+                              unsigned int const precision)
+{
+  buffer.append("    {\"p\": [\n");
+
+  size_t i = 0;
+  for (const auto& place : pquery) {
+    buffer.append("      ");
+    placement_to_jplace_buffer(place, buffer, mapper, precision);
+    if (++i < pquery.size()) {
+      buffer.push_back(',');
+    }
+    buffer.push_back(NEWL);
+  }
+
+  buffer.append("      ],\n");
+  buffer.append("    \"n\": [");
+  append_name(buffer, pquery.header());
+  for (const auto& duplicate : pquery.duplicates()) {
+    buffer.append(", ");
+    append_name(buffer, duplicate);
+  }
+  buffer.append("]\n");
+  buffer.append("    }");
+}
+
+/**
+ * Formats the pqueries [begin, end) of the sample, with the separators they would
+ * have as part of the whole sample.
+ */
+static void pquery_range_to_jplace_buffer(Sample<Placement> const& sample,
+                                          size_t const begin,
+                                          size_t const end,
+                                          std::string& buffer,
+                                          rtree_mapper const& mapper,
+                                          unsigned int const precision)
+{
+  // rough estimate, so that the buffer is allocated (about) once
+  size_t estimate = 0;
+  for (size_t i = begin; i < end; ++i) {
+    const auto& p = sample.at(i);
+    estimate += 48 + p.header().size() + p.size() * (40 + 4 * (precision + 8));
+  }
+  buffer.reserve(buffer.size() + estimate);
+
+  for (size_t i = begin; i < end; ++i) {
+    pquery_to_jplace_buffer(sample.at(i), buffer, mapper, precision);
+    if (i + 1 < sample.size()) {
+      buffer.push_back(',');
+    }
+    buffer.push_back(NEWL);
+  }
+}
+
+void sample_to_jplace_buffer( Sample<Placement> const& sample,
+                              std::string& buffer,
+                              rtree_mapper const& mapper,
+                              unsigned int const precision,
+                              size_t num_threads)
+{
+  const size_t size = sample.size();
+
+  #ifdef __OMP
+  if (not num_threads) {
+    num_threads = omp_get_max_threads();
+  }
+  #else
+  num_threads = 1;
+  #endif
+  // not worth a thread team for small chunks
+  num_threads = std::min(num_threads, size / JPLACE_MIN_PQUERIES_PER_THREAD);
+
+  if (num_threads <= 1) {
+    pquery_range_to_jplace_buffer(sample, 0, size, buffer, mapper, precision);
+    return;
+  }
+
+  // contiguous ranges of pqueries into per-thread buffers, concatenated in order
+  std::vector<std::string> parts(num_threads);
+
+  parallel_for(0, num_threads, num_threads, [&](const size_t t) {
+    pquery_range_to_jplace_buffer(sample,
+                                  t * size / num_threads,
+                                  (t + 1) * size / num_threads,
+                                  parts[t],
+                                  mapper,
+                                  precision);
+  });
+
+  size_t total = buffer.size();
+  for (const auto& part : parts) {
+    total += part.size();
+  }
+  buffer.reserve(total);
+  for (const auto& part : parts) {
+    buffer.append(part);
+  }
+}
+
 void pquery_to_jplace_string( PQuery<Placement> const& pquery,
                               std::ostream& os,
                               rtree_mapper const& mapper)
@@ -64,8 +337,12 @@ void pquery_to_jplace_string( PQuery<Placement> const& pquery,
 
   // sequence header
   const auto& header = pquery.header();
-  os << "\"" << header.c_str() << "\"";
+  os << "\"" << escape_json(header) << "\"";
 
+  // headers of identical sequences, if deduplicated
+  for (const auto& duplicate : pquery.duplicates()) {
+    os << ", \"" << escape_json(duplicate) << "\"";
+  }
 
   os << "]" << NEWL; // close name bracket
 
@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <vector>
+#include <string>
 
 #include "util/stringify.hpp"
 #include "sample/PQuery.hpp"
@@ -16,6 +17,29 @@ void placement_to_jplace_string( Placement const& p, std::ostream& os, rtree_map
 std::string full_jplace_string( Sample<Placement> const& sample,
                                 std::string const& invocation,
                                 rtree_mapper const& mapper );
+
+/**
+ * Buffer based variants of the above: the text is appended to buffer, with numbers
+ * formatted like an ostream in std::fixed notation at the given precision would, but
+ * without the per-number overhead of the stream. The pqueries of large samples are
+ * formatted on num_threads threads (0: as many as OpenMP would use).
+ */
+void sample_to_jplace_buffer( Sample<Placement> const& sample,
+                              std::string& buffer,
+                              rtree_mapper const& mapper,
+                              unsigned int const precision,
+                              size_t num_threads = 1 );
+void pquery_to_jplace_buffer( PQuery<Placement> const& p,
+                              std::string& buffer,
+                              rtree_mapper const& mapper,
+                              unsigned int const precision );
+void placement_to_jplace_buffer( Placement const& p,
+                                 std::string& buffer,
+                                 rtree_mapper const& mapper,
+                                 unsigned int const precision );
+void append_fixed( std::string& buffer, double const value, unsigned int const precision );
+std::string escape_json( std::string const& s );
+
 void init_jplace_string( std::string const& numbered_newick, std::ostream& os );
 void finalize_jplace_string( std::string const& invocation, std::ostream& os );
 void merge_into( std::ofstream& dest, std::vector<std::string> const& sources );
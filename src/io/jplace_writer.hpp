@@ -1,22 +1,26 @@
 #pragma once
 
 #include <string>
-#include <future>
 #include <memory>
 #include <sstream>
 #include <cassert>
 #include <iomanip>
+#include <fstream>
+#include <cstdio>
 
 #include "sample/Sample.hpp"
 #include "util/logging.hpp"
 #include "io/jplace_util.hpp"
+#include "io/Block_Compressor.hpp"
+#include "io/Output_File.hpp"
+#include "io/placement_writer_interface.hpp"
 #include "core/pll/rtree_mapper.hpp"
 
 #ifdef __MPI
 #include "net/epa_mpi_util.hpp"
 #endif
 
-class jplace_writer
+class jplace_writer : public async_placement_writer
 {
 public:
   jplace_writer() = default;
@@ -24,16 +28,24 @@ public:
                 const std::string& file_name,
                 const std::string& tree_string,
                 const std::string& invocation_string,
-                rtree_mapper const& mapper)
+                rtree_mapper const& mapper,
+                Block_Compressor::Format const compression = Block_Compressor::Format::kNone,
+                bool const rank_files = false,
+                bool const append = false)
     : tree_string_(tree_string)
     , invocation_(invocation_string)
     , mapper_(mapper)
+    , rank_files_(rank_files)
+    , append_(append)
   {
+    if (compression != Block_Compressor::Format::kNone) {
+      compressor_ = std::make_unique<Block_Compressor>(compression, threads_);
+    }
     init_mpi_();
-    init_file_(out_dir, file_name);
+    init_file_(out_dir, file_name + Block_Compressor::extension(compression));
   }
 
-  ~jplace_writer()
+  ~jplace_writer() override
   {
     // ensure last write/gather was completed
     wait();
@@ -41,90 +53,124 @@ public:
     // finalize and close
     #ifdef __MPI
 
-    if (local_rank_ == 0) {
-      std::stringstream trailing;
-      trailing.precision( precision_ );
-      trailing.setf( std::ios::fixed, std:: ios::floatfield );
-      finalize_jplace_string( invocation_, trailing );
-      MPI_File_seek(shared_file_, 0, MPI_SEEK_END);
-      MPI_File_write(shared_file_, trailing.str().c_str(), trailing.str().size(),
-                      MPI_CHAR, MPI_STATUS_IGNORE);
+    if (rank_file_) {
+      try {
+        rank_file_->close();
+      } catch (const std::exception& e) {
+        LOG_ERR << e.what();
+      }
+      // all parts have to be complete before they can be merged
+      MPI_BARRIER(MPI_COMM_WORLD);
+      if (local_rank_ == 0) {
+        try {
+          merge_rank_files_();
+        } catch (const std::exception& e) {
+          LOG_ERR << "Failed to merge the per-rank results: " << e.what();
+        }
+      }
+    } else {
+      if (local_rank_ == 0) {
+        const auto& trailing = trailer_();
+        MPI_File_seek(shared_file_, 0, MPI_SEEK_END);
+        MPI_File_write(shared_file_, trailing.c_str(), trailing.size(),
+                        MPI_CHAR, MPI_STATUS_IGNORE);
+      }
+      MPI_File_close(&shared_file_);
     }
-    MPI_File_close(&shared_file_);
 
     #else
 
     if (file_) {
-      finalize_jplace_string(invocation_, *file_);
-      file_->close();
+      try {
+        file_->write(trailer_());
+        file_->close();
+      } catch (const std::exception& e) {
+        LOG_ERR << e.what();
+      }
     }
 
     #endif
   }
 
-  void write( Sample<>& chunk )
+  /**
+   * Syncs the output to storage. Under MPI, this is the part of this rank, and only
+   * possible when writing rank files.
+   */
+  void sync(std::vector<File_State>& states) override
   {
-    #ifdef __PREFETCH
-    // ensure the last write has finished
-    if (prev_gather_.valid()) {
-      prev_gather_.get();
+    wait();
+    auto file = output_file_();
+    if (not file) {
+      throw std::runtime_error{"Checkpointing the jplace output under MPI requires rank files"};
     }
-    prev_gather_ = std::async(std::launch::async,
-      [chunk = chunk, this]() mutable {
-        this->write_(chunk);
-      });
-    #else
-    write_(chunk);
-    #endif
+    file->sync();
+    states.push_back({file->path(), file->size()});
   }
 
-  void wait()
+  /**
+   * Number of threads formatting each chunk, 0 for as many as OpenMP would use.
+   */
+  jplace_writer& set_threads( size_t n )
   {
-    #ifdef __PREFETCH
-    if (prev_gather_.valid()) {
-      prev_gather_.get();
+    threads_ = n;
+    if (compressor_) {
+      compressor_ = std::make_unique<Block_Compressor>(compressor_->format(), threads_);
     }
-    #endif
+    return *this;
   }
 
   jplace_writer& set_precision( size_t n )
   {
     precision_ = n;
+    return *this;
+  }
 
-    #ifndef __MPI
-    file_->precision( n );
-    file_->setf( std::ios::fixed, std:: ios::floatfield );
-    #endif
+  /**
+   * Size of the output buffer, in bytes.
+   */
+  jplace_writer& set_buffer_size( size_t n )
+  {
+    if (output_file_()) {
+      output_file_()->set_buffer_size( n );
+    }
+    return *this;
+  }
 
+  /**
+   * Expected size of the output, in bytes, to reserve space for it on disk.
+   */
+  jplace_writer& set_size_hint( size_t n )
+  {
+    #ifdef __MPI
+    // each rank writes about its share
+    n /= all_ranks_.size();
+    #endif
+    if (output_file_() and not compressor_) {
+      output_file_()->reserve( n );
+    }
     return *this;
   }
 
 protected:
 
-  void write_( Sample<>& chunk )
+  void write_( Sample<>& chunk ) override
   {
     #ifdef __MPI // ========== MPI ==============
 
-    if (shared_file_) {
-      // serialize the sample
-      std::stringstream buffer;
-      buffer.precision( precision_ );
-      buffer.setf( std::ios::fixed, std:: ios::floatfield );
-      if (first_){
-        // account for the leading string
-        if (local_rank_ == 0) {
-          init_jplace_string( tree_string_, buffer );
-        }
-        first_ = false;
-      } else {
-        buffer << ",\n";
+    if (rank_file_) {
+      // no need to wait for the other ranks: their parts are put together at the end
+      if (chunk.size()) {
+        serialize_(chunk, false);
+        const auto& encoded = encoded_();
+        rank_file_->write(encoded);
       }
-      sample_to_jplace_string(chunk, buffer, mapper_);
+    } else if (shared_file_) {
+      // serialize the sample
+      serialize_(chunk, local_rank_ == 0);
 
       // how much this rank intends to write this turn
-      const auto buffer_str = buffer.str();
+      const auto& buffer_str = encoded_();
       size_t num_bytes = buffer_str.size();
-      buffer.clear();
 
       // make the displacements known to all
       std::vector<size_t> block_sizes( all_ranks_.size() );
@@ -151,41 +197,106 @@ protected:
 
     #else // ========== NOT MPI ==============
 
-    if (file_) {
-      if (first_){
-        first_ = false;
-        init_jplace_string(tree_string_, *file_);
-      } else {
-        *file_ << ",\n";
-      }
+    // an empty chunk would only add a stray separator
+    if (file_ and chunk.size()) {
+      serialize_(chunk, true);
+      const auto& encoded = encoded_();
+      file_->write(encoded);
 
-      sample_to_jplace_string(chunk, *file_, mapper_);
+      // hand out each chunk right away, so consumers of a streamed run can start early
+      file_->flush();
     }
 
     #endif
   }
 
+  /**
+   * Formats the chunk into buffer_, preceded by the start of the file if this is
+   * the first chunk (and with_init is set) or by the separating comma otherwise.
+   */
+  void serialize_( Sample<>& chunk, bool const with_init )
+  {
+    buffer_.clear();
+    if (first_) {
+      // account for the leading string
+      if (with_init) {
+        std::ostringstream init;
+        init_jplace_string( tree_string_, init );
+        buffer_.append(init.str());
+      }
+      first_ = false;
+    } else {
+      buffer_.append(",\n");
+    }
+    sample_to_jplace_buffer( chunk, buffer_, mapper_, precision_, threads_ );
+  }
+
+  /**
+   * The serialized chunk as it goes to the file: compressed into independent blocks,
+   * if output compression was requested.
+   */
+  const std::string& encoded_()
+  {
+    if (not compressor_) {
+      return buffer_;
+    }
+    compressed_.clear();
+    compressor_->compress(buffer_, compressed_);
+    return compressed_;
+  }
+
+  /**
+   * The end of the jplace file, including the end of stream marker of the compressor.
+   */
+  const std::string& trailer_()
+  {
+    std::ostringstream trailing;
+    finalize_jplace_string( invocation_, trailing );
+    buffer_ = trailing.str();
+    if (compressor_) {
+      encoded_();
+      compressed_.append(compressor_->finish());
+      return compressed_;
+    }
+    return buffer_;
+  }
+
   virtual void init_file_(const std::string& out_dir,
                           const std::string& file_name)
   {
     const auto file_path = out_dir + file_name;
     #ifdef __MPI
-    MPI_File_open(MPI_COMM_WORLD,
-              file_path.c_str(),
-              MPI_MODE_WRONLY | MPI_MODE_CREATE,
-              MPI_INFO_NULL,
-              &shared_file_);
-    #else
-    file_ = std::make_unique<std::fstream>();
-    file_->open(file_path,
-                std::fstream::in | std::fstream::out | std::fstream::trunc);
-
-    if (not file_->is_open()) {
-      throw std::runtime_error{file_path + ": could not open!"};
+    if (rank_files_) {
+      file_path_ = file_path;
+      rank_file_ = std::make_unique<Output_File>(rank_file_path_(local_rank_),
+                                                 Output_File::DEFAULT_BUFFER_SIZE,
+                                                 append_);
+      // every part starts without a separator, they are joined when merging
+      first_ = rank_file_->size() == 0;
+    } else {
+      if (append_) {
+        throw std::runtime_error{"Appending to the jplace output under MPI requires rank files"};
+      }
+      MPI_File_open(MPI_COMM_WORLD,
+                file_path.c_str(),
+                MPI_MODE_WRONLY | MPI_MODE_CREATE,
+                MPI_INFO_NULL,
+                &shared_file_);
     }
+    #else
+    // written by an I/O thread of its own, through a large buffer
+    file_ = std::make_unique<Output_File>(file_path, Output_File::DEFAULT_BUFFER_SIZE, append_);
+    // continuing a file that holds chunks already: no second head
+    first_ = file_->size() == 0;
+    #endif
+  }
 
-    set_precision( precision_ );
-
+  Output_File* output_file_()
+  {
+    #ifdef __MPI
+    return rank_file_.get();
+    #else
+    return file_.get();
     #endif
   }
 
@@ -208,20 +319,79 @@ protected:
     #endif
   }
 
+  #ifdef __MPI
+  std::string rank_file_path_(int const rank) const
+  {
+    return file_path_ + "." + std::to_string(rank) + ".part";
+  }
+
+  /**
+   * Concatenates the parts written by the ranks into the final file, in rank order,
+   * between the start and the end of the jplace. Run by rank 0 only.
+   */
+  void merge_rank_files_()
+  {
+    std::ofstream out(file_path_, std::ios::binary | std::ios::trunc);
+    if (not out.is_open()) {
+      throw std::runtime_error{file_path_ + ": could not open!"};
+    }
+
+    std::ostringstream init;
+    init_jplace_string( tree_string_, init );
+    buffer_ = init.str();
+    const auto& head = encoded_();
+    out.write(head.data(), head.size());
+
+    bool first = true;
+    for (const auto rank : all_ranks_) {
+      const auto part_path = rank_file_path_(rank);
+      std::ifstream part(part_path, std::ios::binary);
+      if (part.peek() != std::ifstream::traits_type::eof()) {
+        if (not first) {
+          buffer_ = ",\n";
+          const auto& separator = encoded_();
+          out.write(separator.data(), separator.size());
+        }
+        out << part.rdbuf();
+        first = false;
+      }
+      part.close();
+      std::remove(part_path.c_str());
+    }
+
+    const auto& trailing = trailer_();
+    out.write(trailing.data(), trailing.size());
+    if (not out) {
+      throw std::runtime_error{"Failed to write to " + file_path_};
+    }
+  }
+  #endif
+
 protected:
   std::string tree_string_;
   std::string invocation_;
-  std::future<void> prev_gather_;
   bool first_ = true;
   unsigned int precision_ = 6;
+  size_t threads_ = 1;
   rtree_mapper const mapper_;
+  // under MPI: every rank writes its own part, merged at the end
+  bool const rank_files_ = false;
+  // continue an existing (unfinished) output instead of starting over
+  bool const append_ = false;
+  // text of the chunk being written, kept to reuse its allocation
+  std::string buffer_;
+  // ... and its compressed form, if output compression was requested
+  std::unique_ptr<Block_Compressor> compressor_;
+  std::string compressed_;
 
   #ifdef __MPI
-  MPI_File shared_file_;
+  MPI_File shared_file_ = MPI_FILE_NULL;
+  std::unique_ptr<Output_File> rank_file_ = nullptr;
+  std::string file_path_;
   size_t bytes_written_ = 0;
   int local_rank_ = 0;
   std::vector<int> all_ranks_ = {0};
   #else
-  std::unique_ptr<std::fstream> file_ = nullptr;
+  std::unique_ptr<Output_File> file_ = nullptr;
   #endif
 };
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "io/msa_info_cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "io/Block_Decompressor.hpp"
+#include "util/logging.hpp"
+
+#include "genesis/utils/io/serializer.hpp"
+#include "genesis/utils/io/deserializer.hpp"
+#include "genesis/utils/core/fs.hpp"
+
+constexpr char INFO_CACHE_MAGIC[] = "EPAINFO\0";
+constexpr size_t INFO_CACHE_MAGIC_SIZE = sizeof(INFO_CACHE_MAGIC);
+constexpr uint64_t INFO_CACHE_VERSION = 1;
+
+std::string info_cache_file(const std::string& file_path)
+{
+  return file_path + ".epainfo";
+}
+
+uint64_t file_hash(const std::string& file_path, const uint64_t size)
+{
+  constexpr uint64_t window = 64u * 1024u;
+
+  uint64_t hash = 14695981039346656037ull;
+  auto digest = [&hash](const std::vector<char>& buffer, const size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      hash ^= static_cast<unsigned char>(buffer[i]);
+      hash *= 1099511628211ull;
+    }
+  };
+
+  std::ifstream in(file_path, std::ios::binary);
+  std::vector<char> buffer(window);
+
+  in.read(buffer.data(), window);
+  digest(buffer, in.gcount());
+
+  if (size > 2u * window) {
+    in.clear();
+    in.seekg(size - window);
+    in.read(buffer.data(), window);
+    digest(buffer, in.gcount());
+  }
+
+  return hash;
+}
+
+File_Key make_file_key(const std::string& file_path)
+{
+  struct stat st;
+  if (stat(file_path.c_str(), &st) != 0) {
+    throw std::runtime_error{std::string("Cannot stat file: ") + file_path};
+  }
+
+  File_Key key;
+  key.size  = static_cast<uint64_t>(st.st_size);
+  key.mtime = static_cast<int64_t>(st.st_mtime);
+  key.hash  = file_hash(file_path, key.size);
+  return key;
+}
+
+std::vector<uint64_t> fasta_record_offsets(const std::string& file_path)
+{
+  std::vector<uint64_t> offsets;
+
+  // gzip, BGZF or zstd, whether or not this build can read them
+  if (Block_Decompressor::detect(file_path) != Block_Decompressor::Format::kNone) {
+    return {};
+  }
+
+  std::ifstream in(file_path, std::ios::binary);
+  std::vector<char> buffer(1u << 20);
+
+  uint64_t pos = 0;
+  bool line_start = true;
+
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    const size_t n = in.gcount();
+
+    const char* data = buffer.data();
+    const char* end = data + n;
+    const char* p = data;
+    while (p < end) {
+      if (line_start and *p == '>') {
+        offsets.push_back(pos + (p - data));
+      }
+      const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      if (not nl) {
+        line_start = false;
+        break;
+      }
+      p = nl + 1;
+      line_start = true;
+    }
+    pos += n;
+  }
+
+  return offsets;
+}
+
+bool load_msa_info_cache(const std::string& file_path, MSA_Info& info)
+{
+  const auto cache_file = info_cache_file(file_path);
+  if (not genesis::utils::file_exists(cache_file)) {
+    return false;
+  }
+
+  try {
+    genesis::utils::Deserializer des(cache_file);
+
+    char magic[INFO_CACHE_MAGIC_SIZE];
+    des.get_raw(magic, INFO_CACHE_MAGIC_SIZE);
+    if (std::memcmp(magic, INFO_CACHE_MAGIC, INFO_CACHE_MAGIC_SIZE)
+        or des.get_int<uint64_t>() != INFO_CACHE_VERSION) {
+      LOG_DBG << "Ignoring " << cache_file << ": not a valid cache file";
+      return false;
+    }
+
+    File_Key stored;
+    stored.size   = des.get_int<uint64_t>();
+    stored.mtime  = des.get_int<int64_t>();
+    stored.hash   = des.get_int<uint64_t>();
+
+    if (not (stored == make_file_key(file_path))) {
+      LOG_DBG << "Ignoring " << cache_file << ": out of date";
+      return false;
+    }
+
+    const auto sites      = des.get_int<uint64_t>();
+    const auto sequences  = des.get_int<uint64_t>();
+
+    MSA_Info::mask_type mask;
+    std::stringstream mask_str( des.get_string() );
+    mask_str >> mask;
+
+    std::vector<uint64_t> offsets(des.get_int<uint64_t>());
+    for (auto& o : offsets) {
+      o = des.get_int<uint64_t>();
+    }
+
+    info = MSA_Info(file_path, sequences, mask, sites);
+    info.offsets(std::move(offsets));
+  } catch (const std::exception& e) {
+    LOG_DBG << "Ignoring " << cache_file << ": " << e.what();
+    return false;
+  }
+
+  return true;
+}
+
+void save_msa_info_cache(const std::string& file_path, const MSA_Info& info)
+{
+  const auto cache_file = info_cache_file(file_path);
+  const auto tmp_file = cache_file + ".tmp" + std::to_string(getpid());
+
+  try {
+    const auto key = make_file_key(file_path);
+    {
+      genesis::utils::Serializer ser(tmp_file);
+      ser.put_raw(INFO_CACHE_MAGIC, INFO_CACHE_MAGIC_SIZE);
+      ser.put_int<uint64_t>(INFO_CACHE_VERSION);
+      ser.put_int<uint64_t>(key.size);
+      ser.put_int<int64_t>(key.mtime);
+      ser.put_int<uint64_t>(key.hash);
+      ser.put_int<uint64_t>(info.sites());
+      ser.put_int<uint64_t>(info.sequences());
+
+      std::stringstream ss;
+      ss << info.gap_mask();
+      ser.put_string(ss.str());
+
+      ser.put_int<uint64_t>(info.offsets().size());
+      for (const auto o : info.offsets()) {
+        ser.put_int<uint64_t>(o);
+      }
+    }
+    if (std::rename(tmp_file.c_str(), cache_file.c_str()) != 0) {
+      throw std::runtime_error{"rename failed"};
+    }
+  } catch (const std::exception& e) {
+    std::remove(tmp_file.c_str());
+    LOG_DBG << "Could not write " << cache_file << ": " << e.what();
+  }
+}
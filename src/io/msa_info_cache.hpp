@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "seq/MSA_Info.hpp"
+
+/**
+ * Sidecar cache of MSA_Info next to an alignment file (<file>.epainfo), so that
+ * repeated runs on the same file do not have to rescan it.
+ *
+ * Layout:
+ * <magic><version><file size><mtime><content hash><sites><sequences><mask string>
+ * <number of offsets><offset>...
+ *
+ * The cache is only used if the size, modification time and content hash (taken
+ * over the head and tail of the file) still match.
+ */
+
+struct File_Key
+{
+  uint64_t size   = 0;
+  int64_t mtime   = 0;
+  uint64_t hash   = 0;
+
+  bool operator==(const File_Key& other) const
+  {
+    return size == other.size and mtime == other.mtime and hash == other.hash;
+  }
+};
+
+std::string info_cache_file(const std::string& file_path);
+
+/**
+ * FNV-1a over the first and last 64 KiB of the file.
+ */
+uint64_t file_hash(const std::string& file_path, const uint64_t size);
+
+File_Key make_file_key(const std::string& file_path);
+
+/**
+ * Byte offsets of every record ('>' at the start of a line) of a plain fasta file.
+ * Returns nothing for compressed files, where byte offsets are of no use for seeking.
+ */
+std::vector<uint64_t> fasta_record_offsets(const std::string& file_path);
+
+bool load_msa_info_cache(const std::string& file_path, MSA_Info& info);
+
+/**
+ * Writes the cache, atomically replacing any previous one. Failing to do so (e.g.
+ * for a read-only input directory) is not an error.
+ */
+void save_msa_info_cache(const std::string& file_path, const MSA_Info& info);
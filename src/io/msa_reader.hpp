@@ -5,6 +5,10 @@
 #include "seq/MSA_Stream.hpp"
 #include "seq/MSA_Info.hpp"
 #include "io/Binary_Fasta.hpp"
+#include "io/Binary_Fasta_v2.hpp"
+#include "io/Mmap_Fasta_Reader.hpp"
+#include "io/Compressed_Fasta_Reader.hpp"
+#include "io/Stream_Input.hpp"
 #include "io/file_io.hpp"
 #include "util/stringify.hpp"
 #include "util/logging.hpp"
@@ -14,14 +18,39 @@
 inline auto make_msa_reader(const std::string& file_name,
                             const MSA_Info& info,
                             const bool premasking = true,
-                            const bool split = false)
+                            const bool split = false,
+                            const bool use_mmap = false,
+                            const size_t parse_threads = 1)
 {
   std::unique_ptr<msa_reader> result(nullptr);
 
+  // stdin or a pipe: plain fasta, read front to back exactly once
+  if (is_stream_input(file_name)) {
+    return std::unique_ptr<msa_reader>(
+      std::make_unique<MSA_Stream>( Stream_Input::get(file_name).stream(), info, premasking ) );
+  }
+
   try {
-    result = std::make_unique<Binary_Fasta_Reader>( file_name, info, premasking, split );
+    result = std::make_unique<Binary_Fasta_Reader>( file_name, info, premasking, split, use_mmap, parse_threads );
   } catch(const std::exception& e) {
+    if (Binary_Fasta_v2::is_bfast_v2(file_name)) {
+      return std::unique_ptr<msa_reader>(
+        std::make_unique<Binary_Fasta_v2_Reader>( file_name, info, premasking, split, parse_threads ) );
+    }
     LOG_DBG << "Failed to parse input as binary fasta (bfast), trying `fasta` instead.";
+    if (is_compressed_fasta(file_name)) {
+      return std::unique_ptr<msa_reader>(
+        std::make_unique<Compressed_Fasta_Reader>( file_name, info, premasking, split, parse_threads ) );
+    }
+    // parallel parsing is done on the memory mapped input
+    if (use_mmap or parse_threads > 1) {
+      try {
+        return std::unique_ptr<msa_reader>(
+          std::make_unique<Mmap_Fasta_Reader>( file_name, info, premasking, split, parse_threads ) );
+      } catch(const std::exception& e) {
+        LOG_DBG << "Cannot memory map the input (" << e.what() << "), streaming it instead.";
+      }
+    }
     result = std::make_unique<MSA_Stream>( file_name, info, premasking, split );
   }
 
@@ -12,5 +12,10 @@ public:
   virtual size_t num_sequences() const = 0;
   virtual size_t local_seq_offset() const = 0;
   virtual size_t read_next(MSA& result, const size_t number) = 0;
+  /**
+   * Skips the next n sequences of this readers part of the input, as if they had
+   * been read. Only allowed before the first read.
+   */
+  virtual void skip(const size_t n) = 0;
 
 };
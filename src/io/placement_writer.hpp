@@ -0,0 +1,162 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+#include "io/jplace_writer.hpp"
+#include "io/Binary_Placement.hpp"
+#include "io/Shard_Writer.hpp"
+#include "io/placement_writer_interface.hpp"
+#include "util/logging.hpp"
+#include "util/Options.hpp"
+
+/**
+ * Hands each chunk to several writers, in order.
+ */
+class Multi_Writer : public placement_writer
+{
+public:
+  Multi_Writer() = default;
+  ~Multi_Writer() override = default;
+
+  Multi_Writer& add(std::unique_ptr<placement_writer> writer)
+  {
+    writers_.push_back(std::move(writer));
+    return *this;
+  }
+
+  void write(Sample<>& chunk) override
+  {
+    for (auto& writer : writers_) {
+      writer->write(chunk);
+    }
+  }
+
+  void wait() override
+  {
+    for (auto& writer : writers_) {
+      writer->wait();
+    }
+  }
+
+  void sync(std::vector<File_State>& states) override
+  {
+    for (auto& writer : writers_) {
+      writer->sync(states);
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<placement_writer>> writers_;
+};
+
+/**
+ * Rough upper bound of the size of the jplace text of this many queries, given the
+ * precision and the maximum number of placements per query.
+ */
+inline size_t estimate_jplace_size(const size_t num_queries, const Options& options)
+{
+  const size_t per_placement = 40 + 4 * options.precision;
+  const size_t per_query = 64 + options.filter_max * per_placement;
+  return num_queries * per_query;
+}
+
+/**
+ * Whether the placements go to shards (see Shard_Writer) instead of a single output.
+ */
+inline bool sharded_output(const Options& options)
+{
+  return not options.shard_regex.empty() or not options.shard_map.empty() or options.shard_chunks;
+}
+
+/**
+ * Threads formatting (and compressing) each chunk of the output: --out-threads, or by
+ * default those of the placement. Where the writing happens in the background
+ * (__PREFETCH), overlapping the placement of the next chunk, the default is a quarter
+ * of them instead, not to oversubscribe the cores.
+ */
+inline size_t output_threads(const Options& options)
+{
+  if (options.out_threads) {
+    return options.out_threads;
+  }
+#ifdef __PREFETCH
+  size_t threads = options.num_threads;
+  #ifdef __OMP
+  if (not threads) {
+    threads = omp_get_max_threads();
+  }
+  #endif
+  return std::max<size_t>(threads / 4u, 1u);
+#else
+  return options.num_threads;
+#endif
+}
+
+/**
+ * Output writer according to --out-format and the --shard options. Returns the path of
+ * the output file, or of the manifest of the shards.
+ * If the number of queries is known, space for the output is reserved on disk.
+ * With append set, an unfinished output of an earlier run is continued (jplace only).
+ */
+inline auto make_placement_writer(const std::string& out_dir,
+                                  const std::string& tree_string,
+                                  const std::string& invocation,
+                                  rtree_mapper const& mapper,
+                                  const Options& options,
+                                  std::string& file_path,
+                                  const size_t num_queries = 0,
+                                  const bool append = false)
+{
+  std::unique_ptr<placement_writer> result(nullptr);
+  const std::string file_name("epa_result.jplace");
+
+  if (options.out_format == "binary") {
+    if (append) {
+      throw std::runtime_error{"Binary placement output can not be appended to"};
+    }
+    file_path = out_dir + file_name + Binary_Placement::EXTENSION;
+    result = std::make_unique<Binary_Placement_Writer>( out_dir, file_name + Binary_Placement::EXTENSION,
+                                                        tree_string, invocation, mapper, options.precision );
+    return result;
+  }
+
+  const auto compression = Block_Compressor::parse_format(options.out_compress);
+
+  if (sharded_output(options)) {
+    if (append) {
+      throw std::runtime_error{"Sharded placement output can not be appended to"};
+    }
+    std::unique_ptr<Shard_Router> router(nullptr);
+    if (not options.shard_regex.empty()) {
+      router = std::make_unique<Shard_Router>(Shard_Router::from_regex(options.shard_regex));
+    } else if (not options.shard_map.empty()) {
+      router = std::make_unique<Shard_Router>(Shard_Router::from_map_file(options.shard_map));
+    }
+    auto shards = std::make_unique<Shard_Writer>( out_dir, "epa_result", tree_string, invocation, mapper,
+                                                  std::move(router), compression );
+    shards->set_precision( options.precision );
+    shards->set_threads( output_threads(options) );
+    file_path = shards->manifest_path();
+    result = std::move(shards);
+    return result;
+  }
+
+  file_path = out_dir + file_name + Block_Compressor::extension(compression);
+  auto jplace = std::make_unique<jplace_writer>( out_dir, file_name, tree_string, invocation, mapper,
+                                                 compression, options.rank_files, append );
+  jplace->set_precision( options.precision );
+  jplace->set_threads( output_threads(options) );
+  jplace->set_buffer_size( options.out_buffer * 1024ul * 1024ul );
+  if (num_queries) {
+    jplace->set_size_hint( estimate_jplace_size(num_queries, options) );
+  }
+  result = std::move(jplace);
+
+  return result;
+}
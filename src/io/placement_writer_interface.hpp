@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <future>
+
+#include "sample/Sample.hpp"
+
+class placement_writer
+{
+
+public:
+  // an output file, and how many bytes of it are written
+  struct File_State
+  {
+    std::string path;
+    size_t size;
+  };
+
+  placement_writer() = default;
+  virtual ~placement_writer() = default;
+
+  virtual void write(Sample<>& chunk) = 0;
+  // blocks until all chunks handed to write are out
+  virtual void wait() = 0;
+
+  /**
+   * Blocks until all chunks handed to write are on storage, and adds the files
+   * written to, with their current size, to states. Used for checkpointing.
+   */
+  virtual void sync(std::vector<File_State>&)
+  {
+    throw std::runtime_error{"This output format does not support checkpointing"};
+  }
+
+};
+
+/**
+ * A writer that formats and writes each chunk in the background (when built with
+ * __PREFETCH), while the caller goes on with the next one. Derived classes implement
+ * write_, and must call wait() first thing in their destructor.
+ */
+class async_placement_writer : public placement_writer
+{
+public:
+  async_placement_writer() = default;
+  ~async_placement_writer() override = default;
+
+  void write(Sample<>& chunk) override
+  {
+    #ifdef __PREFETCH
+    // ensure the last write has finished
+    wait();
+    prev_write_ = std::async(std::launch::async,
+      [chunk = chunk, this]() mutable {
+        this->write_(chunk);
+      });
+    #else
+    write_(chunk);
+    #endif
+  }
+
+  void wait() override
+  {
+    if (prev_write_.valid()) {
+      prev_write_.get();
+    }
+  }
+
+protected:
+  virtual void write_(Sample<>& chunk) = 0;
+
+private:
+  std::future<void> prev_write_;
+};
@@ -11,10 +11,17 @@
 #include "util/stringify.hpp"
 #include "util/parse_model.hpp"
 #include "util/split.hpp"
+#include "util/numa.hpp"
+#include "util/Timer.hpp"
 #include "io/Binary_Fasta.hpp"
+#include "io/Binary_Fasta_v2.hpp"
 #include "io/Binary.hpp"
 #include "io/file_io.hpp"
 #include "io/msa_reader.hpp"
+#include "io/Stream_Input.hpp"
+#include "io/Block_Compressor.hpp"
+#include "io/Binary_Placement.hpp"
+#include "io/placement_writer.hpp"
 #include "tree/Tree.hpp"
 #include "core/raxml/Model.hpp"
 #include "core/place.hpp"
@@ -81,7 +88,9 @@ int main(int argc, char** argv)
   std::string reference_file;
   std::string binary_file;
   std::string bfast_conv_file;
+  bool bfast_v2 = false;
   std::vector<std::string> split_files;
+  std::string bplace_conv_file;
 
   std::string banner;
 
@@ -109,6 +118,11 @@ int main(int argc, char** argv)
                   bfast_conv_file,
                   "Convert the given fasta file to bfast format."
                 )->group("Convert")->check(CLI::ExistingFile);
+  app.add_flag( "--bfast-v2",
+                  bfast_v2,
+                  "With --bfast: write the block-compressed, checksummed v2 format, which also "
+                  "supports amino acid data and is converted in constant memory."
+                )->group("Convert");
   app.add_flag( "-B,--dump-binary",
                   options.dump_binary_mode,
                   "Binary Dump mode: write ref. tree in binary format then exit. NOTE: not compatible with premasking!"
@@ -122,6 +136,11 @@ int main(int argc, char** argv)
                   "Usage: epa-ng --split ref_alignment query_alignments+"
                 )->group("Convert")->check(CLI::ExistingFile);
 
+  app.add_option( "--convert",
+                  bplace_conv_file,
+                  "Convert the given binary placement file (see --out-format) to jplace."
+                )->group("Convert")->check(CLI::ExistingFile);
+
   //  ============== INPUT OPTIONS ==============
   auto tree_file_opt =
   app.add_option( "-t,--tree",
@@ -145,8 +164,29 @@ int main(int argc, char** argv)
 
   app.add_option( "-q,--query",
                   query_file,
-                  "Path to Query MSA file."
-                )->group("Input")->check(CLI::ExistingFile);
+                  "Path to Query MSA file. Pass - to read it from stdin; named pipes are read as a stream too."
+                )->group("Input");
+  app.add_flag( "--single-pass",
+                  options.single_pass,
+                  "Read the query file only once: take the alignment width from its first sequence and "
+                  "premask based on the reference alone, instead of pre-scanning the whole file."
+                )->group("Input");
+  app.add_flag( "--mmap",
+                  options.mmap_queries,
+                  "Parse the (uncompressed fasta) query file from a memory mapping, in one pass per sequence. "
+                  "bfast query files are decoded from a shared mapping, so ranks on one node share the page cache."
+                )->group("Input");
+  auto parse_threads =
+  app.add_option( "--parse-threads",
+                  options.parse_threads,
+                  "Number of threads parsing each chunk of the (uncompressed fasta) query file, or "
+                  "decoding it for bfast files. For fasta, more than one implies --mmap."
+                )->group("Input")->check(CLI::Range(1u, 1024u));
+  app.add_flag( "--info-cache",
+                  options.info_cache,
+                  "Keep the result of scanning the reference and query fasta files (width, sequence count, "
+                  "gap mask, record offsets) in a <file>.epainfo sidecar, and reuse it on later runs."
+                )->group("Input");
 
   auto model_option =
   app.add_option( "-m,--model",
@@ -201,6 +241,11 @@ int main(int argc, char** argv)
                   "Output decimal point precision for floating point numbers.",
                   true
                 )->group("Output");
+  app.add_flag( "--stats",
+                  options.stats,
+                  "Count placements, Newton iterations, Tiny_Tree and lookup constructions and CLV loads, "
+                  "time each phase per thread, and write a JSON summary (per MPI rank) to the output dir."
+                )->group("Output");
 
   app.add_flag( "--redo",
                   redo,
@@ -212,6 +257,90 @@ int main(int argc, char** argv)
                 preserve_rooting_option,
                 "Preserve the rooting of rooted trees. When disabled, EPA-ng will print the result as an unrooted tree."
                 )->group("Output")->check(CLI::IsMember({"off", "on"}, CLI::ignore_case));
+  auto out_compress =
+  app.add_option( "--out-compress",
+                  options.out_compress,
+                  "Compress the jplace output: gzip (blocked, as written by bgzip) or zstd. "
+                  "Blocks are compressed in parallel.",
+                  true
+                )->group("Output")->check(CLI::IsMember({"none", "gzip", "zstd"}));
+  auto out_format =
+  app.add_option( "--out-format",
+                  options.out_format,
+                  "Format of the placement output: jplace, or binary for a compact, block indexed "
+                  "binary format that can be turned into jplace using --convert.",
+                  true
+                )->group("Output")->check(CLI::IsMember({"jplace", "binary"}));
+  auto out_buffer =
+  app.add_option( "--out-buffer",
+                  options.out_buffer,
+                  "Size in MB of the buffers in which the jplace output is collected before a thread "
+                  "of its own writes them to disk.",
+                  true
+                )->group("Output")->check(CLI::Range(1, 4096));
+  auto out_threads =
+  app.add_option( "--out-threads",
+                  options.out_threads,
+                  "Number of threads formatting and compressing each chunk of the output. By default "
+                  "those of --threads, or a quarter of them where the output is written in the "
+                  "background while the next chunk is placed."
+                )->group("Output")->check(CLI::Range(1u, 1024u));
+  app.add_flag( "--deterministic",
+                  options.deterministic,
+                  "Order the pqueries of the output by their position in the query file, and their placements "
+                  "by likelihood and edge, so that the output does not depend on the number of threads. "
+                  "With --dedup, identical sequences are grouped per chunk, so the output also depends on "
+                  "--chunk-size, and can not be combined with --auto-chunk-size."
+                )->group("Output");
+  app.add_flag( "--rank-files",
+                  options.rank_files,
+                  "MPI: every rank writes its placements to a part file of its own, without waiting for the "
+                  "other ranks, and the parts are merged into the jplace at the end."
+                )->group("Output");
+  app.add_flag( "--summary",
+                  options.summary,
+                  "Also write epa_summary.tsv (per MPI rank): for every query the edge, LWR, likelihood, "
+                  "distal and pendant length of its best placement, and the EDPL of its placements."
+                )->group("Output");
+  auto checkpoint =
+  app.add_flag( "--checkpoint",
+                  options.checkpoint,
+                  "Record the progress (per MPI rank) in epa_checkpoint after every chunk written, so an "
+                  "interrupted run can be continued using --resume."
+                )->group("Output");
+  auto resume =
+  app.add_flag( "--resume",
+                  options.resume,
+                  "Continue an interrupted run from its checkpoint in the output dir, appending to its "
+                  "output files. Implies --checkpoint. Fails if there is no checkpoint to continue from. "
+                  "With --dedup, the sequences placed before the interruption are not remembered, so "
+                  "copies of them are placed again."
+                )->group("Output");
+  auto shard_regex =
+  app.add_option( "--shard-regex",
+                  options.shard_regex,
+                  "Write the placements to one jplace per shard instead of a single one, with the shard "
+                  "of a query given by the first capture group (or the match) of this regex on its name, "
+                  "e.g. '^([^_]+)_'. The shards are listed in epa_result.shards.tsv."
+                )->group("Output");
+  auto shard_map =
+  app.add_option( "--shard-map",
+                  options.shard_map,
+                  "Like --shard-regex, with the shard of each query name given by a file of "
+                  "'<name> <shard>' lines."
+                )->group("Output")->check(CLI::ExistingFile);
+  auto shard_chunks =
+  app.add_flag( "--shard-chunks",
+                  options.shard_chunks,
+                  "Like --shard-regex, with one shard per chunk of queries."
+                )->group("Output");
+  shard_regex->excludes(shard_map)->excludes(shard_chunks);
+  shard_map->excludes(shard_regex)->excludes(shard_chunks);
+  shard_chunks->excludes(shard_regex)->excludes(shard_map);
+  for (auto shard_option : {shard_regex, shard_map, shard_chunks}) {
+    // a checkpoint can not record the state of the shards
+    shard_option->excludes(checkpoint)->excludes(resume);
+  }
 
   //  ============== COMPUTE OPTIONS ==============
 
@@ -249,6 +378,17 @@ int main(int argc, char** argv)
                   "Number of query sequences to be read in at a time. May influence performance.",
                   true
                 )->group("Compute");
+  app.add_flag( "--auto-chunk-size",
+                  options.auto_chunk_size,
+                  "Adapt the chunk size during the run based on the measured throughput, starting from"
+                  " --chunk-size and bounded by --chunk-mem."
+                )->group("Compute");
+  auto chunk_mem =
+  app.add_option( "--chunk-mem",
+                  options.chunk_memory,
+                  "Memory ceiling in MB for the queries in flight under --auto-chunk-size."
+                  " Default: a quarter of the physical memory."
+                )->group("Compute");
   app.add_flag( "--raxml-blo",
                   raxml_blo,
                   "Employ old style of branch length optimization during thorough insertion as opposed"
@@ -276,6 +416,50 @@ int main(int argc, char** argv)
                   true
                 )->group("Compute");
   #endif
+  auto pipeline =
+  app.add_flag( "--pipeline",
+                  options.pipeline,
+                  "Overlap reading, prescoring, thorough placement and output of consecutive chunks "
+                  "by running them as concurrent pipeline stages."
+                )->group("Compute");
+  auto pipeline_depth =
+  app.add_option( "--pipeline-depth",
+                  options.pipeline_depth,
+                  "Number of chunks that may wait between two pipeline stages. Bounds memory use of --pipeline.",
+                  true
+                )->group("Compute")->check(CLI::Range(1u, 1024u));
+  auto prescore_threads =
+  app.add_option( "--prescore-threads",
+                  options.prescore_threads,
+                  "Threads used by the prescoring stage of --pipeline. Default: half of the available threads."
+                )->group("Compute");
+  auto thorough_threads =
+  app.add_option( "--thorough-threads",
+                  options.thorough_threads,
+                  "Threads used by the thorough placement stage of --pipeline. Default: the remaining threads."
+                )->group("Compute");
+  app.add_flag( "--overlap-chunks",
+                  options.overlap_chunks,
+                  "Let threads that run out of thorough placement work go on to prescore the next chunk, "
+                  "using one persistent thread team and task-based execution instead of a barrier per phase."
+                )->group("Compute")->excludes(pipeline);
+  app.add_flag( "--numa",
+                  options.numa,
+                  "NUMA-aware execution: pin threads to NUMA nodes and keep one replica of the reference "
+                  "data per node. Trades memory for locality on multi-socket machines."
+                )->group("Compute");
+  app.add_flag( "--dedup",
+                  options.dedup,
+                  "Place identical (premasked) query sequences only once. The headers of all copies are "
+                  "listed in the name list of the placed pquery."
+                )->group("Compute");
+  auto dedup_mem =
+  app.add_option( "--dedup-mem",
+                  options.dedup_memory,
+                  "Memory in MB for the placements remembered by --dedup, beyond which they are spilled to "
+                  "disk (to --tmp, or the output directory).",
+                  true
+                )->group("Compute");
 
   try {
     app.parse(argc, argv);
@@ -300,7 +484,10 @@ int main(int argc, char** argv)
   // no log file for conversion functions
   if (not bfast_conv_file.empty()) {
     LOG_INFO << "Converting given FASTA file to BFAST format...";
-    auto resultfile = Binary_Fasta::fasta_to_bfast(bfast_conv_file, work_dir);
+    auto resultfile = bfast_v2
+      ? Binary_Fasta_v2::fasta_to_bfast(bfast_conv_file, work_dir,
+                                        Binary_Fasta_v2::DEFAULT_BLOCK_SIZE, options.num_threads)
+      : Binary_Fasta::fasta_to_bfast(bfast_conv_file, work_dir, options.num_threads);
     LOG_INFO << "Resulting bfast file was written to: " << resultfile;
     exit_epa();
   }
@@ -321,6 +508,18 @@ int main(int argc, char** argv)
     exit_epa();
   }
 
+  if (not bplace_conv_file.empty()) {
+    LOG_INFO << "Converting given binary placement file to jplace...";
+    try {
+      auto resultfile = Binary_Placement::convert(bplace_conv_file, work_dir);
+      LOG_INFO << "Resulting jplace file was written to: " << resultfile;
+    } catch (const std::exception& e) {
+      LOG_ERR << e.what() << std::endl;
+      exit_epa(EXIT_FAILURE);
+    }
+    exit_epa();
+  }
+
   std::string log_file;
   #ifdef __MPI
   log_file = work_dir + std::to_string(local_rank) + ".epa_info.log";
@@ -328,7 +527,8 @@ int main(int argc, char** argv)
   log_file = work_dir + "epa_info.log";
   #endif
 
-  if ( not redo and genesis::utils::file_exists( log_file ) ) {
+  // a resumed run continues in the output dir of the interrupted one
+  if ( not redo and not options.resume and genesis::utils::file_exists( log_file ) ) {
     throw std::runtime_error{ log_file + " already exists! To overwrite existing output files, rerun with --redo" };
   } else {
     genesis::utils::Logging::log_to_file( log_file );
@@ -343,6 +543,18 @@ int main(int argc, char** argv)
 
   if (not query_file.empty()) {
     LOG_INFO << "Selected: Query file: " << query_file;
+    if (is_stream_input(query_file)) {
+      #ifdef __MPI
+      LOG_ERR << "Reading the query file from stdin or a pipe is not supported under MPI." << std::endl;
+      exit_epa(EXIT_FAILURE);
+      #else
+      LOG_INFO << "Selected: Streaming the query file (implies --single-pass)";
+      options.single_pass = true;
+      #endif
+    } else if (not genesis::utils::file_exists(query_file)) {
+      LOG_ERR << "Query file does not exist: " << query_file << std::endl;
+      exit_epa(EXIT_FAILURE);
+    }
   }
 
   if (not tree_file.empty()) {
@@ -460,11 +672,175 @@ int main(int argc, char** argv)
   if (*chunk_size) {
     LOG_INFO << "Selected: Reading queries in chunks of: " << options.chunk_size;
   }
+  if (options.auto_chunk_size) {
+    #ifdef __MPI
+    LOG_WARN << "WARNING: --auto-chunk-size is not supported under MPI, using a fixed chunk size";
+    options.auto_chunk_size = false;
+    #else
+    LOG_INFO << "Selected: Adapting the chunk size to the measured throughput";
+    #endif
+  }
+  if (*chunk_mem) {
+    LOG_INFO << "Selected: Chunk memory ceiling: " << options.chunk_memory << " MB";
+  }
   #ifdef __OMP
   if (*threads) {
     LOG_INFO << "Selected: Using threads: " << options.num_threads;
   }
   #endif
+  if (options.pipeline) {
+    LOG_INFO << "Selected: Pipelined placement";
+  }
+  if (options.overlap_chunks) {
+    LOG_INFO << "Selected: Overlapping the placement of consecutive chunks";
+  }
+  if (*pipeline_depth) {
+    LOG_INFO << "Selected: Pipeline queue depth: " << options.pipeline_depth;
+  }
+  if (*prescore_threads) {
+    LOG_INFO << "Selected: Prescoring stage threads: " << options.prescore_threads;
+  }
+  if (*thorough_threads) {
+    LOG_INFO << "Selected: Thorough placement stage threads: " << options.thorough_threads;
+  }
+  if (options.single_pass) {
+    #ifdef __MPI
+    LOG_WARN << "WARNING: --single-pass is not supported under MPI, as splitting the query file"
+             << " requires its number of sequences";
+    options.single_pass = false;
+    #else
+    LOG_INFO << "Selected: Single pass over the query file";
+    #endif
+  }
+  if (options.mmap_queries) {
+    LOG_INFO << "Selected: Memory mapped query parsing";
+  }
+  if (*parse_threads) {
+    LOG_INFO << "Selected: Query parsing threads: " << options.parse_threads;
+  }
+  if (options.info_cache) {
+    LOG_INFO << "Selected: Caching MSA info in sidecar files";
+  }
+  if (*out_compress) {
+    try {
+      // throws if this build does not support the format
+      Block_Compressor check(Block_Compressor::parse_format(options.out_compress));
+      static_cast<void>(check);
+    } catch (const std::exception& e) {
+      LOG_ERR << e.what() << std::endl;
+      exit_epa(EXIT_FAILURE);
+    }
+    LOG_INFO << "Selected: Output compression: " << options.out_compress;
+  }
+  if (*out_format) {
+    #ifdef __MPI
+    if (options.out_format == "binary") {
+      LOG_WARN << "WARNING: binary output is not supported under MPI, writing jplace instead.";
+      options.out_format = "jplace";
+    }
+    #endif
+    if (options.out_format == "binary" and options.out_compress != "none") {
+      LOG_WARN << "WARNING: --out-compress only applies to jplace output, ignoring it.";
+    }
+    LOG_INFO << "Selected: Output format: " << options.out_format;
+  }
+  if (options.summary) {
+    LOG_INFO << "Selected: Writing a per query summary";
+  }
+  if (options.deterministic) {
+    LOG_INFO << "Selected: Deterministic output order";
+    if (options.dedup and options.auto_chunk_size) {
+      // which copies of a sequence end up in one pquery depends on the chunk boundaries
+      LOG_ERR << "--deterministic with --dedup requires a fixed chunk size, not --auto-chunk-size." << std::endl;
+      exit_epa(EXIT_FAILURE);
+    }
+  }
+  if (*out_buffer) {
+    LOG_INFO << "Selected: Output buffer size: " << options.out_buffer << " MB";
+  }
+  if (*out_threads) {
+    LOG_INFO << "Selected: Output threads: " << options.out_threads;
+  }
+  if (options.rank_files) {
+    #ifdef __MPI
+    LOG_INFO << "Selected: Writing per-rank part files, merged at the end";
+    #else
+    LOG_WARN << "WARNING: --rank-files only applies under MPI, ignoring it.";
+    #endif
+  }
+  if (options.resume) {
+    LOG_INFO << "Selected: Resuming from the last checkpoint";
+    options.checkpoint = true;
+    if (is_stream_input(query_file)) {
+      LOG_ERR << "--resume requires a query file that can be read again, not stdin or a pipe." << std::endl;
+      exit_epa(EXIT_FAILURE);
+    }
+  }
+  if (options.checkpoint) {
+    LOG_INFO << "Selected: Checkpointing after every chunk";
+    if (options.pipeline or options.overlap_chunks) {
+      LOG_WARN << "WARNING: --checkpoint only applies to chunk by chunk placement, placing chunk by chunk.";
+      options.pipeline = false;
+      options.overlap_chunks = false;
+    }
+    if (options.out_format == "binary") {
+      LOG_WARN << "WARNING: --checkpoint is not supported with binary output, writing jplace instead.";
+      options.out_format = "jplace";
+    }
+    #ifdef __MPI
+    if (not options.rank_files) {
+      LOG_INFO << "Note: under MPI, checkpointing implies --rank-files";
+      options.rank_files = true;
+    }
+    #endif
+  }
+  if (sharded_output(options)) {
+    #ifdef __MPI
+    LOG_WARN << "WARNING: sharded output is not supported under MPI, writing a single jplace instead.";
+    options.shard_regex.clear();
+    options.shard_map.clear();
+    options.shard_chunks = false;
+    #else
+    if (not options.shard_regex.empty()) {
+      try {
+        // throws if the regex is malformed
+        Shard_Router::from_regex(options.shard_regex);
+      } catch (const std::exception& e) {
+        LOG_ERR << e.what() << std::endl;
+        exit_epa(EXIT_FAILURE);
+      }
+      LOG_INFO << "Selected: Sharding the output by the query name regex: " << options.shard_regex;
+    } else if (not options.shard_map.empty()) {
+      LOG_INFO << "Selected: Sharding the output by the query name map: " << options.shard_map;
+    } else {
+      LOG_INFO << "Selected: Sharding the output by chunk";
+    }
+    if (options.out_format == "binary") {
+      LOG_WARN << "WARNING: sharded output is written as jplace, ignoring --out-format binary.";
+      options.out_format = "jplace";
+    }
+    #endif
+  }
+  if (options.dedup) {
+    LOG_INFO << "Selected: Deduplicating identical query sequences";
+    if (options.pipeline or options.overlap_chunks) {
+      LOG_WARN << "WARNING: --dedup only applies to chunk by chunk placement, ignoring it.";
+      options.dedup = false;
+    }
+    #ifdef __MPI
+    LOG_INFO << "Note: under MPI, sequences are deduplicated per rank";
+    #endif
+  }
+  if (*dedup_mem) {
+    LOG_INFO << "Selected: Deduplication memory: " << options.dedup_memory << " MB";
+  }
+  if (options.stats) {
+    LOG_INFO << "Selected: Collecting hot path statistics";
+    Stats::enable();
+  }
+  if (options.numa) {
+    LOG_INFO << "Selected: NUMA-aware execution, " << get_num_numa_nodes() << " node(s) detected";
+  }
 
   //================================================================
   //============    EPA    =========================================
@@ -484,13 +860,15 @@ int main(int argc, char** argv)
 
   MSA_Info ref_info;
   if (not reference_file.empty()) {
-    ref_info = make_msa_info(reference_file);
+    ref_info = make_msa_info(reference_file, options.info_cache);
     LOG_DBG << "Reference File:\n" << ref_info;
   }
 
   MSA_Info qry_info;
   if (not query_file.empty()) {
-    qry_info = make_msa_info(query_file);
+    qry_info  = options.single_pass
+              ? make_streaming_msa_info(query_file)
+              : make_msa_info(query_file, options.info_cache);
     LOG_DBG << "Query File:\n" << qry_info;
   }
 
@@ -553,6 +931,20 @@ int main(int argc, char** argv)
 
   LOG_INFO << "Time spent placing: " << placetime << "s";
 
+  if (options.stats) {
+    std::string stats_file;
+    int stats_rank = 0;
+    #ifdef __MPI
+    stats_file = work_dir + std::to_string(local_rank) + ".epa_stats.json";
+    stats_rank = local_rank;
+    #else
+    stats_file = work_dir + "epa_stats.json";
+    #endif
+    const std::chrono::duration<double> place_seconds = end_place - start_place;
+    Stats::write_json(stats_file, stats_rank, place_seconds.count());
+    LOG_INFO << "Statistics written to: " << stats_file;
+  }
+
   MPI_FINALIZE();
 
   auto end_all = std::chrono::high_resolution_clock::now();
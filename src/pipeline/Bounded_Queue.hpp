@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+/**
+ * Blocking FIFO of Tokens with a fixed capacity, connecting two pipeline stages.
+ *
+ * push() blocks while the queue is full, pop() while it is empty. close() aborts
+ * the queue: push() then drops its argument and returns false, and pop() returns
+ * end tokens, so that stages on either side terminate.
+ */
+template <class T>
+class Bounded_Queue
+{
+public:
+  explicit Bounded_Queue(const size_t capacity = 1)
+    : capacity_(std::max<size_t>(capacity, 1u))
+  { }
+  ~Bounded_Queue() = default;
+
+  Bounded_Queue(Bounded_Queue const& other) = delete;
+  Bounded_Queue& operator= (Bounded_Queue const& other) = delete;
+
+  void capacity(const size_t c)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = std::max<size_t>(c, 1u);
+  }
+
+  bool push(T&& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]{ return closed_ or items_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    items_.push_back(std::move(item));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  T pop()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]{ return closed_ or not items_.empty(); });
+
+    T item;
+    if (closed_) {
+      item.is_last(true);
+      return item;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    lock.unlock();
+    not_full_.notify_one();
+    return item;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  size_t capacity_;
+  bool closed_ = false;
+};
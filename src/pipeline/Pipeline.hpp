@@ -15,24 +15,6 @@
 #include "util/function_traits.hpp"
 #include "util/template_magic.hpp"
 
-/**
- * Building a Stage Tuple out of a bunch of lambda functions/functors
- */
-template < class I, class... lambdas>
-struct stage_types_base;
-
-template < std::size_t... I, class... lambdas >
-struct stage_types_base<std::index_sequence<I...>, lambdas...>
-{
-  using types = typename std::tuple< Typed_Stage<I, lambdas>... >;
-};
-
-template < class... lambdas >
-struct stage_types 
-  : stage_types_base<std::make_index_sequence<sizeof...(lambdas) >, lambdas...>
-{
-};
-
 /**
  * Basic Pipeline Class. Runs all stages in serial.
  */
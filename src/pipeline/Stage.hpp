@@ -3,6 +3,8 @@
 #include <functional>
 #include <type_traits>
 #include <memory>
+#include <tuple>
+#include <utility>
 
 #include "pipeline/Token.hpp"
 #include "util/function_traits.hpp"
@@ -113,3 +115,21 @@ private:
   put_func_type     put_;
 
 };
+
+/**
+ * Building a Stage Tuple out of a bunch of lambda functions/functors
+ */
+template < class I, class... lambdas>
+struct stage_types_base;
+
+template < std::size_t... I, class... lambdas >
+struct stage_types_base<std::index_sequence<I...>, lambdas...>
+{
+  using types = typename std::tuple< Typed_Stage<I, lambdas>... >;
+};
+
+template < class... lambdas >
+struct stage_types 
+  : stage_types_base<std::make_index_sequence<sizeof...(lambdas) >, lambdas...>
+{
+};
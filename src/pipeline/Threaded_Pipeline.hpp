@@ -0,0 +1,157 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <memory>
+
+#include "pipeline/Stage.hpp"
+#include "pipeline/Token.hpp"
+#include "pipeline/Bounded_Queue.hpp"
+#include "util/template_magic.hpp"
+#include "util/parallel.hpp"
+
+/**
+ * Building a tuple of Bounded_Queues out of a tuple of Token types
+ */
+template < class Tuple >
+struct queue_types;
+
+template < class... Ts >
+struct queue_types< std::tuple<Ts...> >
+{
+  using types = typename std::tuple< Bounded_Queue<Ts>... >;
+};
+
+/**
+ * Shared memory Pipeline that runs every stage on its own thread, connecting
+ * neighbouring stages through bounded queues. This way consecutive stages work on
+ * consecutive chunks concurrently, while the queue depth bounds how many chunks
+ * are in flight (and thus the memory footprint).
+ *
+ * The first stage acts as the source: it is called repeatedly until it returns an
+ * end Token (Token::is_last). End Tokens are passed downstream, terminating each
+ * stage in turn. Any thread budget of a stage is the business of its lambda.
+ */
+template <class... lambdas>
+class Threaded_Pipeline
+{
+  using stack_type      = typename stage_types< lambdas... >::types;
+  using token_set_type  = typename token_types< stack_type >::types;
+  using queue_set_type  = typename queue_types< token_set_type >::types;
+
+  static constexpr size_t num_stages = sizeof...(lambdas);
+
+public:
+  Threaded_Pipeline(const stack_type& stages,
+                    const size_t queue_depth)
+    : stages_(stages)
+    , queue_depth_(queue_depth)
+  { }
+
+  ~Threaded_Pipeline() = default;
+
+  template <class Function>
+  auto push(const Function& f) const
+  {
+    constexpr auto new_stage_id = num_stages;
+
+    using stage_type = Typed_Stage<new_stage_id, Function>;
+    using new_stack_type = typename stage_types<lambdas..., Function>::types;
+
+    new_stack_type stage_tuple
+      = std::tuple_cat(stages_, std::make_tuple(stage_type(f)));
+
+    return Threaded_Pipeline<lambdas..., Function>(stage_tuple, queue_depth_);
+  }
+
+  /**
+   * Runs all stages to completion. Rethrows the first exception thrown by any stage.
+   */
+  void process()
+  {
+    queue_set_type queues;
+    for_each(queues, [&](auto& q) {
+      q.capacity(queue_depth_);
+    });
+
+    std::vector<std::thread> threads;
+    First_Error error;
+
+    for_each(stages_, [&](const auto& s) {
+      threads.emplace_back([&, s]() {
+        try {
+          run_stage_(s, queues);
+        } catch (...) {
+          error.capture();
+          // unblock everyone else
+          for_each(queues, [](auto& q) {
+            q.close();
+          });
+        }
+      });
+    });
+
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    error.rethrow();
+  }
+
+private:
+
+  template <class Stage_Type>
+  static void run_stage_(const Stage_Type& s, queue_set_type& queues)
+  {
+    constexpr auto stage_id = Stage_Type::id();
+    constexpr bool is_source = (stage_id == 0u);
+    constexpr bool is_sink = (stage_id == num_stages - 1u);
+
+    using in_type   = typename Stage_Type::in_type;
+    using out_type  = typename Stage_Type::out_type;
+
+    // queue i feeds stage i, queue i+1 receives its output
+    auto& in_queue  = std::get<stage_id>(queues);
+    auto& out_queue = std::get<stage_id + 1u>(queues);
+
+    bool done = false;
+    while (not done) {
+      in_type in_token;
+      if (not is_source) {
+        in_token = in_queue.pop();
+      }
+
+      out_type out_token;
+      if (in_token.valid()) {
+        out_token = s.process(in_token);
+        if (not is_source) {
+          // carry over the token status
+          out_token.status(in_token.status());
+        }
+      } else {
+        out_token.is_last(true);
+      }
+
+      done = not out_token.valid();
+
+      if (not is_sink) {
+        // a closed queue means the pipeline was aborted
+        done = not out_queue.push(std::move(out_token)) or done;
+      }
+    }
+  }
+
+  stack_type stages_;
+  size_t queue_depth_;
+};
+
+template <class stage_f>
+auto make_threaded_pipeline(const stage_f& first_stage,
+                            const size_t queue_depth)
+{
+  return Threaded_Pipeline<stage_f>(std::make_tuple(Typed_Stage<0u, stage_f>(first_stage)),
+                                    queue_depth);
+}
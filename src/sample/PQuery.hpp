@@ -4,6 +4,7 @@
 #include <type_traits>
 
 #include <cereal/types/vector.hpp>
+#include <cereal/types/string.hpp>
 
 #include "seq/Sequence.hpp"
 #include "sample/Placement.hpp"
@@ -26,6 +27,7 @@ public:
   >
   PQuery(const PQuery<Slim_Placement>& other)
     : sequence_id_(other.sequence_id())
+    , duplicates_(other.duplicates())
     , placements_(other.size())
   {
     const auto size = other.size();
@@ -61,6 +63,9 @@ public:
   inline seqid_type sequence_id() const { return sequence_id_; }
   inline void sequence_id(const seqid_type seq_id) { sequence_id_ = seq_id; }
   const std::string& header() const { return header_; }
+  // headers of identical query sequences that share this pquerys placements
+  const std::vector<std::string>& duplicates() const { return duplicates_; }
+  void add_duplicate(std::string header) { duplicates_.push_back(std::move(header)); }
   size_t size() const { return placements_.size(); }
 
   // manipulators
@@ -97,9 +102,10 @@ public:
 
   // serialization
   template<class Archive>
-  void serialize(Archive& ar) { ar( sequence_id_, header_, placements_ ); }
+  void serialize(Archive& ar) { ar( sequence_id_, header_, duplicates_, placements_ ); }
 private:
   seqid_type sequence_id_ = 0;
   std::string header_;
+  std::vector<std::string> duplicates_;
   std::vector<value_type> placements_;
 };
@@ -18,6 +18,7 @@ public:
 
   void move_sequences(iterator begin, iterator end);
   void append(const std::string& header, const std::string& sequence);
+  void append(std::string&& header, std::string&& sequence);
   void erase(iterator begin, iterator end) {sequence_list_.erase(begin, end);}
   void clear() {sequence_list_.clear();}
 
@@ -1,14 +1,77 @@
 #include "seq/MSA_Info.hpp"
 
 #include "io/Binary_Fasta.hpp"
+#include "io/Binary_Fasta_v2.hpp"
+#include "io/msa_info_cache.hpp"
+#include "io/Compressed_Fasta_Reader.hpp"
+#include "io/Stream_Input.hpp"
 
-MSA_Info make_msa_info(const std::string& file_path)
+MSA_Info make_msa_info(const std::string& file_path, const bool use_cache)
 {
   MSA_Info info;
   try {
     info = Binary_Fasta::get_info(file_path);
   } catch(const std::exception&) {
-    info = MSA_Info(file_path);
+    if (Binary_Fasta_v2::is_bfast_v2(file_path)) {
+      return Binary_Fasta_v2::get_info(file_path);
+    }
+
+    if (use_cache and load_msa_info_cache(file_path, info)) {
+      LOG_DBG << "Using cached MSA info: " << info_cache_file(file_path);
+      return info;
+    }
+
+    if (is_compressed_fasta(file_path)) {
+      info = compressed_msa_info(file_path);
+    } else {
+      info = MSA_Info(file_path);
+    }
+
+    if (use_cache) {
+      info.offsets(fasta_record_offsets(file_path));
+      if (not info.offsets().empty() and info.offsets().size() != info.sequences()) {
+        // the raw scan disagrees with the parser, do not seek based on it
+        info.offsets({});
+      }
+      save_msa_info_cache(file_path, info);
+    }
   }
   return info;
+}
+
+/**
+ * Like make_msa_info, but without parsing all of a fasta file: the width is taken
+ * from the first record, the number of sequences is left unknown (0), and the gap
+ * mask is empty, such that combining it with the reference via or_mask yields the
+ * mask of the reference alone. Sequence lengths are then validated while streaming.
+ */
+MSA_Info make_streaming_msa_info(const std::string& file_path)
+{
+  // stdin or a pipe: opening it again is not an option, so peek instead
+  if (is_stream_input(file_path)) {
+    const auto sites = Stream_Input::get(file_path).first_sequence_length();
+    return MSA_Info(file_path, 0, MSA_Info::mask_type(sites, false), sites);
+  }
+
+  try {
+    return Binary_Fasta::get_info(file_path);
+  } catch(const std::exception&) {
+    // not a bfast file
+  }
+
+  if (Binary_Fasta_v2::is_bfast_v2(file_path)) {
+    return Binary_Fasta_v2::get_info(file_path);
+  }
+
+  if (is_compressed_fasta(file_path)) {
+    return compressed_msa_info(file_path, true);
+  }
+
+  auto it = genesis::sequence::FastaInputIterator( genesis::utils::from_file(file_path) );
+  if (not it) {
+    throw std::runtime_error{std::string("Cannot read first sequence of file: ") + file_path};
+  }
+  const auto sites = it->length();
+
+  return MSA_Info(file_path, 0, MSA_Info::mask_type(sites, false), sites);
 }
\ No newline at end of file
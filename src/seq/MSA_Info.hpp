@@ -6,6 +6,8 @@
 #include "genesis/sequence/formats/fasta_input_iterator.hpp"
 
 #include <string>
+#include <vector>
+#include <cstdint>
 
 /**
  * Class encompassing info about a MSA File.
@@ -80,6 +82,13 @@ public:
   const mask_type& gap_mask() const {return gap_mask_;}
   size_t gap_count() const {return gap_mask_.count();}
 
+  /**
+   * Byte offsets of the records in the file, if known (see msa_info_cache.hpp).
+   * Empty otherwise.
+   */
+  const std::vector<uint64_t>& offsets() const {return offsets_;}
+  void offsets(std::vector<uint64_t> o) {offsets_ = std::move(o);}
+
 
   static void or_mask(MSA_Info& lhs, MSA_Info& rhs)
   {
@@ -100,6 +109,7 @@ private:
   size_t sites_ = 0;
   size_t sequences_ = 0;
   mask_type gap_mask_;
+  std::vector<uint64_t> offsets_;
 
 };
 
@@ -137,4 +147,5 @@ inline std::ostream& operator << (std::ostream& out, MSA_Info const& rhs)
   return out;
 }
 
-MSA_Info make_msa_info(const std::string& file_path);
+MSA_Info make_msa_info(const std::string& file_path, const bool use_cache = false);
+MSA_Info make_streaming_msa_info(const std::string& file_path);
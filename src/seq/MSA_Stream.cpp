@@ -5,6 +5,16 @@
 #include "util/logging.hpp"
 #include "net/epa_mpi_util.hpp"
 
+#include "genesis/utils/io/input_source.hpp"
+
+static genesis::sequence::FastaReader reader_settings()
+{
+  genesis::sequence::FastaReader settings;
+  // ensure sequences are uniformly upper case
+  settings.site_casing( genesis::sequence::FastaReader::SiteCasing::kToUpper );
+  return settings;
+}
+
 static void read_chunk( MSA_Stream::file_type& iter,
                         const MSA_Info& info,
                         const bool premasking,
@@ -13,7 +23,8 @@ static void read_chunk( MSA_Stream::file_type& iter,
                         const size_t max_read,
                         size_t& num_read)
 {
-  prefetch_buffer.clear();
+  // appends to the buffer, which may still hold sequences left over from the last chunk
+  const auto num_before = prefetch_buffer.size();
 
   auto length = info.sites();
   size_t number_left = std::min(number, max_read - num_read);
@@ -22,7 +33,8 @@ static void read_chunk( MSA_Stream::file_type& iter,
   {
     const auto sequence_length = iter->length();
     if ( length and (length != sequence_length) ) {
-      throw std::runtime_error{"MSA file does not contain equal size sequences"};
+      throw std::runtime_error{"MSA file does not contain equal size sequences! First offending sequence: "
+        + iter->label()};
     }
 
     if (!length) length = sequence_length;
@@ -38,7 +50,7 @@ static void read_chunk( MSA_Stream::file_type& iter,
     ++iter;
   }
 
-  num_read += prefetch_buffer.size();
+  num_read += prefetch_buffer.size() - num_before;
 }
 
 MSA_Stream::MSA_Stream( const std::string& msa_file,
@@ -48,10 +60,7 @@ MSA_Stream::MSA_Stream( const std::string& msa_file,
   : info_(info)
   , premasking_(premasking)
 {
-  genesis::sequence::FastaReader reader_settings;
-  // ensure sequences are uniformly upper case
-  reader_settings.site_casing( genesis::sequence::FastaReader::SiteCasing::kToUpper );
-  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_file( msa_file ), reader_settings );
+  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_file( msa_file ), reader_settings() );
 
   if (!iter_) {
     throw std::runtime_error{std::string("Cannot open file: ") + msa_file};
@@ -72,6 +81,19 @@ MSA_Stream::MSA_Stream( const std::string& msa_file,
 
 }
 
+MSA_Stream::MSA_Stream( std::istream& stream,
+                        const MSA_Info& info,
+                        const bool premasking)
+  : info_(info)
+  , premasking_(premasking)
+{
+  iter_ = genesis::sequence::FastaInputIterator( genesis::utils::from_stream( stream ), reader_settings() );
+
+  if (!iter_) {
+    throw std::runtime_error{std::string("Cannot read a sequence from: ") + info.path()};
+  }
+}
+
 size_t MSA_Stream::read_next( MSA_Stream::container_type& result,
                               const size_t number)
 {
@@ -86,8 +108,23 @@ size_t MSA_Stream::read_next( MSA_Stream::container_type& result,
     prefetcher_.wait();
   }
 #endif
+  // the read-ahead used the chunk size of the previous call: top it up to this one...
+  if (prefetch_chunk_.size() < number) {
+    read_chunk(iter_, info_, premasking_, number - prefetch_chunk_.size(),
+               prefetch_chunk_, max_read_, num_read_);
+  }
+
   // perform pointer swap to data
   std::swap(result, prefetch_chunk_);
+  prefetch_chunk_.clear();
+
+  // ... or keep what it read past it for the next call
+  if (result.size() > number) {
+    const auto surplus = result.begin() + number;
+    prefetch_chunk_.move_sequences(surplus, result.end());
+    result.erase(surplus, result.end());
+  }
+  const auto next_count = number - std::min(number, prefetch_chunk_.size());
 
   // start request next chunk from prefetcher (async)
 #ifdef __PREFETCH
@@ -96,12 +133,12 @@ size_t MSA_Stream::read_next( MSA_Stream::container_type& result,
                             std::ref(iter_),
                             std::ref(info_),
                             premasking_,
-                            number,
+                            next_count,
                             std::ref(prefetch_chunk_),
                             max_read_,
                             std::ref(num_read_));
 #else
-  read_chunk(iter_, info_, premasking_, number, prefetch_chunk_, max_read_, num_read_);
+  read_chunk(iter_, info_, premasking_, next_count, prefetch_chunk_, max_read_, num_read_);
 #endif
   // return size of current buffer
   return result.size();
@@ -140,8 +177,41 @@ void MSA_Stream::skip_to_sequence(const size_t n)
     throw std::runtime_error{"Trying to skip behind!"};
   }
 
+  const auto& offsets = info_.offsets();
+  if (num_read_ == 0 and n < offsets.size()) {
+    // seek right to the record, instead of parsing all preceding ones
+    seek_stream_ = std::make_unique<std::ifstream>( info_.path(), std::ios::binary );
+    seek_stream_->seekg( offsets[n] );
+    if (not *seek_stream_) {
+      throw std::runtime_error{"Could not seek to sequence " + std::to_string(n) + " in " + info_.path()};
+    }
+    iter_ = file_type( genesis::utils::from_stream( *seek_stream_ ), reader_settings() );
+    return;
+  }
+
   size_t offset = n - num_read_;
 
   std::advance(iter_, offset);
 
 }
+
+void MSA_Stream::skip(const size_t n)
+{
+  if (not first_) {
+    throw std::runtime_error{"Skipping currently not allowed after first read!"};
+  }
+  if (n > max_read_ - num_read_) {
+    throw std::runtime_error{"Trying to skip out of bounds!"};
+  }
+
+  const auto target = local_seq_offset_ + num_read_ + n;
+  if (n and target < info_.offsets().size()) {
+    skip_to_sequence(target);
+  } else {
+    // no offset to seek to: parse past them (running out just leaves nothing to read)
+    for (size_t i = 0; i < n and iter_; ++i) {
+      ++iter_;
+    }
+  }
+  num_read_ += n;
+}
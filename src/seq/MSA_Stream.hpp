@@ -5,6 +5,7 @@
 #include <stdexcept>
 #include <memory>
 #include <limits>
+#include <fstream>
 
 #ifdef __PREFETCH
 #include <future>
@@ -26,6 +27,13 @@ public:
               const MSA_Info& info,
               const bool premasking = true,
               const bool split = false);
+  /**
+   * Reads from a stream that can not be rewound (see Stream_Input), which thus can
+   * not be split among ranks.
+   */
+  MSA_Stream (std::istream& stream,
+              const MSA_Info& info,
+              const bool premasking = true);
   MSA_Stream() = default;
   ~MSA_Stream();
 
@@ -36,6 +44,7 @@ public:
   MSA_Stream& operator= (MSA_Stream && other) = default;
 
   size_t read_next(container_type& result, const size_t number) override;
+  void skip(const size_t n) override;
   size_t num_sequences() const override { return info_.sequences(); }
   size_t local_seq_offset() const override { return local_seq_offset_; }
 
@@ -44,6 +53,8 @@ private:
 
 private:
   MSA_Info info_;
+  // only set when seeking to a record offset, as the stream underlying iter_
+  std::unique_ptr<std::ifstream> seek_stream_;
   file_type iter_;
   // container_type active_chunk_;
   container_type prefetch_chunk_;
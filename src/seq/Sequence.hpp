@@ -2,16 +2,17 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 
 class Sequence
 {
 public:
   Sequence()  = default;
   ~Sequence() = default;
-  Sequence(std::string header, std::string sequence) 
-    : sequence_(sequence) 
+  Sequence(std::string header, std::string sequence)
+    : sequence_(std::move(sequence))
   {
-    header_.push_back(header);
+    header_.push_back(std::move(header));
   }
   Sequence(const Sequence& s) = default;
   Sequence(Sequence&& s)      = default;
@@ -82,7 +82,8 @@ void compute_and_set_lwr(Sample<Placement>& sample)
 
 void sort_by_lwr(PQuery<Placement>& pq)
 {
-  sort(pq.begin(), pq.end(),
+  // stable, so placements of equal weight keep their (possibly canonical) order
+  std::stable_sort(pq.begin(), pq.end(),
     [](const Placement &p_a, const Placement &p_b) -> bool {
       return p_a.lwr() > p_b.lwr();
     }
@@ -98,6 +99,36 @@ void sort_by_logl(PQuery<Placement>& pq)
   );
 }
 
+void sort_by_sequence_id(Sample<Placement>& sample)
+{
+  std::sort(sample.begin(), sample.end(),
+    [](const PQuery<Placement>& lhs, const PQuery<Placement>& rhs) -> bool {
+      return lhs.sequence_id() < rhs.sequence_id();
+    }
+  );
+}
+
+void sort_canonically(Sample<Placement>& sample, const size_t num_threads)
+{
+  #ifdef __OMP
+  #pragma omp parallel for schedule(dynamic) num_threads(std::max<size_t>(num_threads, 1u))
+  #else
+  static_cast<void>(num_threads);
+  #endif
+  for (size_t i = 0; i < sample.size(); ++i) {
+    auto& pq = sample[i];
+    std::sort(pq.begin(), pq.end(),
+      [](const Placement &lhs, const Placement &rhs) -> bool {
+        if (lhs.likelihood() != rhs.likelihood()) {
+          return lhs.likelihood() > rhs.likelihood();
+        }
+        return lhs.branch_id() < rhs.branch_id();
+      }
+    );
+  }
+  sort_by_sequence_id(sample);
+}
+
 pq_iter_t until_top_percent( PQuery<Placement>& pq,
                               const double x)
 {
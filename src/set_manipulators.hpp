@@ -19,6 +19,13 @@ void merge(Timer<>& dest, const Timer<>& src);
 
 void sort_by_lwr(PQuery<Placement>& pq);
 void sort_by_logl(PQuery<Placement>& pq);
+void sort_by_sequence_id(Sample<Placement>& sample);
+/**
+ * Orders the placements of every pquery by descending likelihood, then by edge, and
+ * the pqueries by sequence id: an order that does not depend on how many threads
+ * computed them, or in what order. The pqueries are sorted on num_threads threads.
+ */
+void sort_canonically(Sample<Placement>& sample, const size_t num_threads = 1);
 void compute_and_set_lwr(Sample<Placement>& sample);
 pq_iter_t until_top_percent( PQuery<Placement>& pq,
                               const double x);
@@ -0,0 +1,130 @@
+#include "tree/Branch_Distances.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "core/pll/pll_util.hpp"
+
+Branch_Distances::Branch_Distances( std::vector<size_t> const& parents,
+                                    std::vector<double> const& lengths )
+  : lengths_(lengths)
+{
+  if (parents.size() != lengths.size()) {
+    throw std::invalid_argument{"Branch_Distances: need a parent and a length for each branch"};
+  }
+  init_(parents);
+}
+
+Branch_Distances::Branch_Distances( pll_utree_t const * const tree )
+{
+  const size_t num_branches = 2 * tree->tip_count - 3;
+  std::vector<pll_unode_t*> branches(num_branches);
+  utree_query_branches(tree, branches.data());
+
+  std::unordered_map<pll_unode_t const*, size_t> index;
+  for (size_t i = 0; i < num_branches; ++i) {
+    index[branches[i]] = i;
+  }
+
+  // the parent of a branch is the one listed with the node it hangs off of, unless
+  // that node is the root
+  std::vector<size_t> parents(num_branches, num_branches);
+  lengths_.resize(num_branches);
+  for (size_t i = 0; i < num_branches; ++i) {
+    const auto proximal = branches[i]->back;
+    for (auto node : {proximal, proximal->next, proximal->next ? proximal->next->next : nullptr}) {
+      const auto it = node ? index.find(node) : index.end();
+      if (it != index.end()) {
+        parents[i] = it->second;
+      }
+    }
+    lengths_[i] = branches[i]->length;
+  }
+
+  init_(parents);
+}
+
+void Branch_Distances::init_( std::vector<size_t> const& parents )
+{
+  const size_t root = parents.size();
+
+  depth_.assign(root + 1, 0);
+  root_distance_.assign(root + 1, 0.0);
+  ancestors_.assign(1, std::vector<size_t>(root + 1, root));
+
+  // parents come after their children, so going backwards they are done first
+  for (size_t i = root; i-- > 0; ) {
+    const auto parent = parents[i];
+    if (parent <= i or parent > root) {
+      throw std::invalid_argument{"Branch_Distances: branches are not in postorder"};
+    }
+    ancestors_[0][i] = parent;
+    depth_[i] = depth_[parent] + 1;
+    root_distance_[i] = root_distance_[parent] + lengths_[i];
+  }
+
+  const auto max_depth = *std::max_element(depth_.begin(), depth_.end());
+  for (size_t k = 1; (1ul << k) <= max_depth; ++k) {
+    const auto& prev = ancestors_[k - 1];
+    std::vector<size_t> level(root + 1);
+    for (size_t i = 0; i <= root; ++i) {
+      level[i] = prev[prev[i]];
+    }
+    ancestors_.push_back(std::move(level));
+  }
+}
+
+size_t Branch_Distances::lca_( size_t x, size_t y ) const
+{
+  if (depth_[x] < depth_[y]) {
+    std::swap(x, y);
+  }
+  for (size_t k = ancestors_.size(); k-- > 0; ) {
+    if (depth_[x] - depth_[y] >= (1ul << k)) {
+      x = ancestors_[k][x];
+    }
+  }
+  if (x == y) {
+    return x;
+  }
+  for (size_t k = ancestors_.size(); k-- > 0; ) {
+    if (ancestors_[k][x] != ancestors_[k][y]) {
+      x = ancestors_[k][x];
+      y = ancestors_[k][y];
+    }
+  }
+  return ancestors_[0][x];
+}
+
+double Branch_Distances::node_distance_( size_t const x, size_t const y ) const
+{
+  return root_distance_[x] + root_distance_[y] - 2.0 * root_distance_[lca_(x, y)];
+}
+
+double Branch_Distances::distance( size_t const a,
+                                   double const distal_a,
+                                   size_t const b,
+                                   double const distal_b ) const
+{
+  if (a == b) {
+    return std::abs(distal_a - distal_b);
+  }
+
+  // the path leaves each branch through one of its two nodes, and the shortest
+  // of the four combinations is the one taking the right ones
+  const size_t ends_a[2] = {a, ancestors_[0][a]};
+  const double offsets_a[2] = {distal_a, lengths_[a] - distal_a};
+  const size_t ends_b[2] = {b, ancestors_[0][b]};
+  const double offsets_b[2] = {distal_b, lengths_[b] - distal_b};
+
+  double result = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < 2; ++i) {
+    for (size_t j = 0; j < 2; ++j) {
+      result = std::min(result, offsets_a[i] + node_distance_(ends_a[i], ends_b[j]) + offsets_b[j]);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "core/pll/pllhead.hpp"
+
+/**
+ * Path lengths between positions on the branches of the reference tree, as needed
+ * for the EDPL of a pquery.
+ *
+ * Branches are identified by their (unrooted) branch id, that is, their index in the
+ * postorder traversal of utree_query_branches. A position on a branch is given by its
+ * distal length, the distance from the node on the far side of the branch as seen from
+ * the root of that traversal, just like the distal length of a Placement.
+ */
+class Branch_Distances
+{
+public:
+  Branch_Distances() = default;
+
+  /**
+   * parents[i] is the branch leading toward the root from the proximal node of branch i,
+   * or size() for the branches adjacent to the root. Branches must be in postorder, so
+   * that the parent of a branch comes after it.
+   */
+  Branch_Distances( std::vector<size_t> const& parents,
+                    std::vector<double> const& lengths );
+  explicit Branch_Distances( pll_utree_t const * const tree );
+
+  ~Branch_Distances() = default;
+
+  /**
+   * Distance between a position on branch a and one on branch b.
+   */
+  double distance( size_t const a,
+                   double const distal_a,
+                   size_t const b,
+                   double const distal_b ) const;
+
+  size_t size() const { return lengths_.size(); }
+  double length(size_t const branch) const { return lengths_[branch]; }
+
+private:
+  void init_( std::vector<size_t> const& parents );
+  size_t lca_( size_t x, size_t y ) const;
+  double node_distance_( size_t const x, size_t const y ) const;
+
+  // node i is the distal node of branch i, node size() the root
+  std::vector<double> lengths_;
+  std::vector<size_t> depth_;
+  std::vector<double> root_distance_;
+  // ancestors_[k][i]: the 2^k-th ancestor of node i (the root is its own ancestor)
+  std::vector<std::vector<size_t>> ancestors_;
+};
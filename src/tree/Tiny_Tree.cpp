@@ -14,6 +14,7 @@
 #include "tree/Tree_Numbers.hpp"
 #include "set_manipulators.hpp"
 #include "util/logging.hpp"
+#include "util/Timer.hpp"
 
 static void precompute_sites_static(char nt,
                                     std::vector<double>& result,
@@ -72,6 +73,9 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
   , branch_id_(branch_id)
   , lookup_(lookup_store)
 {
+  Stats::count(Stat_Counter::kTinyTrees);
+  Phase_Timer setup_time(Stat_Phase::kTinyTree);
+
   assert(edge_node);
   original_branch_length_ = edge_node->length;
 
@@ -136,10 +140,15 @@ Tiny_Tree::Tiny_Tree( pll_unode_t * edge_node,
   // use update_partials to compute the clv pointing toward the new tip
   pll_update_partials(partition_.get(), &op, 1);
 
+  setup_time.stop();
+
   if (not opt_branches) {
     const std::lock_guard<std::mutex> lock(lookup_store->get_mutex(branch_id));
 
     if (not lookup_store->has_branch(branch_id)) {
+      Stats::count(Stat_Counter::kLookupBuilds);
+      Phase_Timer lookup_time(Stat_Phase::kLookup);
+
       const auto size = lookup_store->char_map_size();
 
       // precompute all possible site likelihoods
@@ -160,6 +169,8 @@ Placement Tiny_Tree::place(const Sequence &s)
   assert(partition_);
   assert(tree_);
 
+  Stats::count(Stat_Counter::kPlacements);
+
   const auto inner    = tree_->nodes[3];
   const auto distal   = tree_->nodes[1];
   const auto proximal = tree_->nodes[0];
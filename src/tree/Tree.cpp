@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <numeric>
 
 #include "core/pll/epa_pll_util.hpp"
@@ -12,12 +13,14 @@
 #include "set_manipulators.hpp"
 #include "util/logging.hpp"
 #include "util/stringify.hpp"
+#include "util/Timer.hpp"
 
 Tree::Tree( const std::string &tree_file,
             const MSA &msa,
             raxml::Model &model,
             const Options& options)
-  : ref_msa_(msa)
+  : source_file_(tree_file)
+  , ref_msa_(msa)
   , model_(model)
   , options_(options)
 {
@@ -77,7 +80,8 @@ Tree::Tree( const std::string &tree_file,
 Tree::Tree( const std::string& bin_file,
             raxml::Model& model,
             const Options& options)
-  : model_(model)
+  : source_file_(bin_file)
+  , model_(model)
   , options_(options)
   , binary_(bin_file)
 {
@@ -120,6 +124,7 @@ void* Tree::get_clv(const pll_unode_t* node)
     if (options_.load_binary_mode
         and clv_ptr == nullptr) {
       binary_.load_tipchars(partition_.get(), i);
+      Stats::count(Stat_Counter::kCLVLoads);
       clv_ptr = partition_->tipchars[i];
     }
   } else {
@@ -128,6 +133,7 @@ void* Tree::get_clv(const pll_unode_t* node)
     if (options_.load_binary_mode
         and clv_ptr == nullptr) {
       binary_.load_clv(partition_.get(), i);
+      Stats::count(Stat_Counter::kCLVLoads);
       clv_ptr = partition_->clv[i];
     }
   }
@@ -142,6 +148,89 @@ void* Tree::get_clv(const pll_unode_t* node)
   return clv_ptr;
 }
 
+/**
+  Builds an independent copy of this tree. All of its memory is written first by the
+  calling thread, which under first-touch places it on that thread's NUMA node.
+  Nothing expensive is redone: the tip states are set from the reference MSA, while
+  the precomputed CLVs and scalers are copied over. In binary mode the copy loads
+  its CLVs from file on demand.
+
+  Only reads from this tree, so several replicas may be built concurrently. The copy
+  does not keep the reference MSA, and can not be replicated itself.
+*/
+Tree Tree::replicate()
+{
+  if (options_.load_binary_mode) {
+    return Tree(source_file_, model_, options_);
+  }
+
+  auto const source = partition_.get();
+  if (source->attributes & PLL_ATTRIB_SITE_REPEATS) {
+    throw std::runtime_error{"Replicating a tree that uses site repeats is not supported"};
+  }
+  if (ref_msa_.size() == 0) {
+    throw std::runtime_error{"Replicating a tree without its reference MSA"};
+  }
+
+  Tree copy;
+  copy.nums_        = nums_;
+  copy.source_file_ = source_file_;
+  copy.model_       = model_;
+  copy.options_     = options_;
+  copy.mapper_      = mapper_;
+
+  copy.tree_ = utree_ptr(clone_utree(tree_.get()), utree_destroy);
+  copy.partition_ = partition_ptr( make_partition( copy.model_,
+                                                   copy.nums_,
+                                                   source->sites,
+                                                   copy.options_ ),
+                                   pll_partition_destroy);
+  auto const target = copy.partition_.get();
+  copy.locks_ = Mutex_List(target->tips + target->clv_buffers);
+
+  link_tree_msa(copy.tree_.get(),
+                target,
+                copy.model_,
+                ref_msa_,
+                nums_.tip_nodes);
+
+  // the transition matrices, which also sets up the eigen decomposition shared
+  // with the tiny trees
+  std::vector<pll_unode_t*> branches(nums_.branches);
+  const auto num_branches = utree_query_branches(copy.tree_.get(), &branches[0]);
+  std::vector<unsigned int> param_indices(target->rate_cats, 0);
+  std::vector<unsigned int> matrix_indices(num_branches);
+  std::vector<double> branch_lengths(num_branches);
+  for (size_t i = 0; i < num_branches; ++i) {
+    matrix_indices[i] = branches[i]->pmatrix_index;
+    branch_lengths[i] = branches[i]->length;
+  }
+  pll_update_prob_matrices(target,
+                           &param_indices[0],
+                           &matrix_indices[0],
+                           &branch_lengths[0],
+                           num_branches);
+
+  // the inner CLVs and their scalers, as computed by precompute_clvs
+  for (size_t i = source->tips; i < source->tips + source->clv_buffers; ++i) {
+    memcpy(target->clv[i],
+           source->clv[i],
+           pll_get_clv_size(source, i) * sizeof(double));
+  }
+  const size_t scaler_size = (source->attributes & PLL_ATTRIB_RATE_SCALERS)
+                           ? source->sites * source->rate_cats
+                           : source->sites;
+  for (size_t i = 0; i < source->scale_buffers; ++i) {
+    if (source->scale_buffer[i] and target->scale_buffer[i]) {
+      memcpy(target->scale_buffer[i],
+             source->scale_buffer[i],
+             scaler_size * sizeof(unsigned int));
+    }
+  }
+
+  return copy;
+}
+
 double Tree::ref_tree_logl()
 {
   std::vector<unsigned int> param_indices(partition_->rate_cats, 0);
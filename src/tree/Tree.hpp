@@ -48,6 +48,8 @@ public:
 
   void * get_clv(const pll_unode_t*);
 
+  Tree replicate();
+
   double ref_tree_logl();
 
 private:
@@ -60,6 +62,7 @@ private:
   Tree_Numbers nums_;
 
   // epa related classes
+  std::string source_file_;
   MSA ref_msa_;
   raxml::Model model_;
   Options options_;
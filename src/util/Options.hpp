@@ -29,6 +29,8 @@ public:
   bool dump_binary_mode         = false;
   bool load_binary_mode         = false;
   unsigned int chunk_size       = 5000;
+  bool auto_chunk_size          = false;
+  size_t chunk_memory           = 0;
   unsigned int num_threads      = 0;
   bool repeats                  = false;
   bool premasking               = true;
@@ -37,4 +39,29 @@ public:
   unsigned int precision        = 10;
   NumericalScaling scaling      = NumericalScaling::kAuto;
   bool preserve_rooting         = true;
+  bool numa                     = false;
+  bool pipeline                 = false;
+  unsigned int pipeline_depth   = 2;
+  unsigned int prescore_threads = 0;
+  unsigned int thorough_threads = 0;
+  bool overlap_chunks           = false;
+  bool stats                    = false;
+  bool single_pass              = false;
+  bool info_cache               = false;
+  bool mmap_queries             = false;
+  unsigned int parse_threads    = 1;
+  bool dedup                    = false;
+  size_t dedup_memory           = 1024;
+  std::string out_compress      = "none";
+  std::string out_format        = "jplace";
+  bool summary                  = false;
+  bool rank_files               = false;
+  size_t out_buffer             = 8;
+  unsigned int out_threads      = 0;
+  bool deterministic            = false;
+  bool checkpoint               = false;
+  bool resume                   = false;
+  std::string shard_regex;
+  std::string shard_map;
+  bool shard_chunks             = false;
 };
@@ -2,7 +2,15 @@
 
 #include <chrono>
 #include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
 #include <algorithm>
+#include <numeric>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/chrono.hpp>
 
@@ -94,6 +102,11 @@ public:
     return this->sum_duration()/ts_.size(); 
   }
 
+  duration last_duration() const
+  {
+    return ts_.empty() ? duration(0) : ts_.back();
+  }
+
   double average() const
   {
     return this->sum()/ts_.size();
@@ -113,3 +126,270 @@ private:
   clock::time_point pause_start_;
   std::vector<duration> pauses_;
 };
+
+/**
+ * Events counted by the hot path instrumentation (see Stats).
+ */
+enum class Stat_Counter : size_t {
+  kPlacements = 0,
+  kNewtonIterations,
+  kTinyTrees,
+  kLookupBuilds,
+  kCLVLoads,
+  kNumCounters
+};
+
+/**
+ * Phases timed by the hot path instrumentation (see Stats). Phases do not nest:
+ * lookup construction is not part of the Tiny_Tree setup time, and so on.
+ */
+enum class Stat_Phase : size_t {
+  kRead = 0,
+  kTinyTree,
+  kLookup,
+  kPrescore,
+  kBLO,
+  kLWRFilter,
+  kOutput,
+  kNumPhases
+};
+
+/**
+ * Counters and phase times of one thread.
+ */
+struct Thread_Stats
+{
+  static constexpr size_t num_counters  = static_cast<size_t>(Stat_Counter::kNumCounters);
+  static constexpr size_t num_phases    = static_cast<size_t>(Stat_Phase::kNumPhases);
+
+  std::array<size_t, num_counters> counts{};
+  std::array<std::chrono::nanoseconds, num_phases> times{};
+
+  Thread_Stats& operator+= (const Thread_Stats& other)
+  {
+    for (size_t i = 0; i < num_counters; ++i) {
+      counts[i] += other.counts[i];
+    }
+    for (size_t i = 0; i < num_phases; ++i) {
+      times[i] += other.times[i];
+    }
+    return *this;
+  }
+};
+
+/**
+ * Process wide, low overhead instrumentation of the hot paths.
+ *
+ * Every thread accumulates into its own Thread_Stats, so counting needs neither
+ * locks nor atomics. The records are owned by a registry that outlives the threads,
+ * such that a summary can be taken after the worker threads have finished.
+ * Disabled by default, in which case count() and Phase_Timer do nothing.
+ */
+class Stats
+{
+public:
+  static void enable(const bool on = true) { enabled_() = on; }
+  static bool enabled() { return enabled_(); }
+
+  static void count(const Stat_Counter c, const size_t n = 1u)
+  {
+    if (enabled()) {
+      local().counts[static_cast<size_t>(c)] += n;
+    }
+  }
+
+  static void add_time(const Stat_Phase p, const std::chrono::nanoseconds t)
+  {
+    local().times[static_cast<size_t>(p)] += t;
+  }
+
+  /**
+   * The record of the calling thread.
+   */
+  static Thread_Stats& local()
+  {
+    thread_local Thread_Stats* record = register_thread_();
+    return *record;
+  }
+
+  /**
+   * Copy of all per-thread records, in order of first use. Only meaningful while no
+   * other thread is counting.
+   */
+  static std::vector<Thread_Stats> threads()
+  {
+    std::lock_guard<std::mutex> lock(mutex_());
+    std::vector<Thread_Stats> result;
+    for (auto& r : registry_()) {
+      result.push_back(*r);
+    }
+    return result;
+  }
+
+  static Thread_Stats total()
+  {
+    Thread_Stats result;
+    for (auto& t : threads()) {
+      result += t;
+    }
+    return result;
+  }
+
+  static void reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex_());
+    for (auto& r : registry_()) {
+      *r = Thread_Stats();
+    }
+  }
+
+  static const char* name(const Stat_Counter c)
+  {
+    static const char* names[] = { "placements", "newton_iterations", "tiny_trees",
+                                   "lookup_builds", "clv_loads" };
+    return names[static_cast<size_t>(c)];
+  }
+
+  static const char* name(const Stat_Phase p)
+  {
+    static const char* names[] = { "read", "tiny_tree", "lookup", "prescore", "blo",
+                                   "lwr_filter", "output" };
+    return names[static_cast<size_t>(p)];
+  }
+
+  /**
+   * Machine readable summary: totals and per-thread counters and phase times (in
+   * seconds), along with the rank and the given wall time.
+   */
+  static std::string to_json(const int rank = 0,
+                             const double wall_time = 0.0)
+  {
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"rank\": " << rank << ",\n";
+    out << "  \"wall_time\": " << wall_time << ",\n";
+    out << "  \"total\": ";
+    record_to_json_(out, total());
+    out << ",\n  \"threads\": [";
+    // threads that never counted anything (e.g. short lived helpers) are left out
+    bool first = true;
+    for (auto& record : threads()) {
+      if (empty_(record)) {
+        continue;
+      }
+      out << (first ? "\n    " : ",\n    ");
+      record_to_json_(out, record);
+      first = false;
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+  }
+
+  static void write_json(const std::string& file_name,
+                         const int rank = 0,
+                         const double wall_time = 0.0)
+  {
+    std::ofstream out(file_name);
+    if (not out) {
+      throw std::runtime_error{std::string("Could not open stats file: ") + file_name};
+    }
+    out << to_json(rank, wall_time);
+  }
+
+private:
+  static void record_to_json_(std::ostream& out, const Thread_Stats& record)
+  {
+    out << "{ \"counters\": { ";
+    for (size_t i = 0; i < Thread_Stats::num_counters; ++i) {
+      out << (i ? ", " : "") << "\"" << name(static_cast<Stat_Counter>(i)) << "\": "
+          << record.counts[i];
+    }
+    out << " }, \"phases\": { ";
+    for (size_t i = 0; i < Thread_Stats::num_phases; ++i) {
+      const std::chrono::duration<double> seconds = record.times[i];
+      out << (i ? ", " : "") << "\"" << name(static_cast<Stat_Phase>(i)) << "\": "
+          << seconds.count();
+    }
+    out << " } }";
+  }
+
+  static bool empty_(const Thread_Stats& record)
+  {
+    return std::all_of(record.counts.begin(), record.counts.end(), [](size_t c){ return c == 0; })
+      and std::all_of(record.times.begin(), record.times.end(), [](std::chrono::nanoseconds t){
+        return t.count() == 0;
+      });
+  }
+
+  static Thread_Stats* register_thread_()
+  {
+    std::lock_guard<std::mutex> lock(mutex_());
+    registry_().push_back(std::make_unique<Thread_Stats>());
+    return registry_().back().get();
+  }
+
+  static bool& enabled_()
+  {
+    static bool on = false;
+    return on;
+  }
+
+  static std::mutex& mutex_()
+  {
+    static std::mutex m;
+    return m;
+  }
+
+  static std::vector<std::unique_ptr<Thread_Stats>>& registry_()
+  {
+    static std::vector<std::unique_ptr<Thread_Stats>> r;
+    return r;
+  }
+};
+
+/**
+ * Adds the time from construction until stop() or destruction to the given phase
+ * of the calling thread. Time spent in other phases timed meanwhile (such as the
+ * Tiny_Tree setups within a placement loop) is left out, so phases do not nest.
+ */
+class Phase_Timer
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit Phase_Timer(const Stat_Phase phase)
+    : phase_(phase)
+    , running_(Stats::enabled())
+  {
+    if (running_) {
+      nested_ = timed_();
+      start_ = clock::now();
+    }
+  }
+
+  ~Phase_Timer() { stop(); }
+
+  Phase_Timer(Phase_Timer const& other) = delete;
+  Phase_Timer& operator= (Phase_Timer const& other) = delete;
+
+  void stop()
+  {
+    if (running_) {
+      const auto elapsed = clock::now() - start_;
+      Stats::add_time(phase_, elapsed - (timed_() - nested_));
+      running_ = false;
+    }
+  }
+
+private:
+  static std::chrono::nanoseconds timed_()
+  {
+    const auto& times = Stats::local().times;
+    return std::accumulate(times.begin(), times.end(), std::chrono::nanoseconds(0));
+  }
+
+  Stat_Phase phase_;
+  bool running_;
+  clock::time_point start_;
+  std::chrono::nanoseconds nested_{0};
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef __NUMA
+#include <numa.h>
+#include <sched.h>
+#endif
+
+/**
+ * Thin wrappers around libnuma. When built without NUMA support (see ENABLE_NUMA)
+ * these degrade to a single node and no-op pinning, so callers need no ifdefs.
+ */
+
+static inline size_t get_num_numa_nodes()
+{
+  #ifdef __NUMA
+  if ( numa_available() < 0 ) {
+    return 1;
+  }
+  const int nodes = numa_num_configured_nodes();
+  return nodes > 0 ? static_cast<size_t>( nodes ) : 1;
+  #else
+  return 1;
+  #endif
+}
+
+/**
+ * Map a thread id onto a NUMA node such that consecutive threads share a node,
+ * i.e. threads [0, n/k) go to node 0, [n/k, 2n/k) to node 1, and so on.
+ */
+static inline size_t get_numa_node( const size_t tid,
+                                    const size_t num_threads,
+                                    const size_t num_nodes )
+{
+  if ( num_nodes <= 1 or num_threads == 0 ) {
+    return 0;
+  }
+  return ( tid * num_nodes ) / num_threads;
+}
+
+/**
+ * The node the calling thread currently runs on, as an index into [0, num_nodes).
+ * Unlike get_numa_node this holds for any thread, whichever team it is part of.
+ * Threads running on a node without a replica (when there are fewer replicas than
+ * nodes) map to the nearest one by NUMA distance.
+ */
+static inline size_t current_numa_node( const size_t num_nodes )
+{
+  #ifdef __NUMA
+  if ( num_nodes > 1 ) {
+    const int cpu  = sched_getcpu();
+    const int node = cpu < 0 ? -1 : numa_node_of_cpu( cpu );
+    if ( node >= 0 and static_cast<size_t>( node ) < num_nodes ) {
+      return static_cast<size_t>( node );
+    }
+    if ( node >= 0 ) {
+      size_t nearest = 0;
+      for ( size_t i = 1; i < num_nodes; ++i ) {
+        if ( numa_distance( node, static_cast<int>( i ) )
+           < numa_distance( node, static_cast<int>( nearest ) ) ) {
+          nearest = i;
+        }
+      }
+      return nearest;
+    }
+  }
+  #endif
+  static_cast<void>( num_nodes );
+  return 0;
+}
+
+/**
+ * Restrict the calling thread to the CPUs of the given node, and make it prefer
+ * allocating memory there. Returns false if pinning was not possible.
+ */
+static inline bool pin_to_numa_node( const size_t node )
+{
+  #ifdef __NUMA
+  if ( numa_available() < 0 ) {
+    return false;
+  }
+  numa_set_preferred( static_cast<int>( node ) );
+  return numa_run_on_node( static_cast<int>( node ) ) == 0;
+  #else
+  static_cast<void>( node );
+  return false;
+  #endif
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <algorithm>
+
+#ifdef __OMP
+#include <omp.h>
+#endif
+
+/**
+ * Keeps the first exception thrown by any of several threads, to be rethrown once
+ * they are done: exceptions must not escape an OpenMP region or a std::thread.
+ */
+class First_Error
+{
+public:
+  First_Error() = default;
+  ~First_Error() = default;
+
+  First_Error(First_Error const& other) = delete;
+  First_Error& operator= (First_Error const& other) = delete;
+
+  /**
+   * To be called from within a catch block.
+   */
+  void capture()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (not error_) {
+      error_ = std::current_exception();
+    }
+  }
+
+  void rethrow() const
+  {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+private:
+  std::exception_ptr error_ = nullptr;
+  std::mutex mutex_;
+};
+
+enum class Schedule { kStatic, kDynamic };
+
+/**
+ * Runs body(i) for every i in [begin, end) across num_threads OpenMP threads, and
+ * rethrows the first exception any of them threw. Runs sequentially without OpenMP.
+ */
+template <class Function>
+void parallel_for( const size_t begin,
+                   const size_t end,
+                   const size_t num_threads,
+                   Function body,
+                   const Schedule schedule = Schedule::kStatic )
+{
+  First_Error error;
+  auto guarded = [&]( const size_t i ) {
+    try {
+      body( i );
+    } catch (...) {
+      error.capture();
+    }
+  };
+
+  #ifdef __OMP
+  const int threads = static_cast<int>( std::max<size_t>( num_threads, 1u ) );
+  if ( schedule == Schedule::kDynamic ) {
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for ( size_t i = begin; i < end; ++i ) {
+      guarded( i );
+    }
+  } else {
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for ( size_t i = begin; i < end; ++i ) {
+      guarded( i );
+    }
+  }
+  #else
+  static_cast<void>( num_threads );
+  static_cast<void>( schedule );
+  for ( size_t i = begin; i < end; ++i ) {
+    guarded( i );
+  }
+  #endif
+
+  error.rethrow();
+}
@@ -0,0 +1,72 @@
+/**
+ * Compares the stream based and the buffer based jplace serialization of a large
+ * sample. Not part of the unit tests, run it through `make jplace_bench`.
+ */
+
+#include "io/jplace_util.hpp"
+#include "core/pll/rtree_mapper.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+
+static Sample<Placement> random_sample(const size_t num_pqueries, const size_t per_pquery)
+{
+  std::mt19937_64 gen(42);
+  std::uniform_real_distribution<double> like(-50000.0, -100.0);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  Sample<Placement> sample;
+  for (size_t i = 0; i < num_pqueries; ++i) {
+    PQuery<Placement> pq(i, "query_" + std::to_string(i));
+    for (size_t j = 0; j < per_pquery; ++j) {
+      pq.emplace_back(gen() % 5000, like(gen), unit(gen), unit(gen) * 0.1);
+      pq.back().lwr(unit(gen));
+    }
+    sample.push_back(std::move(pq));
+  }
+  return sample;
+}
+
+int main(int argc, char** argv)
+{
+  const size_t num_pqueries = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+  const unsigned int precision = 10;
+
+  const auto sample = random_sample(num_pqueries, 7);
+
+  using clock = std::chrono::steady_clock;
+  using ms = std::chrono::duration<double, std::milli>;
+
+  const auto t0 = clock::now();
+  std::ostringstream ss;
+  ss.precision(precision);
+  ss.setf(std::ios::fixed, std::ios::floatfield);
+  sample_to_jplace_string(sample, ss, rtree_mapper());
+  const auto stream_str = ss.str();
+
+  const auto t1 = clock::now();
+  std::string buffer;
+  sample_to_jplace_buffer(sample, buffer, rtree_mapper(), precision);
+
+  const auto t2 = clock::now();
+  std::string parallel;
+  sample_to_jplace_buffer(sample, parallel, rtree_mapper(), precision, 0);
+  const auto t3 = clock::now();
+
+  if (stream_str != buffer or stream_str != parallel) {
+    std::cerr << "Serializations differ!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "jplace serialization of " << sample.size() << " pqueries: "
+            << "stream " << ms(t1 - t0).count() << " ms, "
+            << "buffer " << ms(t2 - t1).count() << " ms, "
+            << "threaded buffer " << ms(t3 - t2).count() << " ms" << std::endl;
+
+  return EXIT_SUCCESS;
+}
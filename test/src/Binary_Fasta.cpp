@@ -6,6 +6,9 @@
 
 #include "genesis/utils/core/options.hpp"
 
+#include <fstream>
+#include <sstream>
+
 static void compare_msas(const MSA& lhs, const MSA& rhs)
 {
   ASSERT_EQ(lhs.size(), rhs.size());
@@ -66,3 +69,52 @@ TEST(Binary_Fasta, reader)
 
   }
 }
+
+TEST(Binary_Fasta, streaming_conversion)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string saved_file(env->out_dir + "saved.bfast");
+
+  // the streaming conversion must produce the same file as saving the full MSA
+  auto msa = build_MSA_from_file(orig_file, MSA_Info(orig_file));
+  Binary_Fasta::save(msa, saved_file);
+  const auto expected = slurp(saved_file);
+
+  for (const size_t threads : {1u, 4u}) {
+    auto converted_file = Binary_Fasta::fasta_to_bfast(orig_file, env->out_dir, threads);
+    EXPECT_TRUE(expected == slurp(converted_file)) << "threads: " << threads;
+  }
+}
+
+TEST(Binary_Fasta, reader_mmap_and_threads)
+{
+  genesis::utils::Options::get().allow_file_overwriting(true);
+
+  const std::string orig_file(env->combined_file);
+  const std::string binfile_name(orig_file + ".bin");
+
+  MSA_Info info(orig_file);
+  auto msa = build_MSA_from_file(orig_file, info);
+  Binary_Fasta::save(msa, binfile_name);
+
+  for (const bool use_mmap : {false, true}) {
+    Binary_Fasta_Reader reader(binfile_name, info, false, false, use_mmap, 4);
+
+    // varying chunk sizes, so that prefetched chunks are sometimes of no use
+    const std::vector<size_t> chunk_sizes = {3, 3, 7, 1, 5};
+    MSA read_msa;
+    size_t i = 0;
+    size_t c = 0;
+    size_t num_sequences = 0;
+    while ( (num_sequences = reader.read_next(read_msa, chunk_sizes[c++ % chunk_sizes.size()])) != 0 ) {
+      for( size_t k = 0; k < num_sequences; ++k ) {
+        EXPECT_STREQ(msa[i+k].header().c_str(), read_msa[k].header().c_str());
+        EXPECT_STREQ(msa[i+k].sequence().c_str(), read_msa[k].sequence().c_str());
+      }
+      i += num_sequences;
+    }
+    EXPECT_EQ(i, msa.size());
+  }
+}
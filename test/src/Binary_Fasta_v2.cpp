@@ -0,0 +1,117 @@
+#include "Epatest.hpp"
+
+#include "io/Binary_Fasta_v2.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include <string>
+#include <fstream>
+
+using namespace std;
+
+static void compare_reader(Binary_Fasta_v2_Reader& reader, const MSA& msa, const size_t chunk_size)
+{
+  MSA chunk;
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = reader.read_next(chunk, chunk_size))) {
+    ASSERT_EQ(n, chunk.size());
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(msa[num_read + i].header(), chunk[i].header());
+      EXPECT_EQ(msa[num_read + i].sequence(), chunk[i].sequence());
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(num_read, msa.size());
+}
+
+TEST(Binary_Fasta_v2, convert_and_read)
+{
+  MSA_Info info(env->combined_file);
+  auto file = Binary_Fasta_v2::fasta_to_bfast(env->combined_file, env->out_dir, 7, 4);
+
+  ASSERT_TRUE(Binary_Fasta_v2::is_bfast_v2(file));
+
+  // the info is computed while converting
+  auto v2_info = Binary_Fasta_v2::get_info(file);
+  EXPECT_EQ(info.sequences(), v2_info.sequences());
+  EXPECT_EQ(info.sites(), v2_info.sites());
+  EXPECT_EQ(info.gap_mask(), v2_info.gap_mask());
+
+  // chunks not aligned to blocks, serially and with parallel block decoding
+  Binary_Fasta_v2_Reader serial(file, info, false, false, 1);
+  compare_reader(serial, build_MSA_from_file(env->combined_file, info, false), 5);
+
+  Binary_Fasta_v2_Reader masked(file, info, true, false, 4);
+  compare_reader(masked, build_MSA_from_file(env->combined_file, info, true), 16);
+}
+
+TEST(Binary_Fasta_v2, random_access)
+{
+  MSA_Info info(env->combined_file);
+  auto msa = build_MSA_from_file(env->combined_file, info, false);
+  auto file = Binary_Fasta_v2::fasta_to_bfast(env->combined_file, env->out_dir, 7, 1);
+
+  Binary_Fasta_v2 bfast(file);
+  ASSERT_EQ(bfast.blocks().size(), (msa.size() + 6) / 7);
+
+  // decode blocks back to front
+  for (size_t i = msa.size(); i-- > 0; ) {
+    const auto b = bfast.block_of(i);
+    const auto& block = bfast.blocks()[b];
+    ASSERT_LE(block.first_sequence, i);
+    ASSERT_LT(i, block.first_sequence + block.num_sequences);
+
+    auto seqs = bfast.decode_block(b, MSA_Info::mask_type());
+    const auto& s = seqs[i - block.first_sequence];
+    EXPECT_EQ(msa[i].header(), s.header());
+    EXPECT_EQ(msa[i].sequence(), s.sequence());
+  }
+
+  EXPECT_ANY_THROW(bfast.block_of(msa.size()));
+}
+
+TEST(Binary_Fasta_v2, checksum)
+{
+  auto file = Binary_Fasta_v2::fasta_to_bfast(env->combined_file, env->out_dir, 7, 1);
+
+  size_t offset = 0;
+  {
+    Binary_Fasta_v2 bfast(file);
+    const auto& block = bfast.blocks()[1];
+    offset = block.offset + block.stored_size / 2;
+  }
+
+  // flip a byte in the middle of the second block
+  fstream f(file, ios::in | ios::out | ios::binary);
+  f.seekg(offset);
+  char c = f.get();
+  f.seekp(offset);
+  f.put(~c);
+  f.close();
+
+  Binary_Fasta_v2 bfast(file);
+  EXPECT_NO_THROW(bfast.decode_block(0, MSA_Info::mask_type()));
+  EXPECT_ANY_THROW(bfast.decode_block(1, MSA_Info::mask_type()));
+}
+
+TEST(Binary_Fasta_v2, amino_acids)
+{
+  const auto aa_file = env->out_dir + "aa_query.fasta";
+  {
+    ofstream out(aa_file);
+    out << ">a\nMKVLAAGIVG\n>b\nMKV-AAGIEG\n>c\nmkqlaa-ivg\n";
+  }
+
+  auto file = Binary_Fasta_v2::fasta_to_bfast(aa_file, env->out_dir, 2, 1);
+
+  MSA_Info info(aa_file);
+  Binary_Fasta_v2_Reader reader(file, info, false);
+  MSA msa;
+  ASSERT_EQ(reader.read_next(msa, 10), 3u);
+  EXPECT_EQ(msa[0].sequence(), "MKVLAAGIVG");
+  EXPECT_EQ(msa[1].sequence(), "MKV-AAGIEG");
+  EXPECT_EQ(msa[2].header(), "c");
+  EXPECT_EQ(msa[2].sequence(), "MKQLAA-IVG");
+}
@@ -0,0 +1,78 @@
+#include "Epatest.hpp"
+
+#include "io/Binary_Placement.hpp"
+#include "io/jplace_writer.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace std;
+
+TEST(Binary_Placement, convert_matches_jplace)
+{
+  const string tree("(a:1,b:2){0};");
+  const string invocation("epa-ng --test");
+  const vector<pair<size_t, size_t>> chunks = {{0, 10}, {10, 0}, {10, 300}, {310, 1}};
+
+  {
+    jplace_writer jplace(env->out_dir, "bplace_test.jplace", tree, invocation, rtree_mapper());
+    jplace.set_precision(8);
+    Binary_Placement_Writer bplace(env->out_dir, "bplace_test.bplace", tree, invocation, rtree_mapper(), 8);
+    for (const auto& c : chunks) {
+      auto sample = make_sample(c.first, c.second);
+      jplace.write(sample);
+      sample = make_sample(c.first, c.second);
+      bplace.write(sample);
+    }
+  }
+
+  const auto bplace_file = env->out_dir + "bplace_test.bplace";
+  EXPECT_TRUE(Binary_Placement::is_binary_placement(bplace_file));
+  EXPECT_FALSE(Binary_Placement::is_binary_placement(env->out_dir + "bplace_test.jplace"));
+
+  remove((env->out_dir + "converted_bplace_test.jplace").c_str());
+  const auto out_file = Binary_Placement::convert(bplace_file, env->out_dir + "converted_");
+  EXPECT_EQ(out_file, env->out_dir + "converted_bplace_test.jplace");
+  EXPECT_EQ(slurp(out_file), slurp(env->out_dir + "bplace_test.jplace"));
+}
+
+TEST(Binary_Placement, random_access)
+{
+  {
+    Binary_Placement_Writer bplace(env->out_dir, "bplace_blocks.bplace", "(a,b){0};", "", rtree_mapper(), 6);
+    for (size_t b = 0; b < 4; ++b) {
+      auto sample = make_sample(b * 50, 50);
+      bplace.write(sample);
+    }
+  }
+
+  Binary_Placement bplace(env->out_dir + "bplace_blocks.bplace");
+  EXPECT_EQ(bplace.tree(), "(a,b){0};");
+  EXPECT_EQ(bplace.precision(), 6u);
+  ASSERT_EQ(bplace.blocks().size(), 4u);
+  EXPECT_EQ(bplace.num_pqueries(), 200u);
+  EXPECT_EQ(bplace.block_of(0), 0u);
+  EXPECT_EQ(bplace.block_of(149), 2u);
+  EXPECT_EQ(bplace.block_of(150), 3u);
+  EXPECT_ANY_THROW(bplace.block_of(200));
+
+  const auto block = bplace.read_block(2);
+  const auto expected = make_sample(100, 50);
+  ASSERT_EQ(block.size(), expected.size());
+  for (size_t i = 0; i < block.size(); ++i) {
+    EXPECT_EQ(block.at(i).sequence_id(), expected.at(i).sequence_id());
+    EXPECT_EQ(block.at(i).header(), expected.at(i).header());
+    EXPECT_EQ(block.at(i).duplicates(), expected.at(i).duplicates());
+    ASSERT_EQ(block.at(i).size(), expected.at(i).size());
+    for (size_t p = 0; p < block.at(i).size(); ++p) {
+      EXPECT_EQ(block.at(i).at(p).branch_id(), expected.at(i).at(p).branch_id());
+      EXPECT_DOUBLE_EQ(block.at(i).at(p).likelihood(), expected.at(i).at(p).likelihood());
+      EXPECT_DOUBLE_EQ(block.at(i).at(p).lwr(), expected.at(i).at(p).lwr());
+      EXPECT_DOUBLE_EQ(block.at(i).at(p).distal_length(), expected.at(i).at(p).distal_length());
+      EXPECT_DOUBLE_EQ(block.at(i).at(p).pendant_length(), expected.at(i).at(p).pendant_length());
+    }
+  }
+}
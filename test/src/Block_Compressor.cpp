@@ -0,0 +1,108 @@
+#include "Epatest.hpp"
+
+#include "io/Block_Compressor.hpp"
+#include "io/Block_Decompressor.hpp"
+#include "io/jplace_writer.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <random>
+
+using namespace std;
+
+static string decompress_file(const string& file_name, const size_t threads)
+{
+  Block_Decompressor decompressor(file_name, threads);
+  string result;
+  while (decompressor.read(result)) {}
+  return result;
+}
+
+// several blocks of somewhat compressible text
+static string make_text()
+{
+  mt19937 gen(1);
+  string text;
+  while (text.size() < 300000) {
+    text += "    {\"p\": [[" + to_string(gen() % 1000) + ", -" + to_string(gen()) + ".1234]]}\n";
+  }
+  return text;
+}
+
+static void round_trip(const Block_Compressor::Format format, const Block_Decompressor::Format expected)
+{
+  const auto text = make_text();
+  const auto file_name = env->out_dir + "blocks" + Block_Compressor::extension(format);
+
+  for (size_t threads : {1u, 4u}) {
+    Block_Compressor compressor(format, threads);
+
+    // written piece by piece, as the jplace writer does
+    string out;
+    compressor.compress(text.substr(0, 1000), out);
+    compressor.compress(text.substr(1000), out);
+    compressor.compress("", out);
+    out += compressor.finish();
+    {
+      ofstream file(file_name, ios::binary);
+      file << out;
+    }
+
+    EXPECT_EQ(Block_Decompressor::detect(file_name), expected);
+    EXPECT_EQ(decompress_file(file_name, 1), text);
+    EXPECT_EQ(decompress_file(file_name, 3), text);
+  }
+}
+
+TEST(Block_Compressor, parse_format)
+{
+  EXPECT_EQ(Block_Compressor::parse_format("none"), Block_Compressor::Format::kNone);
+  EXPECT_EQ(Block_Compressor::parse_format("gzip"), Block_Compressor::Format::kGzip);
+  EXPECT_EQ(Block_Compressor::parse_format("zstd"), Block_Compressor::Format::kZstd);
+  EXPECT_ANY_THROW(Block_Compressor::parse_format("bzip2"));
+
+  string out;
+  Block_Compressor(Block_Compressor::Format::kNone).compress("abc", out);
+  EXPECT_EQ(out, "abc");
+}
+
+#ifdef __ZLIB
+
+TEST(Block_Compressor, gzip)
+{
+  round_trip(Block_Compressor::Format::kGzip, Block_Decompressor::Format::kBGZF);
+}
+
+TEST(Block_Compressor, compressed_jplace)
+{
+  Sample<Placement> sample;
+  for (size_t i = 0; i < 500; ++i) {
+    PQuery<Placement> pq(i, "q" + to_string(i));
+    pq.emplace_back(i % 17, -1000.5 - i, 0.1, 0.2);
+    sample.push_back(std::move(pq));
+  }
+
+  for (auto format : {Block_Compressor::Format::kNone, Block_Compressor::Format::kGzip}) {
+    jplace_writer jplace(env->out_dir, "compressed.jplace", "(a:1,b:2){0};", "epa-ng --test",
+                         rtree_mapper(), format);
+    jplace.set_precision(6).set_threads(2);
+    jplace.write(sample);
+    jplace.write(sample);
+  }
+
+  const auto plain = slurp(env->out_dir + "compressed.jplace");
+  EXPECT_EQ(decompress_file(env->out_dir + "compressed.jplace.gz", 2), plain);
+}
+
+#endif // __ZLIB
+
+#ifdef __ZSTD
+
+TEST(Block_Compressor, zstd)
+{
+  round_trip(Block_Compressor::Format::kZstd, Block_Decompressor::Format::kZstd);
+}
+
+#endif // __ZSTD
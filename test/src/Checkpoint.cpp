@@ -0,0 +1,127 @@
+#include "Epatest.hpp"
+
+#include "core/Checkpoint.hpp"
+#include "io/jplace_writer.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+TEST(Checkpoint, save_and_load)
+{
+  const auto file_name = env->out_dir + "test_checkpoint";
+  std::remove(file_name.c_str());
+
+  Checkpoint checkpoint(file_name, "queries with spaces.fasta", 2);
+  EXPECT_FALSE(checkpoint.load());
+
+  checkpoint.save(150, 3, {{"/some/dir/epa_result.jplace.0.part", 12345},
+                           {"/some/dir/0.epa summary.tsv", 678}});
+
+  Checkpoint loaded(file_name, "queries with spaces.fasta", 2);
+  ASSERT_TRUE(loaded.load());
+  EXPECT_EQ(loaded.sequences_done(), 150u);
+  EXPECT_EQ(loaded.chunks_done(), 3u);
+  ASSERT_EQ(loaded.files().size(), 2u);
+  EXPECT_EQ(loaded.files()[0].path, "/some/dir/epa_result.jplace.0.part");
+  EXPECT_EQ(loaded.files()[0].size, 12345u);
+  EXPECT_EQ(loaded.files()[1].path, "/some/dir/0.epa summary.tsv");
+  EXPECT_EQ(loaded.files()[1].size, 678u);
+
+  // of another run
+  EXPECT_ANY_THROW(Checkpoint(file_name, "other.fasta", 2).load());
+  EXPECT_ANY_THROW(Checkpoint(file_name, "queries with spaces.fasta", 4).load());
+
+  // cut short
+  const auto text = slurp(file_name);
+  {
+    ofstream out(file_name, ios::binary | ios::trunc);
+    out << text.substr(0, text.size() - 4);
+  }
+  EXPECT_ANY_THROW(Checkpoint(file_name, "queries with spaces.fasta", 2).load());
+
+  loaded.remove();
+  EXPECT_FALSE(loaded.load());
+}
+
+TEST(Checkpoint, failed_save)
+{
+  // a directory in the way: the rename fails
+  const auto file_name = env->out_dir + "test_checkpoint_dir";
+  mkdir(file_name.c_str(), 0700);
+  const auto blocker = file_name + "/blocker";
+  ofstream(blocker) << "x";
+
+  Checkpoint checkpoint(file_name, "queries.fasta");
+  EXPECT_ANY_THROW(checkpoint.save(10, 1, {}));
+
+  // no partial checkpoint is left behind
+  struct stat info;
+  EXPECT_NE(stat((file_name + ".tmp").c_str(), &info), 0);
+
+  std::remove(blocker.c_str());
+  rmdir(file_name.c_str());
+}
+
+TEST(Checkpoint, resume_jplace)
+{
+  const string tree("(a:1,b:2){0};");
+  const string invocation("epa-ng --test");
+  const auto chunk_a = make_sample(0, 10);
+  const auto chunk_b = make_sample(10, 7);
+  const auto chunk_c = make_sample(17, 12);
+
+  // uninterrupted
+  {
+    jplace_writer jplace(env->out_dir, "uninterrupted.jplace", tree, invocation, rtree_mapper());
+    for (auto chunk : {chunk_a, chunk_b, chunk_c}) {
+      jplace.write(chunk);
+    }
+  }
+  const auto expected = slurp(env->out_dir + "uninterrupted.jplace");
+
+  const auto checkpoint_file = env->out_dir + "test_resume_checkpoint";
+  std::remove(checkpoint_file.c_str());
+  {
+    Checkpoint checkpoint(checkpoint_file, "queries.fasta");
+    jplace_writer jplace(env->out_dir, "resumed.jplace", tree, invocation, rtree_mapper());
+    auto chunk = chunk_a;
+    jplace.write(chunk);
+    vector<placement_writer::File_State> files;
+    jplace.sync(files);
+    checkpoint.save(chunk.size(), 1, files);
+
+    // written, but not checkpointed: gone on resume
+    chunk = chunk_b;
+    jplace.write(chunk);
+  }
+
+  {
+    Checkpoint checkpoint(checkpoint_file, "queries.fasta");
+    ASSERT_TRUE(checkpoint.load());
+    EXPECT_EQ(checkpoint.sequences_done(), chunk_a.size());
+    checkpoint.restore_files();
+
+    jplace_writer jplace(env->out_dir, "resumed.jplace", tree, invocation, rtree_mapper(),
+                         Block_Compressor::Format::kNone, false, true);
+    for (auto chunk : {chunk_b, chunk_c}) {
+      jplace.write(chunk);
+    }
+  }
+  EXPECT_EQ(slurp(env->out_dir + "resumed.jplace"), expected);
+
+  // the recorded outputs have to be there
+  Checkpoint checkpoint(checkpoint_file, "queries.fasta");
+  ASSERT_TRUE(checkpoint.load());
+  std::remove((env->out_dir + "resumed.jplace").c_str());
+  EXPECT_ANY_THROW(checkpoint.restore_files());
+  checkpoint.remove();
+}
@@ -0,0 +1,100 @@
+#include "Epatest.hpp"
+
+#include "core/Chunk_Sizer.hpp"
+#include "util/Options.hpp"
+
+using ms = Chunk_Sizer::duration;
+
+TEST(Chunk_Sizer, fixed)
+{
+  Options options;
+  options.chunk_size = 123;
+  Chunk_Sizer sizer(1000, 500, options);
+
+  EXPECT_EQ(sizer.next(), 123u);
+  sizer.update(123, 123, ms(10));
+  sizer.update(123, 123, ms(1));
+  EXPECT_EQ(sizer.next(), 123u);
+}
+
+TEST(Chunk_Sizer, memory_ceiling)
+{
+  Options options;
+  options.auto_chunk_size = true;
+  options.chunk_size = 1000000;
+  options.chunk_memory = 1; // MB
+
+  const size_t num_branches = 1000;
+  const size_t sites = 500;
+  Chunk_Sizer sizer(num_branches, sites, options);
+
+  const auto per_query = Chunk_Sizer::bytes_per_query(num_branches, sites, options);
+  EXPECT_GT(per_query, num_branches * sizeof(Placement));
+  EXPECT_EQ(sizer.max(), (1024u * 1024u) / per_query);
+  EXPECT_EQ(sizer.next(), sizer.max());
+
+  // more chunks in flight, smaller chunks
+  Chunk_Sizer pipelined(num_branches, sites, options, 4);
+  EXPECT_EQ(pipelined.max(), (1024u * 1024u) / (per_query * 4));
+}
+
+TEST(Chunk_Sizer, adapts)
+{
+  Options options;
+  options.auto_chunk_size = true;
+  options.chunk_size = 100;
+  options.chunk_memory = 1024;
+
+  Chunk_Sizer sizer(10, 100, options);
+  ASSERT_EQ(sizer.next(), 100u);
+
+  // first measurement always counts as an improvement
+  sizer.update(100, 100, ms(100));
+  EXPECT_EQ(sizer.next(), 200u);
+
+  // twice the work in less than twice the time: keep growing
+  sizer.update(200, 200, ms(150));
+  EXPECT_EQ(sizer.next(), 400u);
+
+  // partial chunks are ignored
+  sizer.update(400, 10, ms(1000));
+  EXPECT_EQ(sizer.next(), 400u);
+
+  // chunks read before the last change still count, with the size they were read with
+  sizer.update(200, 200, ms(150));
+  EXPECT_EQ(sizer.next(), 400u);
+
+  // throughput collapsed: back to the best size
+  sizer.update(400, 400, ms(2000));
+  EXPECT_EQ(sizer.next(), 200u);
+}
+
+TEST(Chunk_Sizer, shrinks)
+{
+  Options options;
+  options.auto_chunk_size = true;
+  options.chunk_size = 100;
+  options.chunk_memory = 1024;
+
+  Chunk_Sizer sizer(10, 100, options);
+  sizer.update(100, 100, ms(100));
+  ASSERT_EQ(sizer.next(), 200u);
+
+  // larger does not pay off: try below the starting size
+  sizer.update(200, 200, ms(400));
+  EXPECT_EQ(sizer.next(), 50u);
+
+  // smaller is faster: keep shrinking
+  sizer.update(50, 50, ms(40));
+  EXPECT_EQ(sizer.next(), 25u);
+
+  // until it is not
+  sizer.update(25, 25, ms(30));
+  EXPECT_EQ(sizer.next(), 50u);
+  sizer.update(50, 50, ms(40));
+  EXPECT_EQ(sizer.next(), 50u);
+
+  // the best size got slower: look further down
+  sizer.update(50, 50, ms(100));
+  EXPECT_EQ(sizer.next(), 25u);
+}
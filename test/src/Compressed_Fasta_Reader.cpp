@@ -0,0 +1,148 @@
+#include "Epatest.hpp"
+
+#include "io/Compressed_Fasta_Reader.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#ifdef __ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef __ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+static void compare_to_plain(const string& compressed_file, const size_t parse_threads)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, true);
+
+  // the info must match the one of the uncompressed file
+  auto cinfo = compressed_msa_info(compressed_file);
+  EXPECT_EQ(info.sequences(), cinfo.sequences());
+  EXPECT_EQ(info.sites(), cinfo.sites());
+  EXPECT_EQ(info.gap_mask(), cinfo.gap_mask());
+
+  Compressed_Fasta_Reader reader(compressed_file, info, true, false, parse_threads);
+
+  const size_t chunk_size = 3;
+  MSA chunk;
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = reader.read_next(chunk, chunk_size))) {
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(complete_msa[num_read + i].header(), chunk[i].header());
+      EXPECT_EQ(complete_msa[num_read + i].sequence(), chunk[i].sequence());
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(num_read, complete_msa.size());
+}
+
+#ifdef __ZLIB
+
+TEST(Compressed_Fasta_Reader, gzip)
+{
+  auto file_name = env->out_dir + "query.fasta.gz";
+
+  auto data = slurp(env->combined_file);
+  auto gz = gzopen(file_name.c_str(), "wb");
+  ASSERT_TRUE(gz);
+  gzwrite(gz, data.data(), data.size());
+  gzclose(gz);
+
+  EXPECT_TRUE(is_compressed_fasta(file_name));
+  EXPECT_EQ(Block_Decompressor::detect(file_name), Block_Decompressor::Format::kGzip);
+
+  compare_to_plain(file_name, 1);
+}
+
+// writes BGZF blocks of at most block_size uncompressed bytes
+static void write_bgzf(const string& data, const string& file_name, const size_t block_size)
+{
+  ofstream out(file_name, ios::binary);
+  const auto put16 = [](string& s, unsigned v){
+    s.push_back(v & 0xff); s.push_back((v >> 8) & 0xff);
+  };
+  const auto put32 = [&](string& s, unsigned long v){
+    put16(s, v & 0xffff); put16(s, (v >> 16) & 0xffff);
+  };
+
+  // the last block is empty, as the BGZF EOF marker
+  for (size_t offset = 0; offset <= data.size(); offset += block_size) {
+    const size_t len = min(block_size, data.size() - offset);
+    const auto in = reinterpret_cast<const Bytef*>(data.data() + offset);
+
+    string deflated(compressBound(len) + 16, '\0');
+    z_stream zs = {};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = const_cast<Bytef*>(in);
+    zs.avail_in = len;
+    zs.next_out = reinterpret_cast<Bytef*>(&deflated[0]);
+    zs.avail_out = deflated.size();
+    deflate(&zs, Z_FINISH);
+    deflated.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    string block = {'\x1f', '\x8b', '\x08', '\x04', 0, 0, 0, 0, 0, '\xff'};
+    put16(block, 6);
+    block += "BC";
+    put16(block, 2);
+    put16(block, 18 + deflated.size() + 8 - 1);
+    block += deflated;
+    put32(block, crc32(0, in, len));
+    put32(block, len);
+    out << block;
+
+    if (len == 0) {
+      break;
+    }
+  }
+}
+
+TEST(Compressed_Fasta_Reader, bgzf)
+{
+  auto file_name = env->out_dir + "query.fasta.bgz";
+  write_bgzf(slurp(env->combined_file), file_name, 1000);
+
+  EXPECT_EQ(Block_Decompressor::detect(file_name), Block_Decompressor::Format::kBGZF);
+
+  compare_to_plain(file_name, 1);
+  compare_to_plain(file_name, 4);
+}
+
+#endif // __ZLIB
+
+#ifdef __ZSTD
+
+TEST(Compressed_Fasta_Reader, zstd_frames)
+{
+  auto file_name = env->out_dir + "query.fasta.zst";
+  auto data = slurp(env->combined_file);
+
+  // several independent frames, as written by zstd -T
+  ofstream out(file_name, ios::binary);
+  const size_t frame_size = 1500;
+  for (size_t offset = 0; offset < data.size(); offset += frame_size) {
+    const size_t len = min(frame_size, data.size() - offset);
+    string frame(ZSTD_compressBound(len), '\0');
+    frame.resize(ZSTD_compress(&frame[0], frame.size(), data.data() + offset, len, 3));
+    out << frame;
+  }
+  out.close();
+
+  EXPECT_EQ(Block_Decompressor::detect(file_name), Block_Decompressor::Format::kZstd);
+
+  compare_to_plain(file_name, 1);
+  compare_to_plain(file_name, 4);
+}
+
+#endif // __ZSTD
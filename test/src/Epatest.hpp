@@ -4,6 +4,7 @@
 
 #include "core/raxml/Model.hpp"
 #include "util/Options.hpp"
+#include "sample/Sample.hpp"
 
 // The testing environment
 class Epatest : public ::testing::Environment {
@@ -29,6 +30,43 @@ public:
 extern Epatest* env;
 
 #include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// the content of a file, byte for byte (compressed files are not decompressed)
+static inline std::string slurp(const std::string& file_name)
+{
+  std::ifstream in(file_name, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// a pquery with 1 to 3 placements, all depending on its id
+static inline PQuery<Placement> make_pquery(const size_t id, const std::string& name)
+{
+  PQuery<Placement> pq(id, name);
+  for (size_t p = 0; p < 1 + id % 3; ++p) {
+    pq.emplace_back((id + p) % 17, -1000.123456789 - id, 0.1 * p, 0.2 / (p + 1));
+    pq.back().lwr(1.0 / (p + 1));
+  }
+  return pq;
+}
+
+// pqueries [first, first + size), named to need escaping, every fifth with a duplicate
+static inline Sample<Placement> make_sample(const size_t first, const size_t size)
+{
+  Sample<Placement> sample;
+  for (size_t i = first; i < first + size; ++i) {
+    auto pq = make_pquery(i, "q\"" + std::to_string(i));
+    if (i % 5 == 0) {
+      pq.add_duplicate("dup" + std::to_string(i));
+    }
+    sample.push_back(std::move(pq));
+  }
+  return sample;
+}
 
 #define COMPL_REPEATS       (1 << 0)
 #define COMPL_OPTIMIZE      (1 << 1)
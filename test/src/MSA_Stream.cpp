@@ -6,6 +6,8 @@
 #include "io/file_io.hpp"
 
 #include <string>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -45,4 +47,81 @@ TEST(MSA_Stream, reading_masked)
     EXPECT_EQ(complete_msa[i], read_msa[i % chunk_size]);
   }
   MSA_Stream dummy;
-}
\ No newline at end of file
+}
+
+TEST(MSA_Stream, reading_single_pass)
+{
+  MSA_Info full_info(env->combined_file);
+  auto info = make_streaming_msa_info(env->combined_file);
+
+  EXPECT_EQ(info.sites(), full_info.sites());
+  EXPECT_EQ(info.sequences(), 0u);
+  EXPECT_EQ(info.gap_count(), 0u);
+
+  MSA complete_msa = build_MSA_from_file(env->combined_file, full_info, false);
+  const size_t chunk_size = 4;
+  MSA read_msa;
+  MSA_Stream streamed_msa(env->combined_file, info, true);
+
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = streamed_msa.read_next(read_msa, chunk_size))) {
+    for (size_t i = 0; i < n; ++i) {
+      // nothing is masked without a reference
+      EXPECT_EQ(complete_msa[num_read + i], read_msa[i]);
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(num_read, complete_msa.size());
+}
+
+TEST(MSA_Stream, skip)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, false);
+  const size_t skipped = 4;
+  MSA read_msa;
+  MSA_Stream streamed_msa(env->combined_file, info, false);
+
+  streamed_msa.skip(skipped);
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = streamed_msa.read_next(read_msa, 3))) {
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(complete_msa[skipped + num_read + i], read_msa[i]);
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(skipped + num_read, complete_msa.size());
+  EXPECT_ANY_THROW(streamed_msa.skip(1));
+
+  // skipping everything leaves nothing to read
+  MSA_Stream all_skipped(env->combined_file, info, false);
+  all_skipped.skip(complete_msa.size());
+  EXPECT_EQ(all_skipped.read_next(read_msa, 3), 0u);
+}
+
+TEST(MSA_Stream, changing_chunk_size)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, false);
+  MSA read_msa;
+  MSA_Stream streamed_msa(env->combined_file, info, false);
+
+  // grow and shrink the chunks, as the adaptive chunk size does
+  const vector<size_t> chunk_sizes{2, 5, 1, 1, 4, 3};
+  size_t num_read = 0;
+  size_t i = 0;
+  size_t n = 0;
+  while ((n = streamed_msa.read_next(read_msa, chunk_sizes[i % chunk_sizes.size()]))) {
+    const auto requested = chunk_sizes[i % chunk_sizes.size()];
+    // every chunk but the last holds exactly as many sequences as requested
+    EXPECT_EQ(n, std::min(requested, complete_msa.size() - num_read));
+    for (size_t j = 0; j < n; ++j) {
+      EXPECT_EQ(complete_msa[num_read + j], read_msa[j]);
+    }
+    num_read += n;
+    ++i;
+  }
+  EXPECT_EQ(num_read, complete_msa.size());
+}
@@ -0,0 +1,89 @@
+#include "Epatest.hpp"
+
+#include "io/Mmap_Fasta_Reader.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include <string>
+
+using namespace std;
+
+static void compare_to_stream(const bool premasking)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, premasking);
+
+  Mmap_Fasta_Reader reader(env->combined_file, info, premasking);
+
+  const size_t chunk_size = 3;
+  MSA chunk;
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = reader.read_next(chunk, chunk_size))) {
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(complete_msa[num_read + i].header(), chunk[i].header());
+      EXPECT_EQ(complete_msa[num_read + i].sequence(), chunk[i].sequence());
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(num_read, complete_msa.size());
+}
+
+TEST(Mmap_Fasta_Reader, reading)
+{
+  compare_to_stream(false);
+}
+
+TEST(Mmap_Fasta_Reader, reading_masked)
+{
+  compare_to_stream(true);
+}
+
+TEST(Mmap_Fasta_Reader, parallel_parsing)
+{
+  MSA_Info info(env->combined_file);
+  Mmap_Fasta_Reader serial(env->combined_file, info, true, false, 1);
+  Mmap_Fasta_Reader parallel(env->combined_file, info, true, false, 4);
+
+  // sequences must come out in input order, so their ids stay the same
+  const size_t chunk_size = 5;
+  MSA serial_chunk;
+  MSA parallel_chunk;
+  size_t n = 0;
+  while ((n = serial.read_next(serial_chunk, chunk_size))) {
+    ASSERT_EQ(parallel.read_next(parallel_chunk, chunk_size), n);
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(serial_chunk[i].header(), parallel_chunk[i].header());
+      EXPECT_EQ(serial_chunk[i].sequence(), parallel_chunk[i].sequence());
+    }
+  }
+  EXPECT_EQ(parallel.read_next(parallel_chunk, chunk_size), 0u);
+}
+
+TEST(Mmap_Fasta_Reader, skip)
+{
+  MSA_Info info(env->combined_file);
+  MSA complete_msa = build_MSA_from_file(env->combined_file, info, false);
+
+  // as when resuming: the rest comes out as it would have without skipping
+  const size_t skipped = 5;
+  Mmap_Fasta_Reader reader(env->combined_file, info, false);
+  reader.skip(skipped);
+  MSA chunk;
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = reader.read_next(chunk, 3))) {
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(complete_msa[skipped + num_read + i].header(), chunk[i].header());
+      EXPECT_EQ(complete_msa[skipped + num_read + i].sequence(), chunk[i].sequence());
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(skipped + num_read, complete_msa.size());
+  EXPECT_ANY_THROW(reader.skip(1));
+
+  Mmap_Fasta_Reader all_skipped(env->combined_file, info, false);
+  all_skipped.skip(complete_msa.size());
+  EXPECT_EQ(all_skipped.read_next(chunk, 3), 0u);
+}
@@ -0,0 +1,79 @@
+#include "Epatest.hpp"
+
+#include "io/Output_File.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <random>
+
+using namespace std;
+
+TEST(Output_File, write)
+{
+  const auto file_name = env->out_dir + "output_file.txt";
+
+  // pieces of all sizes, around and beyond that of the (small) buffer
+  mt19937 gen(3);
+  string expected;
+  {
+    Output_File out(file_name, 4096);
+    out.reserve(1 << 20);
+    for (size_t i = 0; i < 500; ++i) {
+      const string piece(gen() % 10000, 'a' + i % 26);
+      out.write(piece);
+      expected += piece;
+      if (i % 50 == 0) {
+        out.flush();
+      }
+      if (i == 250) {
+        out.set_buffer_size(100000);
+      }
+    }
+    EXPECT_EQ(out.size(), expected.size());
+    out.close();
+    EXPECT_FALSE(out.is_open());
+    EXPECT_ANY_THROW(out.write("more"));
+  }
+
+  // including the release of the reserved space beyond the end
+  EXPECT_EQ(slurp(file_name), expected);
+}
+
+TEST(Output_File, flush_makes_visible)
+{
+  const auto file_name = env->out_dir + "output_file_flush.txt";
+
+  Output_File out(file_name);
+  out.write("first chunk\n");
+  out.flush();
+
+  // written by the I/O thread in the background: closing waits for it
+  out.close();
+  EXPECT_EQ(slurp(file_name), "first chunk\n");
+}
+
+TEST(Output_File, append_and_sync)
+{
+  const auto file_name = env->out_dir + "output_file_append.txt";
+
+  {
+    Output_File out(file_name, 4096);
+    out.write(string(10000, 'a'));
+    out.sync();
+    // all of it is in the file already, without closing
+    EXPECT_EQ(slurp(file_name), string(10000, 'a'));
+  }
+
+  Output_File out(file_name, 4096, true);
+  EXPECT_EQ(out.size(), 10000u);
+  out.write("bc");
+  out.close();
+  EXPECT_EQ(out.size(), 10002u);
+  EXPECT_EQ(slurp(file_name), string(10000, 'a') + "bc");
+}
+
+TEST(Output_File, bad_path)
+{
+  EXPECT_ANY_THROW(Output_File(env->out_dir + "no/such/dir/file"));
+}
@@ -0,0 +1,36 @@
+#include "Epatest.hpp"
+
+#include "core/Overlap_Monitor.hpp"
+
+using Phase = Overlap_Monitor::Phase;
+
+TEST(Overlap_Monitor, tail_and_recovered)
+{
+  Overlap_Monitor monitor(3);
+
+  const auto t0 = Overlap_Monitor::clock::now();
+  const auto ms = [t0](const int x){ return t0 + std::chrono::milliseconds(x); };
+
+  // thread 0 is the straggler, finishing the thorough phase at 100
+  monitor.record(0, Phase::kThorough, ms(0), ms(100));
+  // thread 1 finishes at 40, then prescores the next chunk from 40 to 70
+  monitor.record(1, Phase::kThorough, ms(0), ms(40));
+  monitor.record(1, Phase::kPrescore, ms(40), ms(70));
+  // thread 2 finishes at 60, then prescores from 60 to 150 (past the phase end)
+  monitor.record(2, Phase::kThorough, ms(0), ms(60));
+  monitor.record(2, Phase::kPrescore, ms(60), ms(150));
+
+  monitor.close_chunk();
+
+  // tails: 0 + 60 + 40, recovered: 30 + 40
+  EXPECT_NEAR(monitor.tail().count(), 100.0, 1e-6);
+  EXPECT_NEAR(monitor.recovered().count(), 70.0, 1e-6);
+  EXPECT_NEAR(monitor.recovered_fraction(), 0.7, 1e-6);
+  EXPECT_EQ(monitor.chunks(), 1u);
+
+  // intervals are forgotten, prescoring alone has no tail
+  monitor.record(1, Phase::kPrescore, ms(200), ms(300));
+  monitor.close_chunk();
+  EXPECT_NEAR(monitor.tail().count(), 100.0, 1e-6);
+  EXPECT_EQ(monitor.chunks(), 1u);
+}
@@ -0,0 +1,152 @@
+#include "Epatest.hpp"
+
+#include "core/Query_Dedup.hpp"
+#include "seq/MSA.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <map>
+
+using namespace std;
+
+// stand-in for the placement of a filtered chunk: one placement per query,
+// whose branch is derived from the sequence
+static Sample<Placement> fake_place(const MSA& chunk, const size_t seq_id_offset)
+{
+  Sample<Placement> sample;
+  for (size_t i = 0; i < chunk.size(); ++i) {
+    PQuery<Placement> pq(seq_id_offset + i, chunk[i].header());
+    pq.emplace_back(chunk[i].sequence().size() + chunk[i].sequence()[0], -1.0 * i, 0.1, 0.2);
+    sample.push_back(std::move(pq));
+  }
+  return sample;
+}
+
+static map<string, pair<size_t, vector<string>>> run_chunks(Query_Dedup& dedup,
+                                                             const vector<MSA>& chunks,
+                                                             size_t& num_placed)
+{
+  // first header -> (input position, duplicate headers)
+  map<string, pair<size_t, vector<string>>> result;
+  size_t offset = 0;
+  num_placed = 0;
+  for (auto chunk : chunks) {
+    const auto size = chunk.size();
+    dedup.filter(chunk, offset);
+    num_placed += chunk.size();
+
+    auto sample = fake_place(chunk, offset);
+    dedup.resolve(sample, offset);
+
+    for (const auto& pq : sample) {
+      EXPECT_EQ(pq.size(), 1u);
+      result[pq.header()] = make_pair(pq.sequence_id(), pq.duplicates());
+    }
+    offset += size;
+  }
+  return result;
+}
+
+// fixed width, so all sequences have the same length
+static string numbered(const size_t i)
+{
+  auto s = to_string(i);
+  return "ACGT" + string(4 - s.size(), '0') + s;
+}
+
+static vector<MSA> make_chunks()
+{
+  vector<MSA> chunks(3);
+  chunks[0].append("a", "ACGT-ACGT");
+  chunks[0].append("b", "TTTT-AAAA");
+  chunks[0].append("a2", "ACGT-ACGT");
+  chunks[0].append("c", "GGGG-CCCC");
+
+  chunks[1].append("b2", "TTTT-AAAA");
+  chunks[1].append("d", "ACGT-ACGA");
+  chunks[1].append("b3", "TTTT-AAAA");
+
+  chunks[2].append("a3", "ACGT-ACGT");
+  chunks[2].append("e", "CCCC-CCCC");
+  return chunks;
+}
+
+static void check_result(const map<string, pair<size_t, vector<string>>>& result)
+{
+  ASSERT_EQ(result.size(), 7u);
+
+  EXPECT_EQ(result.at("a").first, 0u);
+  EXPECT_EQ(result.at("a").second, vector<string>({"a2"}));
+  EXPECT_EQ(result.at("b").first, 1u);
+  EXPECT_TRUE(result.at("b").second.empty());
+  EXPECT_EQ(result.at("c").first, 3u);
+  EXPECT_TRUE(result.at("c").second.empty());
+
+  // already placed in an earlier chunk: its own pquery, holding the copies of the chunk
+  EXPECT_EQ(result.at("b2").first, 4u);
+  EXPECT_EQ(result.at("b2").second, vector<string>({"b3"}));
+  EXPECT_EQ(result.at("d").first, 5u);
+  EXPECT_EQ(result.at("a3").first, 7u);
+  EXPECT_EQ(result.at("e").first, 8u);
+}
+
+TEST(Query_Dedup, within_and_across_chunks)
+{
+  Query_Dedup dedup(0, env->out_dir);
+  size_t num_placed = 0;
+  auto result = run_chunks(dedup, make_chunks(), num_placed);
+
+  check_result(result);
+  EXPECT_EQ(num_placed, 5u);
+  EXPECT_EQ(dedup.num_unique(), 5u);
+  EXPECT_EQ(dedup.num_duplicates(), 4u);
+  EXPECT_EQ(dedup.num_spills(), 0u);
+}
+
+TEST(Query_Dedup, spill_to_disk)
+{
+  // spill after every chunk
+  Query_Dedup dedup(1, env->out_dir);
+  size_t num_placed = 0;
+  auto chunks = make_chunks();
+  auto result = run_chunks(dedup, chunks, num_placed);
+
+  check_result(result);
+  EXPECT_EQ(num_placed, 5u);
+  EXPECT_EQ(dedup.num_spills(), 3u);
+
+  // placements handed out for earlier sequences are the ones they were placed with
+  const auto a = fake_place(chunks[2], 0);
+  MSA again;
+  again.append("a4", "ACGT-ACGT");
+  dedup.filter(again, 9);
+  EXPECT_EQ(again.size(), 0u);
+  Sample<Placement> sample;
+  dedup.resolve(sample, 9);
+  ASSERT_EQ(sample.size(), 1u);
+  EXPECT_EQ(sample.at(0).at(0).branch_id(), a.at(0).at(0).branch_id());
+}
+
+TEST(Query_Dedup, many_spilled_keys)
+{
+  Query_Dedup dedup(1, env->out_dir);
+
+  MSA chunk;
+  for (size_t i = 0; i < 1000; ++i) {
+    chunk.append(to_string(i), numbered(i));
+  }
+  dedup.filter(chunk, 0);
+  auto sample = fake_place(chunk, 0);
+  dedup.resolve(sample, 0);
+  ASSERT_EQ(dedup.num_spills(), 1u);
+
+  // every key is found through the sparse index, unseen ones are not
+  MSA again;
+  for (size_t i = 0; i < 1000; i += 7) {
+    again.append("x" + to_string(i), numbered(i));
+  }
+  again.append("new", "ACGTNNNN");
+  dedup.filter(again, 1000);
+  ASSERT_EQ(again.size(), 1u);
+  EXPECT_EQ(again[0].header(), "new");
+}
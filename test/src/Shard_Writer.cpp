@@ -0,0 +1,137 @@
+#include "Epatest.hpp"
+
+#include "io/Shard_Writer.hpp"
+#include "io/jplace_writer.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static const string TREE("(a:1,b:2){0};");
+static const string INVOCATION("epa-ng --test");
+
+// what a plain jplace output of these chunks looks like
+static string as_jplace(const string& file_name, vector<Sample<Placement>> chunks)
+{
+  {
+    jplace_writer jplace(env->out_dir, file_name, TREE, INVOCATION, rtree_mapper());
+    for (auto& chunk : chunks) {
+      jplace.write(chunk);
+    }
+  }
+  return slurp(env->out_dir + file_name);
+}
+
+TEST(Shard_Writer, router)
+{
+  const auto by_prefix = Shard_Router::from_regex("^([^_]+)_");
+  EXPECT_EQ(by_prefix.shard_of("S1_read7"), "S1");
+  EXPECT_EQ(by_prefix.shard_of("plain"), Shard_Router::UNASSIGNED);
+
+  // without a group, the whole match
+  const auto by_match = Shard_Router::from_regex("S[0-9]+");
+  EXPECT_EQ(by_match.shard_of("read_S12_x"), "S12");
+
+  EXPECT_ANY_THROW(Shard_Router::from_regex("(unclosed"));
+
+  const auto map_file = env->out_dir + "shard_map.tsv";
+  {
+    ofstream out(map_file);
+    out << "# name\tsample\n" << "q1\tgut\n" << "q2 skin\n\n" << "q1\tgut\n";
+  }
+  const auto by_map = Shard_Router::from_map_file(map_file);
+  EXPECT_EQ(by_map.shard_of("q1"), "gut");
+  EXPECT_EQ(by_map.shard_of("q2"), "skin");
+  EXPECT_EQ(by_map.shard_of("q3"), Shard_Router::UNASSIGNED);
+
+  {
+    ofstream out(map_file, ios::app);
+    out << "q2\tgut\n";
+  }
+  EXPECT_ANY_THROW(Shard_Router::from_map_file(map_file));
+  EXPECT_ANY_THROW(Shard_Router::from_map_file(env->out_dir + "no_such_map.tsv"));
+}
+
+TEST(Shard_Writer, by_regex)
+{
+  Sample<Placement> first;
+  first.push_back(make_pquery(0, "A_0"));
+  first.push_back(make_pquery(1, "B/1_1"));
+  auto shared = make_pquery(2, "A_2");
+  // an identical sequence of another shard
+  shared.add_duplicate("B/1_9");
+  shared.add_duplicate("A_10");
+  first.push_back(shared);
+  first.push_back(make_pquery(3, "no prefix"));
+
+  Sample<Placement> second;
+  second.push_back(make_pquery(4, "B/1_4"));
+  second.push_back(make_pquery(5, "A_5"));
+
+  {
+    Shard_Writer shards(env->out_dir, "sharded", TREE, INVOCATION, rtree_mapper(),
+                        std::make_unique<Shard_Router>(Shard_Router::from_regex("^([^_]+)_")));
+    // more shards than open files
+    shards.set_max_open(1).set_threads(2);
+    auto chunk = first;
+    shards.write(chunk);
+    chunk = second;
+    shards.write(chunk);
+  }
+
+  // every shard is the jplace of its part of each chunk
+  Sample<Placement> a_first;
+  a_first.push_back(make_pquery(0, "A_0"));
+  auto a_shared = make_pquery(2, "A_2");
+  a_shared.add_duplicate("A_10");
+  a_first.push_back(a_shared);
+  Sample<Placement> a_second;
+  a_second.push_back(make_pquery(5, "A_5"));
+  EXPECT_EQ(slurp(env->out_dir + "sharded.A.jplace"), as_jplace("expected_A.jplace", {a_first, a_second}));
+
+  // '/' does not make it into the file name
+  Sample<Placement> b_first;
+  b_first.push_back(make_pquery(1, "B/1_1"));
+  b_first.push_back(make_pquery(2, "B/1_9"));
+  Sample<Placement> b_second;
+  b_second.push_back(make_pquery(4, "B/1_4"));
+  EXPECT_EQ(slurp(env->out_dir + "sharded.B_1.jplace"), as_jplace("expected_B.jplace", {b_first, b_second}));
+
+  Sample<Placement> unassigned;
+  unassigned.push_back(make_pquery(3, "no prefix"));
+  EXPECT_EQ(slurp(env->out_dir + "sharded.unassigned.jplace"), as_jplace("expected_u.jplace", {unassigned}));
+
+  EXPECT_EQ(slurp(env->out_dir + "sharded.shards.tsv"),
+            string(Shard_Writer::MANIFEST_HEADER)
+            + "A\tsharded.A.jplace\t3\t4\n"
+            + "B/1\tsharded.B_1.jplace\t3\t3\n"
+            + "unassigned\tsharded.unassigned.jplace\t1\t1\n");
+}
+
+TEST(Shard_Writer, by_chunk)
+{
+  Sample<Placement> first;
+  first.push_back(make_pquery(0, "q0"));
+  first.push_back(make_pquery(1, "q1"));
+  Sample<Placement> second;
+  second.push_back(make_pquery(2, "q2"));
+
+  {
+    Shard_Writer shards(env->out_dir, "chunked", TREE, INVOCATION, rtree_mapper(), nullptr);
+    auto chunk = first;
+    shards.write(chunk);
+    chunk = second;
+    shards.write(chunk);
+  }
+
+  EXPECT_EQ(slurp(env->out_dir + "chunked.0.jplace"), as_jplace("expected_0.jplace", {first}));
+  EXPECT_EQ(slurp(env->out_dir + "chunked.1.jplace"), as_jplace("expected_1.jplace", {second}));
+  EXPECT_EQ(slurp(env->out_dir + "chunked.shards.tsv"),
+            string(Shard_Writer::MANIFEST_HEADER)
+            + "0\tchunked.0.jplace\t2\t2\n"
+            + "1\tchunked.1.jplace\t1\t1\n");
+}
@@ -0,0 +1,75 @@
+#include "Epatest.hpp"
+
+#include <thread>
+#include <vector>
+
+#include "util/Timer.hpp"
+
+TEST(Stats, per_thread_counters)
+{
+  Stats::enable();
+  Stats::reset();
+
+  const size_t num_threads = 4;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; ++t) {
+    threads.emplace_back([]() {
+      for (size_t i = 0; i < 1000; ++i) {
+        Stats::count(Stat_Counter::kPlacements);
+      }
+      Stats::count(Stat_Counter::kTinyTrees, 3);
+      Phase_Timer timer(Stat_Phase::kBLO);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  const auto total = Stats::total();
+  EXPECT_EQ(total.counts[static_cast<size_t>(Stat_Counter::kPlacements)], 1000u * num_threads);
+  EXPECT_EQ(total.counts[static_cast<size_t>(Stat_Counter::kTinyTrees)], 3u * num_threads);
+  EXPECT_EQ(total.counts[static_cast<size_t>(Stat_Counter::kCLVLoads)], 0u);
+  EXPECT_GE(Stats::threads().size(), num_threads);
+
+  const auto json = Stats::to_json(2, 1.5);
+  EXPECT_NE(json.find("\"rank\": 2"), std::string::npos);
+  EXPECT_NE(json.find("\"placements\": 4000"), std::string::npos);
+  EXPECT_NE(json.find("\"blo\": "), std::string::npos);
+
+  // disabled: nothing is counted
+  Stats::enable(false);
+  Stats::reset();
+  Stats::count(Stat_Counter::kPlacements);
+  {
+    Phase_Timer timer(Stat_Phase::kRead);
+  }
+  EXPECT_EQ(Stats::total().counts[static_cast<size_t>(Stat_Counter::kPlacements)], 0u);
+  EXPECT_EQ(Stats::total().times[static_cast<size_t>(Stat_Phase::kRead)].count(), 0);
+}
+
+TEST(Stats, phases_do_not_nest)
+{
+  Stats::enable();
+  Stats::reset();
+
+  using ms = std::chrono::milliseconds;
+  {
+    Phase_Timer outer(Stat_Phase::kBLO);
+    std::this_thread::sleep_for(ms(5));
+    {
+      Phase_Timer inner(Stat_Phase::kTinyTree);
+      std::this_thread::sleep_for(ms(50));
+    }
+  }
+
+  const auto& times = Stats::local().times;
+  const auto blo = times[static_cast<size_t>(Stat_Phase::kBLO)];
+  const auto tiny_tree = times[static_cast<size_t>(Stat_Phase::kTinyTree)];
+  EXPECT_GE(tiny_tree, ms(50));
+  EXPECT_GE(blo, ms(5));
+  // the inner phase is not counted twice
+  EXPECT_LT(blo, ms(50));
+
+  Stats::enable(false);
+  Stats::reset();
+}
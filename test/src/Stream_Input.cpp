@@ -0,0 +1,108 @@
+#include "Epatest.hpp"
+
+#include "io/Stream_Input.hpp"
+#include "io/msa_reader.hpp"
+#include "io/file_io.hpp"
+#include "seq/MSA.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static string make_fifo(const string& name)
+{
+  const auto path = env->out_dir + name;
+  unlink(path.c_str());
+  if (mkfifo(path.c_str(), 0600) != 0) {
+    throw runtime_error{"Cannot create fifo: " + path};
+  }
+  return path;
+}
+
+// feeds a file into the fifo from another thread, as an upstream tool would
+static thread feed(const string& fifo, const string& content)
+{
+  return thread([fifo, content](){
+    ofstream out(fifo, ios::binary);
+    // in small pieces, to exercise partial reads
+    for (size_t i = 0; i < content.size(); i += 1000) {
+      out.write(content.data() + i, min<size_t>(1000, content.size() - i));
+      out.flush();
+    }
+  });
+}
+
+TEST(Stream_Input, is_stream_input)
+{
+  EXPECT_TRUE(is_stream_input("-"));
+  EXPECT_FALSE(is_stream_input(env->combined_file));
+  EXPECT_FALSE(is_stream_input(env->out_dir + "does_not_exist.fasta"));
+
+  const auto fifo = make_fifo("is_stream.fifo");
+  EXPECT_TRUE(is_stream_input(fifo));
+  unlink(fifo.c_str());
+}
+
+TEST(Stream_Input, replays_peeked_record)
+{
+  const auto fifo = make_fifo("replay.fifo");
+  const string content = "\n>first seq\nACGT\nAC-T\n>second\nTTTTTTTT\n";
+  auto writer = feed(fifo, content);
+
+  auto& input = Stream_Input::get(fifo);
+  EXPECT_EQ(input.first_sequence_length(), 8u);
+  EXPECT_EQ(input.first_sequence_length(), 8u);
+
+  stringstream ss;
+  ss << input.stream().rdbuf();
+  EXPECT_EQ(ss.str(), content);
+
+  writer.join();
+  unlink(fifo.c_str());
+}
+
+TEST(Stream_Input, read_error)
+{
+  // opens fine, but can not be read from
+  const auto dir = env->out_dir + "stream_input.dir";
+  mkdir(dir.c_str(), 0700);
+
+  auto& input = Stream_Input::get(dir);
+  EXPECT_THROW(input.stream().get(), runtime_error);
+}
+
+TEST(Stream_Input, read_through_fifo)
+{
+  MSA_Info info(env->combined_file);
+  auto msa = build_MSA_from_file(env->combined_file, info, false);
+
+  const auto fifo = make_fifo("query.fifo");
+  auto writer = feed(fifo, slurp(env->combined_file));
+
+  auto stream_info = make_streaming_msa_info(fifo);
+  EXPECT_EQ(stream_info.sites(), info.sites());
+
+  auto reader = make_msa_reader(fifo, stream_info, false, true);
+
+  MSA chunk;
+  size_t num_read = 0;
+  size_t n = 0;
+  while ((n = reader->read_next(chunk, 7))) {
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(msa[num_read + i].header(), chunk[i].header());
+      EXPECT_EQ(msa[num_read + i].sequence(), chunk[i].sequence());
+    }
+    num_read += n;
+  }
+  EXPECT_EQ(num_read, msa.size());
+
+  writer.join();
+  unlink(fifo.c_str());
+}
@@ -0,0 +1,101 @@
+#include "Epatest.hpp"
+
+#include "io/Summary_Writer.hpp"
+#include "tree/Branch_Distances.hpp"
+#include "sample/Sample.hpp"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+// ((a:1,b:2)X:3,c:4,d:5); with branches in postorder: a, b, X, c, d
+static Branch_Distances make_distances()
+{
+  return Branch_Distances({2, 2, 5, 5, 5}, {1.0, 2.0, 3.0, 4.0, 5.0});
+}
+
+TEST(Summary_Writer, branch_distances)
+{
+  auto distances = make_distances();
+
+  EXPECT_DOUBLE_EQ(distances.distance(0, 0.2, 0, 0.7), 0.5);
+  EXPECT_DOUBLE_EQ(distances.distance(0, 0.5, 1, 1.0), 1.5);
+  EXPECT_DOUBLE_EQ(distances.distance(1, 1.0, 0, 0.5), 1.5);
+  EXPECT_DOUBLE_EQ(distances.distance(0, 0.5, 3, 1.0), 6.5);
+  EXPECT_DOUBLE_EQ(distances.distance(2, 1.0, 0, 0.25), 1.75);
+  EXPECT_DOUBLE_EQ(distances.distance(3, 0.0, 4, 0.0), 9.0);
+  EXPECT_DOUBLE_EQ(distances.distance(2, 3.0, 4, 5.0), 0.0);
+
+  EXPECT_ANY_THROW(Branch_Distances({1, 2}, {1.0}));
+  // not in postorder
+  EXPECT_ANY_THROW(Branch_Distances({1, 0, 3}, {1.0, 1.0, 1.0}));
+}
+
+// placements on a, b and c, for which the EDPL below was worked out by hand
+static PQuery<Placement> edpl_pquery(const size_t id)
+{
+  PQuery<Placement> pq(id, "q" + to_string(id));
+  pq.emplace_back(1, -10.0, 0.1, 1.0);
+  pq.back().lwr(0.3);
+  pq.emplace_back(0, -9.5, 0.2, 0.5);
+  pq.back().lwr(0.5);
+  pq.emplace_back(3, -11.0, 0.3, 1.0);
+  pq.back().lwr(0.2);
+  return pq;
+}
+
+TEST(Summary_Writer, edpl)
+{
+  auto distances = make_distances();
+
+  EXPECT_NEAR(edpl(edpl_pquery(0), distances), 2.0 * (0.15 * 1.5 + 0.1 * 6.5 + 0.06 * 7.0), 1e-12);
+
+  PQuery<Placement> single(1, "single");
+  single.emplace_back(4, -1.0, 0.1, 0.1);
+  single.back().lwr(1.0);
+  EXPECT_DOUBLE_EQ(edpl(single, distances), 0.0);
+}
+
+TEST(Summary_Writer, buffer)
+{
+  auto distances = make_distances();
+
+  Sample<Placement> sample;
+  sample.push_back(edpl_pquery(0));
+  sample.back().add_duplicate("dup");
+  sample.push_back(PQuery<Placement>(1, "empty"));
+
+  string buffer;
+  sample_to_summary_buffer(sample, buffer, distances, rtree_mapper(), 3);
+  EXPECT_EQ(buffer, "q0\t0\t0.500\t-9.500\t0.500\t0.200\t2.590\n"
+                    "dup\t0\t0.500\t-9.500\t0.500\t0.200\t2.590\n");
+
+  // the same text when formatted on several threads
+  Sample<Placement> large;
+  for (size_t i = 0; i < 2000; ++i) {
+    large.push_back(edpl_pquery(i));
+  }
+  string serial, parallel;
+  sample_to_summary_buffer(large, serial, distances, rtree_mapper(), 6, 1);
+  sample_to_summary_buffer(large, parallel, distances, rtree_mapper(), 6, 4);
+  EXPECT_EQ(serial, parallel);
+}
+
+TEST(Summary_Writer, file)
+{
+  {
+    Summary_Writer summary(env->out_dir, "summary_test.tsv", make_distances(), rtree_mapper(), 3);
+    Sample<Placement> sample;
+    sample.push_back(edpl_pquery(7));
+    summary.write(sample);
+    summary.write(sample);
+  }
+
+  ifstream in(env->out_dir + "summary_test.tsv");
+  stringstream ss;
+  ss << in.rdbuf();
+  const string row("q7\t0\t0.500\t-9.500\t0.500\t0.200\t2.590\n");
+  EXPECT_EQ(ss.str(), string(Summary_Writer::HEADER) + row + row);
+}
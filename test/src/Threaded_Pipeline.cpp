@@ -0,0 +1,78 @@
+#include "Epatest.hpp"
+
+#include "pipeline/Threaded_Pipeline.hpp"
+#include "pipeline/Token.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+class Number_Token : public Token
+{
+public:
+  size_t value = 0;
+};
+
+TEST(Threaded_Pipeline, order_and_completeness)
+{
+  const size_t num_chunks = 100;
+  size_t produced = 0;
+  std::vector<size_t> received;
+
+  auto source = [&](VoidToken&) {
+    Number_Token t;
+    if (produced == num_chunks) {
+      t.is_last(true);
+    }
+    t.value = produced++;
+    return t;
+  };
+
+  auto square = [](Number_Token& t) {
+    Number_Token out;
+    out.value = t.value * t.value;
+    return out;
+  };
+
+  auto sink = [&](Number_Token& t) {
+    received.push_back(t.value);
+    return VoidToken();
+  };
+
+  make_threaded_pipeline(source, 2)
+    .push(square)
+    .push(sink)
+    .process();
+
+  ASSERT_EQ(received.size(), num_chunks);
+  for (size_t i = 0; i < num_chunks; ++i) {
+    EXPECT_EQ(received[i], i * i);
+  }
+}
+
+TEST(Threaded_Pipeline, exception_aborts)
+{
+  size_t produced = 0;
+
+  auto source = [&](VoidToken&) {
+    Number_Token t;
+    t.value = produced++;
+    return t;
+  };
+
+  auto fail = [](Number_Token& t) {
+    if (t.value == 5) {
+      throw std::runtime_error{"stage failure"};
+    }
+    return t;
+  };
+
+  auto sink = [](Number_Token&) {
+    return VoidToken();
+  };
+
+  auto pipeline = make_threaded_pipeline(source, 1)
+    .push(fail)
+    .push(sink);
+
+  EXPECT_THROW(pipeline.process(), std::runtime_error);
+}
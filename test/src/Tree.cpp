@@ -64,3 +64,19 @@ TEST(Tree, rooted_input)
   auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), true);
   auto tree = Tree(env->tree_file_rooted, msa, env->model, env->options);
 }
+
+TEST(Tree, replicate)
+{
+  auto msa = build_MSA_from_file(env->reference_file, MSA_Info(env->reference_file), true);
+  Tree original_tree(env->tree_file, msa, env->model, env->options);
+
+  auto replica = original_tree.replicate();
+
+  // the replica owns its own copy of the reference data...
+  EXPECT_NE(original_tree.tree(), replica.tree());
+  EXPECT_NE(original_tree.partition(), replica.partition());
+  EXPECT_EQ(original_tree.nums().branches, replica.nums().branches);
+
+  // ... which evaluates exactly like the original
+  EXPECT_DOUBLE_EQ(original_tree.ref_tree_logl(), replica.ref_tree_logl());
+}
@@ -35,3 +35,97 @@
 //   // teardown
 //
 // }
+
+#include "io/jplace_util.hpp"
+
+#include <string>
+#include <sstream>
+#include <random>
+#include <limits>
+
+static std::string stream_fixed(const double value, const unsigned int precision)
+{
+  std::ostringstream ss;
+  ss.precision(precision);
+  ss.setf(std::ios::fixed, std::ios::floatfield);
+  ss << value;
+  return ss.str();
+}
+
+static Sample<Placement> random_sample(const size_t num_pqueries, const size_t per_pquery)
+{
+  std::mt19937_64 gen(42);
+  std::uniform_real_distribution<double> like(-50000.0, -100.0);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  Sample<Placement> sample;
+  for (size_t i = 0; i < num_pqueries; ++i) {
+    PQuery<Placement> pq(i, "query_" + std::to_string(i));
+    for (size_t j = 0; j < per_pquery; ++j) {
+      pq.emplace_back(gen() % 5000, like(gen), unit(gen), unit(gen) * 0.1);
+      pq.back().lwr(unit(gen));
+    }
+    sample.push_back(std::move(pq));
+  }
+  return sample;
+}
+
+TEST(jplace_util, append_fixed)
+{
+  std::mt19937_64 gen(7);
+  std::uniform_real_distribution<double> wide(-1e6, 1e6);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  std::vector<double> values = { 0.0, -0.0, 0.5, 1.5, 2.5, 0.125, -0.125, 1e-300, -1e-20,
+                                 4.9e-324, 1e15, 1e19, 1e20, 1e300, -1e300, 0.1, 0.7,
+                                 std::numeric_limits<double>::infinity(),
+                                 -std::numeric_limits<double>::infinity(),
+                                 std::numeric_limits<double>::quiet_NaN() };
+  for (size_t i = 0; i < 20000; ++i) {
+    values.push_back(wide(gen));
+    values.push_back(unit(gen) * 1e-5);
+    // exact binary fractions, which hit the ties
+    values.push_back(static_cast<double>(gen() % 100000) / 1024.0);
+  }
+
+  for (unsigned int precision : {0u, 1u, 3u, 6u, 10u, 17u, 20u}) {
+    for (const auto v : values) {
+      std::string buffer;
+      append_fixed(buffer, v, precision);
+      ASSERT_EQ(stream_fixed(v, precision), buffer) << v << " at precision " << precision;
+    }
+  }
+}
+
+TEST(jplace_util, buffer_matches_stream)
+{
+  auto sample = random_sample(200, 7);
+  sample.back().add_duplicate("duplicate \"quoted\"");
+
+  for (unsigned int precision : {6u, 10u}) {
+    std::ostringstream ss;
+    ss.precision(precision);
+    ss.setf(std::ios::fixed, std::ios::floatfield);
+    sample_to_jplace_string(sample, ss, rtree_mapper());
+
+    std::string buffer;
+    sample_to_jplace_buffer(sample, buffer, rtree_mapper(), precision);
+
+    EXPECT_EQ(ss.str(), buffer);
+  }
+  EXPECT_EQ(escape_json("a\"b\\c\td"), "a\\\"b\\\\c\\u0009d");
+}
+
+TEST(jplace_util, parallel_buffer)
+{
+  auto sample = random_sample(3001, 5);
+
+  std::string serial;
+  sample_to_jplace_buffer(sample, serial, rtree_mapper(), 10, 1);
+
+  for (size_t threads : {0u, 2u, 3u, 8u}) {
+    std::string parallel = "prefix";
+    sample_to_jplace_buffer(sample, parallel, rtree_mapper(), 10, threads);
+    EXPECT_EQ("prefix" + serial, parallel);
+  }
+}
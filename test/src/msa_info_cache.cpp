@@ -0,0 +1,64 @@
+#include "Epatest.hpp"
+
+#include "io/msa_info_cache.hpp"
+#include "seq/MSA_Info.hpp"
+
+#include "genesis/utils/core/fs.hpp"
+
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+using namespace std;
+
+TEST(msa_info_cache, roundtrip)
+{
+  // work on a copy, to not leave a sidecar next to the test data
+  const string file = env->out_dir + "info_cache_test.fasta";
+  {
+    ifstream src(env->combined_file, ios::binary);
+    ofstream dst(file, ios::binary);
+    dst << src.rdbuf();
+  }
+  remove(info_cache_file(file).c_str());
+
+  auto info = make_msa_info(file, true);
+  EXPECT_TRUE(genesis::utils::file_exists(info_cache_file(file)));
+  ASSERT_EQ(info.offsets().size(), info.sequences());
+
+  // every offset points at the start of a record
+  ifstream in(file, ios::binary);
+  for (const auto o : info.offsets()) {
+    in.seekg(o);
+    EXPECT_EQ(in.get(), '>');
+  }
+
+  MSA_Info cached;
+  ASSERT_TRUE(load_msa_info_cache(file, cached));
+  EXPECT_EQ(cached.sites(), info.sites());
+  EXPECT_EQ(cached.sequences(), info.sequences());
+  EXPECT_EQ(cached.gap_count(), info.gap_count());
+  EXPECT_EQ(cached.gap_mask(), info.gap_mask());
+  EXPECT_EQ(cached.offsets(), info.offsets());
+
+  // a changed file invalidates the cache
+  {
+    ofstream out(file, ios::app);
+    out << "\n";
+  }
+  MSA_Info stale;
+  EXPECT_FALSE(load_msa_info_cache(file, stale));
+}
+
+TEST(msa_info_cache, compressed_offsets)
+{
+  // byte offsets into compressed data are of no use, whichever the format
+  const string file = env->out_dir + "info_cache_test.fasta.zst";
+  {
+    ofstream out(file, ios::binary);
+    const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+    out.write(reinterpret_cast<const char*>(zstd_magic), sizeof(zstd_magic));
+    out << "\n>not a record\nACGT\n";
+  }
+  EXPECT_TRUE(fasta_record_offsets(file).empty());
+}
@@ -0,0 +1,27 @@
+#include "Epatest.hpp"
+
+#include "util/numa.hpp"
+
+TEST(numa, get_numa_node)
+{
+  // without multiple nodes everything maps to the first
+  EXPECT_EQ(get_numa_node(5, 8, 1), 0u);
+  EXPECT_EQ(get_numa_node(0, 0, 2), 0u);
+
+  // consecutive threads share a node, all nodes are used
+  const size_t num_threads = 8;
+  const size_t num_nodes = 2;
+  for (size_t tid = 0; tid < 4; ++tid) {
+    EXPECT_EQ(get_numa_node(tid, num_threads, num_nodes), 0u);
+  }
+  for (size_t tid = 4; tid < num_threads; ++tid) {
+    EXPECT_EQ(get_numa_node(tid, num_threads, num_nodes), 1u);
+  }
+
+  // uneven splits still stay in range
+  for (size_t tid = 0; tid < 7; ++tid) {
+    EXPECT_LT(get_numa_node(tid, 7, 3), 3u);
+  }
+
+  EXPECT_GE(get_num_numa_nodes(), 1u);
+}
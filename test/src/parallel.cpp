@@ -0,0 +1,38 @@
+#include "Epatest.hpp"
+
+#include "util/parallel.hpp"
+
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+TEST(parallel, parallel_for)
+{
+  for (const auto schedule : {Schedule::kStatic, Schedule::kDynamic}) {
+    vector<size_t> done(100, 0);
+    parallel_for(10, done.size(), 4, [&](const size_t i) {
+      done[i] = i;
+    }, schedule);
+
+    for (size_t i = 0; i < done.size(); ++i) {
+      EXPECT_EQ(done[i], i < 10 ? 0u : i);
+    }
+  }
+
+  // nothing to do is fine
+  parallel_for(0, 0, 4, [](const size_t) {});
+}
+
+TEST(parallel, rethrows_first_error)
+{
+  for (const auto schedule : {Schedule::kStatic, Schedule::kDynamic}) {
+    EXPECT_THROW(
+      parallel_for(0, 100, 4, [](const size_t i) {
+        if (i % 7 == 3) {
+          throw runtime_error{"failed"};
+        }
+      }, schedule),
+      runtime_error);
+  }
+}
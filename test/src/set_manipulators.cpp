@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -464,3 +465,46 @@ TEST(set_manipulators, discard_by_support_threshold)
     EXPECT_EQ( num_expected[i++], num);
   }
 }
+
+TEST(set_manipulators, sort_canonically)
+{
+  // the same results, as different threads might have merged them
+  Sample<> sample_1;
+  sample_1.emplace_back(2, "c");
+  sample_1.back().emplace_back(4, -12.0, 0.1, 0.1);
+  sample_1.back().emplace_back(1, -10.0, 0.1, 0.1);
+  sample_1.emplace_back(0, "a");
+  sample_1.back().emplace_back(7, -10.0, 0.1, 0.1);
+  sample_1.back().emplace_back(3, -10.0, 0.1, 0.1);
+  sample_1.back().emplace_back(5, -9.0, 0.1, 0.1);
+  sample_1.emplace_back(1, "b");
+  sample_1.back().emplace_back(2, -10.0, 0.1, 0.1);
+
+  Sample<> sample_2;
+  sample_2.push_back(sample_1[1]);
+  sample_2.push_back(sample_1[2]);
+  sample_2.push_back(sample_1[0]);
+  std::reverse(sample_2[0].begin(), sample_2[0].end());
+  std::reverse(sample_2[2].begin(), sample_2[2].end());
+
+  for (auto sample : {&sample_1, &sample_2}) {
+    sort_canonically(*sample);
+    compute_and_set_lwr(*sample);
+    discard_by_support_threshold(*sample, 0.0, 1, 2);
+  }
+
+  string text_1, text_2;
+  sample_to_jplace_buffer(sample_1, text_1, rtree_mapper(), 10);
+  sample_to_jplace_buffer(sample_2, text_2, rtree_mapper(), 10);
+  EXPECT_EQ(text_1, text_2);
+
+  ASSERT_EQ(sample_1.size(), 3u);
+  EXPECT_EQ(sample_1[0].sequence_id(), 0u);
+  EXPECT_EQ(sample_1[1].sequence_id(), 1u);
+  EXPECT_EQ(sample_1[2].sequence_id(), 2u);
+  // equal weights stay ordered by edge
+  ASSERT_EQ(sample_1[0].size(), 2u);
+  EXPECT_EQ(sample_1[0][0].branch_id(), 5u);
+  EXPECT_EQ(sample_1[0][1].branch_id(), 3u);
+  EXPECT_EQ(sample_1[2][0].branch_id(), 1u);
+}